@@ -0,0 +1,298 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+/** @file 
+ * @brief  ブロードキャスト送信先管理関数群
+ * @author Takeharu KATO
+ */ 
+
+/** ブロードキャスト送信先排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex bcast_mutex = G_STATIC_MUTEX_INIT;
+
+/** 構成情報(ブロードキャストアドレス一覧)から得た送信先
+ * @attention 内部リンケージ
+ */
+static GArray *config_targets = NULL;
+
+/** ダイアルアップホストの送信先
+ * @attention 内部リンケージ
+ */
+static GArray *dialup_targets = NULL;
+
+/** 構成情報の送信先の再構築要求
+ * @attention 内部リンケージ
+ */
+static gint config_dirty = 1;
+
+/** ダイアルアップホストの送信先の再構築要求
+ * @attention 内部リンケージ
+ */
+static gint dialup_dirty = 1;
+
+/** 送信先を追加する
+ *  @param[in]  targets      送信先配列
+ *  @param[in]  bcast        ブロードキャストアドレス文字列
+ *  @param[in]  port         送信先ポート番号
+ *  @retval  0       正常終了
+ *  @retval  負の値  名前解決失敗
+ *  @attention 内部リンケージ
+ */
+static int
+add_config_target(GArray *targets, const char *bcast, int port) {
+	int                rc = 0;
+	struct addrinfo *info = NULL;
+	udp_send_target_t target;
+
+	rc = setup_addr_info(&info, bcast, port, SOCK_DGRAM, PF_UNSPEC);
+	if (rc < 0)
+		goto error_out;
+
+	if (info->ai_addrlen > sizeof(target.addr)) {
+		rc = -ENOSPC;
+		goto error_out;
+	}
+
+	memset(&target, 0, sizeof(target));
+	memcpy(&target.addr, info->ai_addr, info->ai_addrlen);
+	target.addrlen = info->ai_addrlen;
+	g_strlcpy(target.name, bcast, sizeof(target.name));
+	g_array_append_val(targets, target);
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	if (info != NULL)
+		freeaddrinfo(info);
+
+	return rc;
+}
+
+/** 構成情報から送信先を再構築する
+ *  @param[in]  con          UDPコネクション情報
+ *  @attention 内部リンケージ
+ *  @attention bcast_mutexを獲得して呼び出すこと
+ */
+static void
+rebuild_config_targets(const udp_con_t *con) {
+	int         rc = 0;
+	int       port = 0;
+	GSList *addr_top = NULL;
+	GSList *addr_list = NULL;
+
+	if (config_targets == NULL)
+		config_targets = g_array_new(FALSE, TRUE, 
+		    sizeof(udp_send_target_t));
+	g_array_set_size(config_targets, 0);
+
+	port = hostinfo_refer_ipmsg_port();
+
+	/*
+	 * 同一セグメントへのブロードキャスト
+	 */
+	rc = add_config_target(config_targets, 
+	    (con->family == PF_INET6) ? ("ff02::1") : ("255.255.255.255"), 
+	    port);
+	if (rc < 0)
+		war_out("Can not resolve local broadcast address:%d\n", rc);
+
+	/*
+	 * 構成情報に登録されたブロードキャストアドレス
+	 */
+	addr_top = addr_list = hostinfo_get_ipmsg_broadcast_list();
+	while(addr_list != NULL) {
+		gchar *element = addr_list->data;
+
+		rc = add_config_target(config_targets, element, port);
+		if (rc < 0)
+			war_out("Can not resolve broadcast address %s:%d\n", 
+			    element, rc);
+		g_free(element);
+		addr_list = g_slist_next(addr_list);
+	}
+	if (addr_top != NULL)
+		g_slist_free(addr_top);
+
+	dbg_out("%d broadcast targets\n", config_targets->len);
+}
+
+/** ダイアルアップホストの送信先を再構築する
+ *  @param[in]  con          UDPコネクション情報
+ *  @attention 内部リンケージ
+ *  @attention bcast_mutexを獲得して呼び出すこと
+ */
+static void
+rebuild_dialup_targets(const udp_con_t *con) {
+	int          i = 0;
+	int       port = 0;
+	udp_send_target_t *target = NULL;
+
+	if (dialup_targets == NULL)
+		dialup_targets = g_array_new(FALSE, TRUE, 
+		    sizeof(udp_send_target_t));
+	g_array_set_size(dialup_targets, 0);
+
+	port = hostinfo_refer_ipmsg_port();
+	userdb_collect_dialup_targets(con, port, dialup_targets);
+
+	/*
+	 * 受信時に記録したアドレスは送信元ポートを持つため, 
+	 * IPMSGのポート番号に置き換える.
+	 */
+	for(i = 0; i < dialup_targets->len; ++i) {
+		target = &g_array_index(dialup_targets, udp_send_target_t, i);
+		switch (target->addr.ss_family) {
+		case AF_INET:
+			((struct sockaddr_in *)&target->addr)->sin_port = 
+				htons(port);
+			break;
+		case AF_INET6:
+			((struct sockaddr_in6 *)&target->addr)->sin6_port = 
+				htons(port);
+			break;
+		default:
+			break;
+		}
+	}
+
+	dbg_out("%d dialup targets\n", dialup_targets->len);
+}
+
+/** 送信結果を確認し, 失敗した送信先を報告する
+ *  @param[in]  targets      送信先配列
+ *  @param[in]  is_dialup    ダイアルアップホストの送信先ならTRUE
+ *  @attention 内部リンケージ
+ */
+static void
+report_failed_targets(GArray *targets, gboolean is_dialup) {
+	int          i = 0;
+	udp_send_target_t *target = NULL;
+
+	for(i = 0; i < targets->len; ++i) {
+		target = &g_array_index(targets, udp_send_target_t, i);
+		if (target->result >= 0)
+			continue;
+
+		war_out("Can not send broadcast to %s:%s(%d)\n", 
+		    target->name, strerror(-target->result), -target->result);
+
+		if (is_dialup) {
+			/*
+			 * アドレスが変わった可能性があるため, 次回は
+			 * 名前解決からやり直す.
+			 */
+			userdb_invalidate_peer_sockaddr(target->name);
+			g_atomic_int_set(&dialup_dirty, 1);
+		}
+	}
+}
+
+/** 構成情報の送信先を再構築させる
+ *  @note ブロードキャストアドレス一覧やポート番号の変更時に呼び出す.
+ */
+void
+ipmsg_bcast_invalidate_config_targets(void) {
+
+	g_atomic_int_set(&config_dirty, 1);
+}
+
+/** ダイアルアップホストの送信先を再構築させる
+ *  @note ユーザ情報の変更時に呼び出す.
+ *        ユーザ情報のロックを保持したまま呼び出してもよい.
+ */
+void
+ipmsg_bcast_invalidate_dialup_targets(void) {
+
+	g_atomic_int_set(&dialup_dirty, 1);
+}
+
+/** ブロードキャストメッセージを全送信先に送信する
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  msg          送信するメッセージ
+ *  @param[in]  len          送信するメッセージ長
+ *  @retval  0以上   送信に失敗した送信先の数
+ *  @retval -EINVAL 引数異常
+ */
+int
+ipmsg_bcast_send_message(const udp_con_t *con, const char *msg, size_t len) {
+	int         rc = 0;
+	int   failures = 0;
+
+	if ( (con == NULL) || (msg == NULL) )
+		return -EINVAL;
+
+	g_static_mutex_lock(&bcast_mutex);
+
+	/*
+	 * 再構築中の無効化要求を取りこぼさないよう, 
+	 * 再構築前に要求を落とす.
+	 */
+	if (g_atomic_int_compare_and_exchange(&config_dirty, 1, 0))
+		rebuild_config_targets(con);
+	if (g_atomic_int_compare_and_exchange(&dialup_dirty, 1, 0))
+		rebuild_dialup_targets(con);
+
+	rc = udp_send_multi(con, (udp_send_target_t *)config_targets->data, 
+	    config_targets->len, msg, len);
+	if (rc > 0) {
+		failures += rc;
+		report_failed_targets(config_targets, FALSE);
+	}
+
+	rc = udp_send_multi(con, (udp_send_target_t *)dialup_targets->data, 
+	    dialup_targets->len, msg, len);
+	if (rc > 0) {
+		failures += rc;
+		report_failed_targets(dialup_targets, TRUE);
+	}
+
+	g_static_mutex_unlock(&bcast_mutex);
+
+	return failures;
+}
+
+/** ブロードキャスト送信先を解放する
+ */
+void
+ipmsg_bcast_cleanup(void) {
+
+	g_static_mutex_lock(&bcast_mutex);
+
+	if (config_targets != NULL) {
+		g_array_free(config_targets, TRUE);
+		config_targets = NULL;
+	}
+	if (dialup_targets != NULL) {
+		g_array_free(dialup_targets, TRUE);
+		dialup_targets = NULL;
+	}
+	g_atomic_int_set(&config_dirty, 1);
+	g_atomic_int_set(&dialup_dirty, 1);
+
+	g_static_mutex_unlock(&bcast_mutex);
+}
@@ -187,13 +187,16 @@ updateConfigWindowGroups(GtkWidget *comboEntry) {
 	return 0;
 }
 
-/** 添付ファイルの拡張部文字列を生成する
- *  @param[in]      pktno  パケット番号
+/** 添付ファイル情報の雛形と拡張部文字列を生成する
  *  @param[in]     editor 添付ファイルエディタのトップウィジェット
+ *  @param[out]  tmpl_p   添付ファイル情報の雛形を指すポインタの返却先
  *  @param[out]  ext_part 添付ファイルの拡張部文字列を指すポインタのアドレス
+ *  @note 添付ファイルの属性取得と拡張部文字列の生成は, 宛先数によらず
+ *        1度だけ行う. 添付ファイルが無い場合は, いずれも返却しない.
  */
 static void
-sendmessage_get_attachment_part(pktno_t pktno, GtkWidget *editor, const char **ext_part){
+sendmessage_prepare_attachment(GtkWidget *editor, 
+    attach_file_block_t **tmpl_p, const char **ext_part){
 	attach_file_block_t *afcb = NULL;
 	GtkWidget           *view = NULL;
 	GtkTreeModel       *model = NULL;
@@ -205,6 +208,8 @@ sendmessage_get_attachment_part(pktno_t pktno, GtkWidget *editor, const char **e
   
 	dbg_out("here\n");
 
+	g_assert(tmpl_p != NULL);
+	g_assert(*tmpl_p == NULL);
 	g_assert(ext_part != NULL);
 	g_assert(*ext_part == NULL);
 
@@ -233,64 +238,74 @@ sendmessage_get_attachment_part(pktno_t pktno, GtkWidget *editor, const char **e
 
 	if ( (count > 0) && 
 	    (get_attach_file_extention(afcb,(const gchar **)&string) == 0) ) {
-		add_upload_queue(pktno, afcb);
 		dbg_out("Attach file string:%s\n", string);
+		*tmpl_p = afcb;
 		*ext_part = string;  
+		return;
 	}
+
+	destroy_attach_file_block(&afcb);
 }
 
-/** 電文を送信する
+/** 選択された宛先のIPアドレスを収集する
  *  @param[in]      model  ホストリストのモデル 
  *  @param[in]       path  ホストリスト中の選択部分
  *  @param[in]       iter  選択部分を探査するイテレータ
- *  @param[in]     info_p  送信者情報
+ *  @param[in]     list_p  IPアドレスのリストを指すポインタのアドレス
  */
 static void
-do_send(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, 
-    gpointer info_p) {
-	send_info_t            *info = NULL;
+collect_send_addr(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, 
+    gpointer list_p) {
+	GList               **addrs = NULL;
 	gchar                *ipaddr = NULL;
-	GtkWidget *attachment_editor = NULL;
-	gchar              *ext_part = NULL;
+
+	addrs = (GList **)list_p;
+	gtk_tree_model_get (model, iter, USER_VIEW_IPADDR_ID, &ipaddr, -1);
+	if (ipaddr != NULL)
+		*addrs = g_list_prepend(*addrs, ipaddr);
+}
+
+/** 電文を送信する
+ *  @param[in]       info  送信者情報(宛先に依存しない部分は生成済みであること)
+ *  @param[in]     ipaddr  宛先IPアドレス
+ */
+static void
+do_send(send_info_t *info, const char *ipaddr) {
+	attach_file_block_t    *afcb = NULL;
 	int                       rc = 0 ;
 	int                   pkt_no = 0;
 	int                   lflags = 0;
 
-	info = (send_info_t *)info_p;
-	gtk_tree_model_get (model, iter, USER_VIEW_IPADDR_ID, &ipaddr, -1);
-
 	pkt_no = ipmsg_get_pkt_no();
 	lflags = info->flags;
 
 	dbg_out("Send to %s Flags[%x] from ui\n", ipaddr, lflags);
 
-	if ( lflags & IPMSG_FILEATTACHOPT) {
+	if ( (lflags & IPMSG_FILEATTACHOPT) && (info->attach_tmpl != NULL) ) {
 		/*
-		 *アタッチメント
+		 *アタッチメント(ファイル属性は雛形から複製する)
 		 */
-		attachment_editor = info->attachment_editor;
-		if (attachment_editor != NULL) {
-			dbg_out("This message has attachment\n");
-			ext_part = NULL;
-			sendmessage_get_attachment_part(pkt_no,
-			    GTK_WIDGET(attachment_editor), 
-			    (const char **)&ext_part);
-
-			if (ext_part == NULL) {
-				lflags &= ~IPMSG_FILEATTACHOPT;
-			}
-		}
+		dbg_out("This message has attachment\n");
+		if (clone_attach_file_block(info->attach_tmpl, &afcb) == 0)
+			add_upload_queue(pkt_no, afcb);
+		else
+			afcb = NULL;
 	}
+
+	if (afcb == NULL)
+		lflags &= ~IPMSG_FILEATTACHOPT;
+
 	/* FIXME:IPアドレスからアドレスファミリを取得して, udp
 	 * コネクションを獲得するように修正
 	 * ipmsg_send_send_msgには, udp_conは本来不要
 	 */
 	if ( lflags & IPMSG_FILEATTACHOPT) {
 		rc = ipmsg_send_send_msg(udp_con, ipaddr, lflags, pkt_no, 
-		    info->msg, ext_part);
-		if (rc == 0) {
+		    info->msg, info->ext_part);
+		if (rc == 0) 
 			ref_attach_file_block(pkt_no, ipaddr);
-		}
+		else
+			release_attach_file_block(pkt_no, TRUE);
 	} else {
 		rc = ipmsg_send_send_msg(udp_con, ipaddr, lflags, pkt_no, 
 		    info->msg, NULL);
@@ -299,10 +314,49 @@ do_send(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
 	if (rc != 0)
 		ipmsg_err_dialog(_("Can not send message to %s pktno=%d"), 
 		    ipaddr, pkt_no);
+}
+
+/** 選択された全宛先に電文を送信する
+ *  @param[in]        sel  ホストリストの選択
+ *  @param[in]       info  送信者情報
+ *  @note 宛先に依存しない処理(添付ファイルの属性取得, 拡張部の生成,
+ *        コードセット変換)は, 宛先数によらず1度だけ行う.
+ */
+static void
+do_send_all(GtkTreeSelection *sel, send_info_t *info) {
+	GList                 *addrs = NULL;
+	GList                  *node = NULL;
+	gboolean             batched = FALSE;
 
-	if (ext_part != NULL)
-		g_free(ext_part);
-	g_free(ipaddr);
+	gtk_tree_selection_selected_foreach(sel, collect_send_addr, &addrs);
+	addrs = g_list_reverse(addrs);
+
+	info->attach_tmpl = NULL;
+	info->ext_part = NULL;
+	if ( (info->flags & IPMSG_FILEATTACHOPT) && 
+	    (info->attachment_editor != NULL) ) 
+		sendmessage_prepare_attachment(
+			GTK_WIDGET(info->attachment_editor), 
+			&info->attach_tmpl, (const char **)&info->ext_part);
+
+	batched = (ipmsg_send_batch_begin(info->msg, info->ext_part) == 0);
+	if (batched)
+		ipmsg_send_batch_prepare(addrs, info->flags);
+
+	for(node = addrs; node != NULL; node = g_list_next(node)) 
+		do_send(info, (const char *)node->data);
+
+	if (batched)
+		ipmsg_send_batch_end();
+
+	if (info->attach_tmpl != NULL)
+		destroy_attach_file_block(&info->attach_tmpl);
+	if (info->ext_part != NULL)
+		g_free(info->ext_part);
+	info->ext_part = NULL;
+
+	g_list_foreach(addrs, (GFunc)g_free, NULL);
+	g_list_free(addrs);
 }
 
 static int
@@ -1595,6 +1649,7 @@ on_viewwindowReplyBtn_clicked          (GtkButton       *button,
   ipmsg_private_data_t *priv=NULL;
   ipmsg_recvmsg_private_t *sender_info;
   GtkWidget *messageUserTree;
+  char *cite_string=NULL;
   int i;
 
   dbg_out("here\n");
@@ -1636,6 +1691,8 @@ on_viewwindowReplyBtn_clicked          (GtkButton       *button,
     buffer=gtk_text_view_get_buffer(text_view);
     text_line=gtk_text_buffer_get_line_count(buffer);
     dbg_out("lines:%d\n",text_line);
+    if (hostinfo_get_ipmsg_cite_string(&cite_string))
+      text_line=0;  /* メモリ不足 */
     for(i=0;i<text_line;++i) {
       
       gtk_text_buffer_get_iter_at_line(buffer,&start_iter,i);
@@ -1648,12 +1705,14 @@ on_viewwindowReplyBtn_clicked          (GtkButton       *button,
 				      &end_iter,
 				      FALSE);
       g_assert(string);
-      gtk_text_buffer_insert_at_cursor(new_buffer,hostinfo_refer_ipmsg_cite_string(),-1);
+      gtk_text_buffer_insert_at_cursor(new_buffer,cite_string,-1);
       gtk_text_buffer_insert_at_cursor(new_buffer," ",-1);
       gtk_text_buffer_insert_at_cursor(new_buffer,string,-1);
       dbg_out("string:%s\n",string);
       g_free(string);
     }
+    if (cite_string)
+      g_free(cite_string);
   }
 
   gtk_widget_show (messageWindow);
@@ -1763,7 +1822,10 @@ on_configWindow_show                   (GtkWidget       *widget,
   g_assert(group_index>=0);
   gtk_combo_box_set_active(GTK_COMBO_BOX(groupEntry),group_index);
 
-  gtk_entry_set_text(GTK_ENTRY(logfile_entry), hostinfo_refer_ipmsg_logfile());
+  if (!hostinfo_get_ipmsg_logfile(&entry_string)) {
+    gtk_entry_set_text(GTK_ENTRY(logfile_entry), entry_string);
+    g_free(entry_string);
+  }
 
   if (hostinfo_refer_ipmsg_default_confirm())
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(configOpenCheckChkBtn),TRUE);
@@ -2945,6 +3007,7 @@ on_sendBtn_clicked                     (GtkButton       *button,
   /*
    * 添付
    */
+  memset(&info,0,sizeof(send_info_t));
   info.flags=flags;
   info.msg=string;
   if (attachment_editor) {
@@ -2953,7 +3016,7 @@ on_sendBtn_clicked                     (GtkButton       *button,
     info.flags |= IPMSG_FILEATTACHOPT;
   }
 
-  gtk_tree_selection_selected_foreach(sel,do_send,&info);
+  do_send_all(sel,&info);
 
   if (hostinfo_is_ipmsg_absent()) { /* 不在モード強制解除 */
     hostinfo_set_ipmsg_absent(FALSE);
@@ -333,6 +333,35 @@ error_out:
 	return rc;
 }
 
+/** 送信先がUTF-8で送信できるホストか判定する
+ *  @param[in]  ipaddr    送信先IPアドレス
+ *                           - IPMSG_PROTOCOL_ENTRY_PKT_ADDR ブロードキャスト系パケット
+ *  @retval  TRUE    UTF-8で送信する
+ *  @retval  FALSE   デフォルトコードセットで送信する
+ */
+gboolean
+ipmsg_is_utf8_peer(const char *ipaddr) {
+#if defined(IPMSG_UTF8_SUPPORT)
+	int                      rc = 0;
+	ipmsg_cap_t        peer_cap = 0;
+	ipmsg_cap_t  peer_crypt_cap = 0;
+
+	/*
+	 * ブロードキャスト系以外のパケットの場合, UTF-8送信を試みる
+	 */
+	if (ipaddr == IPMSG_PROTOCOL_ENTRY_PKT_ADDR) 
+		return FALSE;
+
+	rc = userdb_get_cap_by_addr(ipaddr, &peer_cap, &peer_crypt_cap);
+	if (rc != 0)
+		return FALSE; /* 能力不明  */
+
+	return (peer_cap & IPMSG_UTF8OPT) ? (TRUE) : (FALSE);
+#else
+	return FALSE;
+#endif  /*  IPMSG_UTF8_SUPPORT  */
+}
+
 /** 文字コードを外部形式に変換する
  *  @param[in]  ipaddr    変換後の文字列を送信する先を表すIPアドレス
  *                           - IPMSG_PROTOCOL_ENTRY_PKT_ADDR デフォルトコードセットへ変換
@@ -346,10 +375,8 @@ error_out:
 int
 ipmsg_convert_string_external(const char *ipaddr, const char *string, const gchar **to_string) {
 	int                      rc = 0;
-	ipmsg_cap_t        peer_cap = 0;
 	gsize              read_len = 0;
 	gsize             write_len = 0;
-	ipmsg_cap_t  peer_crypt_cap = 0;
 	GError          *error_info = NULL;
 	gchar     *converted_string = NULL;
 	const char *external_encode = NULL;
@@ -357,21 +384,10 @@ ipmsg_convert_string_external(const char *ipaddr, const char *string, const gcha
 	if ( (string == NULL) || (to_string == NULL) )
 		return -EINVAL;
 	
-#if defined(IPMSG_UTF8_SUPPORT)
 	/*
 	 * UTF-8ホスト対応
 	 */
-	if (ipaddr != IPMSG_PROTOCOL_ENTRY_PKT_ADDR) {
-		/*
-		 * ブロードキャスト系以外のパケットの場合, UTF-8送信を試みる
-		 */
-		rc = userdb_get_cap_by_addr(ipaddr, &peer_cap, &peer_crypt_cap);
-		if (rc != 0) {
-			goto start_default_encoding; /* 能力不明  */
-		}
-
-		if ( !(peer_cap & IPMSG_UTF8OPT) )
-			goto start_default_encoding; /* 非UTF-8ホスト  */
+	if (ipmsg_is_utf8_peer(ipaddr)) {
 		/*
 		 * UTF-8で送信
 		 */
@@ -385,9 +401,7 @@ ipmsg_convert_string_external(const char *ipaddr, const char *string, const gcha
 
 		goto convert_end;
 	}
-#endif  /*  IPMSG_UTF8_SUPPORT  */
 
-start_default_encoding:	
 	/*
 	 * デフォルトエンコーディング
 	 */
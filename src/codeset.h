@@ -49,6 +49,7 @@
 #define IPMSG_PROTO_CODE    IPMSG_EXTERNAL_CHARCODE
 
 int setup_encoding_combobox(GtkComboBox *);
+gboolean ipmsg_is_utf8_peer(const char *);
 int ipmsg_convert_string_external(const char *, const char *, const gchar **);
 int ipmsg_convert_string_internal(const char *, const char *, const gchar **);
 int convert_string_internal(const char *, const gchar **);
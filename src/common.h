@@ -50,6 +50,7 @@
 #include <libgnomevfs/gnome-vfs.h>
 #include <libgnomevfs/gnome-vfs-utils.h>
 #include <libgnomevfs/gnome-vfs-mime-handlers.h>
+#include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -129,6 +130,7 @@
 #include "downloads.h"
 #include "codeset.h"
 #include "protocol.h"
+#include "trace.h"
 #include "msgout.h"
 #include "private.h"
 #include "compat.h"
@@ -137,4 +139,7 @@
 #include "cryptcommon.h"
 #include "dbusif.h"
 #include "screensaver.h"
+#include "uievent.h"
+#include "bcast.h"
+#include "recvcrypt.h"
 #endif  /* COMMON_H */
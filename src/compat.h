@@ -35,6 +35,7 @@
 
 #if !GLIB_CHECK_VERSION(2,10,0)
 #define g_slice_new(type) g_malloc(sizeof(type))
+#define g_slice_new0(type) g_malloc0(sizeof(type))
 #define g_slice_free(type,data_p) g_free((data_p))
 #endif 
 
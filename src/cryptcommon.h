@@ -40,6 +40,7 @@
 
 #include "ipmsg.h"
 #include "base64.h"
+#include "hexcodec.h"
 #include "pubcrypt.h"
 #include "symcrypt.h"
 #include "pbkdf2.h"
@@ -51,6 +52,15 @@
 /** 乱数発生試行回数の最大値
  */
 #define CRYPT_RND_MAX_RETRY    (100)
+/** スレッド毎の乱数プールのサイズ(バイト)
+ */
+#define CRYPT_RND_POOL_SIZE    (1024)
+/** 乱数プールを経由せずに直接生成する要求長(バイト)
+ */
+#define CRYPT_RND_DIRECT_LEN   (CRYPT_RND_POOL_SIZE / 4)
+/** 乱数生成器の再シード間隔(ms)
+ */
+#define CRYPT_RND_RESEED_INTERVAL_MS  (10 * 60 * 1000)
 /** 公開鍵/秘密鍵保存ディレクトリ
  */
 #define G2IPMSG_KEY_DIR        ".g2ipmsg"
@@ -87,11 +97,28 @@
  */
 #define PUBKEY_MAX_RETRY                    (5)
 
+/** 複数宛先向け暗号化で並行してセッションキーの暗号化と署名を行う
+ *  ワーカスレッド数の上限
+ */
+#define CRYPT_ENCRYPT_MAX_WORKERS           (4)
+
 #if defined(USE_OPENSSL)
-int add_timing_entropy(void);
+/** 複数宛先向け暗号化要求
+ */
+typedef struct _ipmsg_encrypt_req{
+	const char      *peer_addr;  /*  送信先IPアドレス  */
+	const char        *message;  /*  暗号化するメッセージ(外部形式)  */
+	unsigned char      *result;  /*  暗号化したメッセージ(呼び出し元で解放)  */
+	size_t                 len;  /*  暗号化メッセージ長  */
+	int                     rc;  /*  処理結果  */
+}ipmsg_encrypt_req_t;
+
+int generate_rand_init(void);
+void generate_rand_cleanup(void);
 int generate_rand(unsigned char *, size_t );
 int ipmsg_encrypt_message(const char *, const char *, unsigned char **, size_t *);
 int ipmsg_decrypt_message(const char *, const char *, unsigned char **, size_t *);
+int ipmsg_encrypt_message_multi(ipmsg_encrypt_req_t *, int );
 GtkWidget *internal_create_crypt_config_window(void);
 int enter_password(void);
 
@@ -30,51 +30,6 @@
  * @author Takeharu KATO
  */ 
 
-/** 16進->10進変換用テーブル
- * @attention 内部リンケージ
- */
-static char *hexstr = "0123456789abcdef";
-
-/** 16進->10進変換を行う
- *  @param[in]   ch           16進数文字(0-9a-fA-F)
- *  @param[out]  index        chの10進変換結果返却領域
- *  @retval  0       正常終了
- *  @retval -EINVAL  引数異常(indexがNULL, chが16進数文字でない)
- *  @retval -ESRCH   変換できなかった(変換テーブル内に当該の文字がなかった)
- *  @attention 内部リンケージ
- */
-static int 
-get_hexstr_index(const char ch, char *index){
-	int         rc = 0;
-	char       ind = 0;
-	int  search_ch = 0;
-	char    *found = NULL;
-
-	if ( (index == NULL) || ( !isxdigit(ch) ) ) {
-		rc = -EINVAL;
-		goto error_out;
-	}
-	  
-	search_ch = tolower((int)ch);
-
-	found = strchr(hexstr, (int)search_ch);
-	if (found == NULL) {
-		err_out("Character %c(%c in original message) can not be found.\n",
-		    search_ch, ch);
-		rc = -ESRCH;
-		goto error_out;
-	}
-
-	ind = (char)(found - hexstr);  /* 16進->10進変換 */
-
-	*index = ind;  /* 値返却 */
-
-	rc = 0; /* 正常終了 */
-
-error_out:
-	return rc;
-}
-
 /** 与えられたバッファ内の各バイトの内容を16進で表示する.
  *  @param[in]  buff           16進数文字(0-9a-fA-F)
  *  @param[in]  len            バッファサイズ
@@ -248,10 +203,8 @@ static int
 string_bin2hex(const u_int8_t *bindata, int len, unsigned char **ret_p)
 {
 	int                rc = 0;
-	int                 i = 0;
 	size_t        buf_len = 0;
 	unsigned char   *buff = NULL;
-	unsigned char *buff_p = NULL;
 
 	if ( (bindata == NULL) || (ret_p == NULL) ) {
 		rc = -EINVAL;
@@ -266,17 +219,10 @@ string_bin2hex(const u_int8_t *bindata, int len, unsigned char **ret_p)
 		goto error_out;
 	}
 
-	memset(buff, 0, buf_len); /* バッファを0クリアする */
-	
 	/*
-	 * 変換
+	 * 変換(小文字で出力し, ヌルターミネートする)
 	 */
-	for (i = 0, buff_p = buff; i < len; ++i) {
-		    *buff_p++ = hexstr[bindata[i] >> 4];
-		    *buff_p++ = hexstr[bindata[i] & 0x0f];
-	}
-
-	*buff_p = '\0'; /* 文字列として扱うようにヌルターミネートする */
+	hexcodec_encode(bindata, len, (gchar *)buff);
 
 	/*
 	 * 返却
@@ -301,12 +247,9 @@ static int
 string_hex2bin(const char *hexdata, int *len,unsigned char **ret_p)
 {
 	int                rc = 0;
-	int                 i = 0;
 	size_t       data_len = 0;
 	size_t        buf_len = 0;
 	unsigned char   *buff = NULL;
-	unsigned char *buff_p = NULL;
-	char              low = 0, high = 0;
 
 	data_len = strlen(hexdata);
 	buf_len = data_len / 2;
@@ -318,19 +261,13 @@ string_hex2bin(const char *hexdata, int *len,unsigned char **ret_p)
 		goto error_out;
 	}
 
-	memset(buff, 0, buf_len);
+	/*
+	 * 奇数長の場合, 末尾の1文字は無視する
+	 */
+	rc = hexcodec_decode(hexdata, buf_len * 2, buff);
+	if (rc != 0)
+		goto error_out;
 
-	for (i=0, buff_p = buff; 
-	     ( ( (i + 1) < data_len) && (hexdata[i] != '\0') && (hexdata[i+1])); ) {
-		rc = get_hexstr_index(hexdata[i++], &high);
-		if (rc != 0)
-			goto error_out;
-		rc = get_hexstr_index(hexdata[i++], &low);
-		if (rc != 0)
-			goto error_out;
-		*buff_p++ = ( ( (high << 4) & 0xf0) | (low & 0xf) );
-	}
-  
 	*ret_p = buff;
 	*len = buf_len;
 
@@ -342,92 +279,109 @@ string_hex2bin(const char *hexdata, int *len,unsigned char **ret_p)
 	return rc;
 }
 
-/** メッセージを暗号化する
- *  @param[in]   peer_addr     送信先IPアドレス
+/** 複数宛先向け暗号化で共有する暗号化済み本文
+ */
+typedef struct _encrypt_body{
+	unsigned long     skey_type;  /*  対称鍵暗号種別  */
+	const char           *plain;  /*  暗号化前の本文(要求元の領域を指す)  */
+	char           *session_key;  /*  セッションキー  */
+	size_t             skey_len;  /*  セッションキー長  */
+	unsigned char     *enc_body;  /*  暗号化した本文(hex形式)  */
+}encrypt_body_t;
+
+/** 複数宛先向け暗号化の宛先毎の処理
+ */
+typedef struct _encrypt_job{
+	ipmsg_encrypt_req_t    *req;  /*  暗号化要求  */
+	unsigned long      peer_cap;  /*  ピアの暗号化能力  */
+	RSA                 *pubkey;  /*  ピアの公開鍵(解析済み)  */
+	encrypt_body_t        *body;  /*  暗号化済み本文  */
+}encrypt_job_t;
+
+/** セッションキーを生成して本文を暗号化する
+ *  @param[in]   skey_type     対称鍵暗号種別
  *  @param[in]   message       暗号化するメッセージ
- *  @param[out]  ret_str       暗号化したメッセージを指すポインタ変数のアドレス
- *  @param[out]  len           暗号化メッセージ長返却領域
+ *  @param[out]  session_key_p セッションキーを指すポインタ変数のアドレス
+ *  @param[out]  skey_len_p    セッションキー長返却領域
+ *  @param[out]  enc_body_p    暗号化した本文(hex形式)を指すポインタ変数のアドレス
  *  @retval  0       正常終了
- *  @retval -EINVAL  引数異常
+ *  @retval -ENOMEM  メモリ不足
+ *  @attention 内部リンケージ
  */
-int
-ipmsg_encrypt_message(const char *peer_addr, const char *message, 
-    unsigned char **ret_str, size_t *len) {
+static int
+encrypt_message_body(unsigned long skey_type, const char *message, 
+    char **session_key_p, size_t *skey_len_p, unsigned char **enc_body_p) {
 	int                           rc = 0;
-	int                        retry = 0;
-	unsigned long           peer_cap = 0;
-	unsigned long          skey_type = 0, akey_type = 0;
 	char                *session_key = NULL;
-	char                   *enc_skey = NULL;
 	size_t                  skey_len = 0;
-	char                      *key_e = NULL, *key_n = NULL;
 	char               *raw_enc_body = NULL;
 	unsigned char          *enc_body = NULL;
 	size_t                   enc_len = 0;
-	unsigned char *encrypted_message = NULL;
-	size_t                 total_len = 0;
-	unsigned char              *sign = NULL;
-	unsigned long         sign_type = 0;
-	int                           i = 0;
-
-	if ( (peer_addr == NULL) || (message == NULL) || 
-	     (ret_str == NULL) || (len == NULL) ) {
-		rc = -EINVAL;
-		goto error_out;
-	}
-
-	/*  相手の暗号化能力を取得  */
-	retry = PUBKEY_MAX_RETRY;
-	do{
-		rc = userdb_wait_public_key(peer_addr, &peer_cap, &key_e, &key_n);
-		if ( (rc < 0) && (rc != -EINTR) ) {
-			goto error_out; /* 明示的なエラー */
-		}
-		if (rc == 0) { /* 見付けた */
-			dbg_out("Found: \n\taddr = %s\n"
-			    "\tcap = %x\n"
-			    "\tpubkey-e = %s\n"
-			    "\tpubkey-n = %s\n",
-			    peer_addr,
-			    peer_cap,
-			    key_e,
-			    key_n);
-
-			break; 
-		}
-		--retry;
-	} while(retry > 0);
-  
-	if ( (rc != 0) && (retry == 0) )
-		goto free_peer_key_out; /* 取得失敗 */
 
-	/*
-	 *暗号化アルゴリズムを選択
-	 */
-	rc = select_symmetric_key(peer_cap, &skey_type, 
-	    hostinfo_refer_ipmsg_crypt_policy_is_speed());
-	if (rc != 0)
-		goto free_peer_key_out;
-	
-	/*
-	 * セッションキー作成と本文の暗号化
-	 */
 	rc = symcrypt_encrypt_message(skey_type, message, &session_key,
 	    &skey_len, &raw_enc_body, &enc_len);
 	if (rc != 0)
-		goto free_peer_key_out;
+		goto error_out;
 
 	rc = string_bin2hex((const u_int8_t *)raw_enc_body, enc_len, &enc_body);
 	if (rc != 0)
 		goto free_session_key_out;    
 
+	*session_key_p = session_key;
+	*skey_len_p = skey_len;
+	*enc_body_p = enc_body;
+	session_key = NULL;
+
+	rc = 0; /* 正常終了 */
+
+free_session_key_out:
+	if (session_key != NULL) {
+		memset(session_key, 0, skey_len);
+		g_free(session_key);
+	}
+
+	if (raw_enc_body != NULL)
+		g_free(raw_enc_body);
+
+error_out:
+	return rc;
+}
+
+/** セッションキーをピアの公開鍵で暗号化し, 署名を付して暗号化電文を生成する
+ *  @param[in]   peer_cap      ピアの暗号化能力
+ *  @param[in]   pubkey        ピアの公開鍵(解析済み)
+ *  @param[in]   skey_type     対称鍵暗号種別
+ *  @param[in]   session_key   セッションキー
+ *  @param[in]   skey_len      セッションキー長
+ *  @param[in]   enc_body      暗号化した本文(hex形式)
+ *  @param[out]  ret_str       暗号化したメッセージを指すポインタ変数のアドレス
+ *  @param[out]  len           暗号化メッセージ長返却領域
+ *  @retval  0       正常終了
+ *  @retval -ENOMEM  メモリ不足
+ *  @note 自ホストの秘密鍵とピアの公開鍵以外の共有資源を参照しないため,
+ *        複数のスレッドから同時に呼び出してよい.
+ *  @attention 内部リンケージ
+ */
+static int
+wrap_session_key_and_sign(unsigned long peer_cap, RSA *pubkey, 
+    unsigned long skey_type, const char *session_key, 
+    size_t skey_len, const unsigned char *enc_body, 
+    unsigned char **ret_str, size_t *len) {
+	int                           rc = 0;
+	unsigned long          akey_type = 0;
+	char                   *enc_skey = NULL;
+	unsigned char *encrypted_message = NULL;
+	size_t                 total_len = 0;
+	unsigned char              *sign = NULL;
+	unsigned long         sign_type = 0;
+
 	/*
 	 * セッションキーを暗号化
 	 */
-	rc = pcrypt_encrypt_message(peer_cap, key_e, key_n, session_key, 
+	rc = pcrypt_encrypt_message_with_key(peer_cap, pubkey, session_key, 
 	    skey_len, &enc_skey, &akey_type);
 	if (rc != 0)
-		goto free_enc_body_out;
+		goto error_out;
 	/*
 	 * 暗号化文字列長取得
 	 * longの長さは, 64ビット環境の場合は, 8バイトになるので, 
@@ -457,17 +411,15 @@ ipmsg_encrypt_message(const char *peer_addr, const char *message,
 
 	dbg_out("Encrypted body:%s\n", encrypted_message);
 
+	/*
+	 * 鍵種別(%x), 暗号化鍵, 本文, 署名はいずれも小文字のhex形式で
+	 * 生成しているため, 小文字への変換は不要.
+	 */
 	if (sign_type != 0) {
-		/*
-		 * 小文字に変換
-		 */
-		for(i = 0; i < total_len; ++i) {
-			encrypted_message[i] = tolower((int)encrypted_message[i]);
-		}
 		rc = pcrypt_sign(akey_type, sign_type, encrypted_message, &sign);
 
 		if (rc != 0)
-			goto free_sign_out;
+			goto free_message_out;
 
 		g_free(encrypted_message);	
 		/*  
@@ -475,8 +427,10 @@ ipmsg_encrypt_message(const char *peer_addr, const char *message,
 		 */
 		total_len += (strlen(sign) + 1); /* +1は, デリミタ分 */
 		encrypted_message = g_malloc(total_len);
-		if (encrypted_message == NULL)
+		if (encrypted_message == NULL) {
+			rc = -ENOMEM;
 			goto free_sign_out;
+		}
 		snprintf(encrypted_message, total_len, "%x:%s:%s:%s",
 		    (skey_type|akey_type|sign_type), 
 		    enc_skey,
@@ -486,43 +440,211 @@ ipmsg_encrypt_message(const char *peer_addr, const char *message,
 		dbg_out("Signed body:%s\n", encrypted_message);
 	}
 
-	/*
-	 * 小文字に変換
-	 */
 	total_len = strlen(encrypted_message);
-	for(i = 0; i < total_len; ++i) {
-		encrypted_message[i] = tolower((int)encrypted_message[i]);
-	}
-	
+
 	/*
 	 * 解析結果返却
 	 */
 
 	*ret_str = encrypted_message;
 	*len     = total_len;
+	encrypted_message = NULL;
 
 	rc = 0;
 
+free_message_out:
+	if (encrypted_message != NULL)
+		g_free(encrypted_message);
+
 free_sign_out:
 	if (sign != NULL)
 		g_free(sign);
 
-free_enc_body_out:
-	if (enc_body != NULL)
-		g_free(enc_body);
-
 free_encoded_session_key:
 	if (enc_skey != NULL)
 		g_free(enc_skey);
 
-free_session_key_out:
-	if (session_key != NULL)
-		g_free(session_key);
+error_out:
+	return rc;
+}
 
-	if (raw_enc_body != NULL)
-		g_free(raw_enc_body);
+/** 複数宛先向け暗号化の宛先毎の処理を行う(ワーカスレッド)
+ *  @param[in]   data          宛先毎の処理(encrypt_job_t)
+ *  @param[in]   user_data     未使用
+ *  @attention 内部リンケージ
+ */
+static void
+encrypt_job_worker(gpointer data, gpointer user_data) {
+	encrypt_job_t             *job = NULL;
+	encrypt_body_t           *body = NULL;
+
+	job = (encrypt_job_t *)data;
+	body = job->body;
+
+	job->req->rc = wrap_session_key_and_sign(job->peer_cap, 
+	    job->pubkey, body->skey_type, body->session_key, 
+	    body->skey_len, body->enc_body, &job->req->result, &job->req->len);
+}
+
+/** 暗号化済み本文を検索し, 無ければ暗号化して登録する
+ *  @param[in,out] bodies_p    暗号化済み本文のリストのアドレス
+ *  @param[in]     skey_type   対称鍵暗号種別
+ *  @param[in]     message     暗号化するメッセージ
+ *  @param[out]    body_p      暗号化済み本文を指すポインタ変数のアドレス
+ *  @retval  0       正常終了
+ *  @retval -ENOMEM  メモリ不足
+ *  @attention 内部リンケージ
+ */
+static int
+refer_encrypt_body(GSList **bodies_p, unsigned long skey_type, 
+    const char *message, encrypt_body_t **body_p) {
+	int                     rc = 0;
+	GSList               *node = NULL;
+	encrypt_body_t       *body = NULL;
+
+	for(node = *bodies_p; node != NULL; node = g_slist_next(node)) {
+		body = node->data;
+		if ( (body->skey_type == skey_type) && 
+		    ( (body->plain == message) || 
+			(strcmp(body->plain, message) == 0) ) ) {
+			*body_p = body;
+			return 0;
+		}
+	}
+
+	body = g_slice_new0(encrypt_body_t);
+	if (body == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+
+	rc = encrypt_message_body(skey_type, message, &body->session_key, 
+	    &body->skey_len, &body->enc_body);
+	if (rc != 0)
+		goto free_body_out;
+
+	body->skey_type = skey_type;
+	body->plain = message;
+	*bodies_p = g_slist_prepend(*bodies_p, body);
+	*body_p = body;
+
+	rc = 0; /* 正常終了 */
+
+	goto error_out;
+
+free_body_out:
+	g_slice_free(encrypt_body_t, body);
+
+error_out:
+	return rc;
+}
+
+/** メッセージを暗号化する
+ *  @param[in]   peer_addr     送信先IPアドレス
+ *  @param[in]   message       暗号化するメッセージ
+ *  @param[out]  ret_str       暗号化したメッセージを指すポインタ変数のアドレス
+ *  @param[out]  len           暗号化メッセージ長返却領域
+ *  @retval  0       正常終了
+ *  @retval -EINVAL  引数異常
+ */
+int
+ipmsg_encrypt_message(const char *peer_addr, const char *message, 
+    unsigned char **ret_str, size_t *len) {
+	int                           rc = 0;
+	int                        retry = 0;
+	unsigned long           peer_cap = 0;
+	unsigned long          skey_type = 0;
+	char                *session_key = NULL;
+	size_t                  skey_len = 0;
+	char                      *key_e = NULL, *key_n = NULL;
+	RSA                      *pubkey = NULL;
+	unsigned char          *enc_body = NULL;
+
+	if ( (peer_addr == NULL) || (message == NULL) || 
+	     (ret_str == NULL) || (len == NULL) ) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	/*  解析済みの公開鍵を保持していれば, それを使用する  */
+	rc = userdb_refer_peer_rsa_key(peer_addr, &peer_cap, &pubkey);
+	if (rc == 0)
+		goto select_algo;
+
+	/*  相手の暗号化能力を取得  */
+	retry = PUBKEY_MAX_RETRY;
+	do{
+		rc = userdb_wait_public_key(peer_addr, &peer_cap, &key_e, &key_n);
+		if ( (rc < 0) && (rc != -EINTR) ) {
+			goto error_out; /* 明示的なエラー */
+		}
+		if (rc == 0) { /* 見付けた */
+			dbg_out("Found: \n\taddr = %s\n"
+			    "\tcap = %x\n"
+			    "\tpubkey-e = %s\n"
+			    "\tpubkey-n = %s\n",
+			    peer_addr,
+			    peer_cap,
+			    key_e,
+			    key_n);
+
+			break; 
+		}
+		--retry;
+	} while(retry > 0);
+  
+	if ( (rc != 0) && (retry == 0) )
+		goto free_peer_key_out; /* 取得失敗 */
+
+	/*
+	 * 受け取った公開鍵を解析する(以降の送信では解析済みの鍵を使用する)
+	 */
+	rc = userdb_refer_peer_rsa_key(peer_addr, &peer_cap, &pubkey);
+	if (rc != 0)
+		rc = pcrypt_convert_peer_key(key_e, key_n, &pubkey);
+	if (rc != 0)
+		goto free_peer_key_out;
+
+select_algo:
+	/*
+	 *暗号化アルゴリズムを選択
+	 */
+	rc = select_symmetric_key(peer_cap, &skey_type, 
+	    hostinfo_refer_ipmsg_crypt_policy_is_speed());
+	if (rc != 0)
+		goto free_peer_key_out;
+	
+	/*
+	 * セッションキー作成と本文の暗号化
+	 */
+	rc = encrypt_message_body(skey_type, message, &session_key, 
+	    &skey_len, &enc_body);
+	if (rc != 0)
+		goto free_peer_key_out;
+
+	/*
+	 * セッションキーを暗号化し, 署名を付す
+	 */
+	rc = wrap_session_key_and_sign(peer_cap, pubkey, skey_type, 
+	    session_key, skey_len, enc_body, ret_str, len);
+	if (rc != 0)
+		goto free_enc_body_out;
+
+	rc = 0;
+
+free_enc_body_out:
+	if (enc_body != NULL)
+		g_free(enc_body);
+
+	if (session_key != NULL) {
+		memset(session_key, 0, skey_len);
+		g_free(session_key);
+	}
 
 free_peer_key_out:
+	if (pubkey != NULL)
+		RSA_free(pubkey);
+
 	if (key_e != NULL)
 		g_free(key_e);
 
@@ -533,6 +655,114 @@ error_out:
 	return rc;
 }
 
+/** 複数の宛先に同じメッセージを暗号化する
+ *  @param[in,out] reqs        暗号化要求の配列
+ *  @param[in]     count       暗号化要求の数
+ *  @retval  0       正常終了(各宛先の処理結果はreqs[i].rcに返却する)
+ *  @retval -EINVAL  引数異常
+ *  @note 本文の暗号化は, 対称鍵暗号種別と本文の組毎に1度だけ行い,
+ *        セッションキーを共有する. 宛先毎には, セッションキーの暗号化と
+ *        署名のみをワーカスレッドで並行して行う.
+ *        公開鍵を保持していない宛先は, 鍵の到着を待たずに-ENOENTとする
+ *        (呼び出し元でipmsg_encrypt_messageを使用すること).
+ */
+int
+ipmsg_encrypt_message_multi(ipmsg_encrypt_req_t *reqs, int count) {
+	int                           rc = 0;
+	int                            i = 0;
+	int                      workers = 0;
+	unsigned long          skey_type = 0;
+	encrypt_job_t              *jobs = NULL;
+	int                         njob = 0;
+	GSList                   *bodies = NULL;
+	GSList                     *node = NULL;
+	encrypt_body_t             *body = NULL;
+	GThreadPool                *pool = NULL;
+
+	if ( (reqs == NULL) || (count <= 0) ) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	jobs = g_new0(encrypt_job_t, count);
+	if (jobs == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+
+	/*
+	 * 公開鍵の参照と本文の暗号化(呼び出し元スレッドで行う)
+	 */
+	for(i = 0; i < count; ++i) {
+		reqs[i].result = NULL;
+		reqs[i].len = 0;
+		reqs[i].rc = -ENOENT;
+
+		if ( (reqs[i].peer_addr == NULL) || (reqs[i].message == NULL) ) {
+			reqs[i].rc = -EINVAL;
+			continue;
+		}
+
+		jobs[njob].req = &reqs[i];
+		rc = userdb_refer_peer_rsa_key(reqs[i].peer_addr, 
+		    &jobs[njob].peer_cap, &jobs[njob].pubkey);
+		if (rc != 0) 
+			continue;  /* 鍵が未到着  */
+
+		rc = select_symmetric_key(jobs[njob].peer_cap, &skey_type, 
+		    hostinfo_refer_ipmsg_crypt_policy_is_speed());
+		if (rc == 0)
+			rc = refer_encrypt_body(&bodies, skey_type, 
+			    reqs[i].message, &jobs[njob].body);
+		if (rc != 0) {
+			reqs[i].rc = rc;
+			RSA_free(jobs[njob].pubkey);
+			memset(&jobs[njob], 0, sizeof(encrypt_job_t));
+			continue;
+		}
+		++njob;
+	}
+
+	/*
+	 * セッションキーの暗号化と署名(ワーカスレッドで並行して行う)
+	 */
+	workers = MIN(njob, CRYPT_ENCRYPT_MAX_WORKERS);
+	if (workers > 1)
+		pool = g_thread_pool_new(encrypt_job_worker, NULL, workers, 
+		    TRUE, NULL);
+
+	for(i = 0; i < njob; ++i) {
+		if (pool != NULL)
+			g_thread_pool_push(pool, &jobs[i], NULL);
+		else
+			encrypt_job_worker(&jobs[i], NULL);
+	}
+
+	if (pool != NULL)
+		g_thread_pool_free(pool, FALSE, TRUE); /* 完了を待ち合わせる  */
+
+	dbg_out("Encrypted for %d/%d peers with %d bodies\n", 
+	    njob, count, g_slist_length(bodies));
+
+	rc = 0; /* 正常終了 */
+
+	for(i = 0; i < njob; ++i) 
+		RSA_free(jobs[i].pubkey);
+	g_free(jobs);
+
+	for(node = bodies; node != NULL; node = g_slist_next(node)) {
+		body = node->data;
+		memset(body->session_key, 0, body->skey_len);
+		g_free(body->session_key);
+		g_free(body->enc_body);
+		g_slice_free(encrypt_body_t, body);
+	}
+	g_slist_free(bodies);
+
+error_out:
+	return rc;
+}
+
 /** 暗号化されたメッセージを複号する
  *  @param[in]   peer_addr     送信先IPアドレス
  *  @param[in]   message       暗号化するメッセージ
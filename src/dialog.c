@@ -544,6 +544,7 @@ password_confirm_window(int type, gchar **passphrase_p) {
 	const gchar            *passwd_string = NULL;
 	const char *configured_encoded_passwd = NULL;
 	gchar              *duplicated_passwd = NULL;
+	char                 *upgraded_passwd = NULL;
 	gint                           result = 0;
   
 	/*
@@ -594,11 +595,24 @@ password_confirm_window(int type, gchar **passphrase_p) {
 		passwd_string = gtk_entry_get_text(passwd_entry);
 		dbg_out("Entered:%s\n", passwd_string);
 		
-		rc = pbkdf2_verify(passwd_string, configured_encoded_passwd);
+		rc = pbkdf2_verify_and_upgrade(passwd_string, 
+		    configured_encoded_passwd, &upgraded_passwd);
 		if (rc != 0) {
 			rc = -EPERM;  /* 不正パスワード  */
 			break;
 		}
+		/*
+		 * 旧形式, または, くり返し回数が少ない場合は符号化しなおして
+		 * 格納する
+		 */
+		if (upgraded_passwd != NULL) {
+			dbg_out("Upgrade encoded password\n");
+			if (type == HOSTINFO_PASSWD_TYPE_ENCKEY)
+				hostinfo_set_encryption_key_password(upgraded_passwd);
+			else
+				hostinfo_set_lock_password(upgraded_passwd);
+			g_free(upgraded_passwd);
+		}
 		/*
 		 * パスフレーズの複製を返却
 		 */
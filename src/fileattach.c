@@ -379,6 +379,77 @@ destroy_attach_file_block(attach_file_block_t **afcb){
 
   return 0;
 }
+/** 添付ファイル情報を複製する
+ *  @param[in]   src         複製元の添付ファイル情報
+ *  @param[out]  dst         複製した添付ファイル情報を指すポインタの返却先
+ *  @retval      0           正常終了
+ *  @retval     -EINVAL      引数異常
+ *  @retval     -ENOMEM      メモリ不足
+ *  @note ファイルの属性は複製元のものを引き継ぎ, 再取得しない.
+ *        複数の宛先に同じファイルを添付する場合に使用する.
+ */
+int
+clone_attach_file_block(attach_file_block_t *src, attach_file_block_t **dst) {
+	int                    rc = 0;
+	attach_file_block_t *new_block = NULL;
+	file_info_t          *info = NULL;
+	file_info_t      *new_info = NULL;
+	GList               *entry = NULL;
+
+	if ( (src == NULL) || (dst == NULL) ) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	rc = create_attach_file_block(&new_block);
+	if (rc != 0)
+		goto error_out;
+
+	g_mutex_lock(src->mutex);
+	for(entry = g_list_first(src->files); 
+	    entry != NULL; 
+	    entry = g_list_next(entry)) {
+		info = entry->data;
+		g_assert(info != NULL);
+
+		rc = create_file_info(&new_info);
+		if (rc != 0)
+			goto unlock_out;
+
+		g_mutex_lock(info->mutex);
+		new_info->fileid = info->fileid;
+		new_info->filename = g_strdup(info->filename);
+		new_info->filepath = g_strdup(info->filepath);
+		new_info->size = info->size;
+		new_info->m_time = info->m_time;
+		new_info->ipmsg_fattr = info->ipmsg_fattr;
+		g_mutex_unlock(info->mutex);
+
+		new_info->main_info_ref = new_block;
+		new_block->files = g_list_prepend(new_block->files, new_info);
+
+		if ( (new_info->filename == NULL) || 
+		    (new_info->filepath == NULL) ) {
+			rc = -ENOMEM;
+			goto unlock_out;
+		}
+	}
+	new_block->files = g_list_reverse(new_block->files);
+	new_block->max_id = src->max_id;
+	g_mutex_unlock(src->mutex);
+
+	*dst = new_block;
+
+	rc = 0; /* 正常終了 */
+
+	goto error_out;
+
+unlock_out:
+	g_mutex_unlock(src->mutex);
+	destroy_attach_file_block(&new_block);
+error_out:
+	return rc;
+}
 int 
 add_attach_file(attach_file_block_t *afcb,const gchar *path){
   int rc;
@@ -77,6 +77,7 @@ typedef struct _file_info{
 
 int create_attach_file_block(attach_file_block_t **afcb);
 int destroy_attach_file_block(attach_file_block_t **afcb);
+int clone_attach_file_block(attach_file_block_t *src, attach_file_block_t **dst);
 int release_attach_file_block(const pktno_t pktno,gboolean force);
 int ref_attach_file_block(pktno_t pktno,const char *ipaddr);
 int unref_attach_file_block(pktno_t pktno);
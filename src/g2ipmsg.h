@@ -92,6 +92,10 @@ extern udp_con_t *udp_con;
  */
 #define _MSG_BUF_MIN_SIZE ((_MSG_BUF_SIZE)/2)
 
+/** 受信スレッドが終了要求を確認する間隔(単位:ms)
+ */
+#define IPMSG_NET_THREAD_WAIT_MS (500)
+
 /** ipmsgのファイル交換時のバッファサイズ(256KB)
  *  @note ソケットバッファのサイズに指定する.
  */
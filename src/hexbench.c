@@ -0,0 +1,341 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * hex変換(hexcodec)のマイクロベンチマーク
+ *
+ * 従来の変換処理(string_bin2hex相当の1文字単位の変換, BN_bn2hexによる変換, 
+ * 暗号化電文全体に対する2回のtolower処理, get_hexstr_indexによる逆変換)と
+ * hexcodec_encode/hexcodec_decodeの処理時間を比較する.
+ * 比較に先立ち, 両者の変換結果が一致することを確認する.
+ *
+ * 使用法: hexbench [繰り返し回数]
+ * make checkで構築する(インストールはしない).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include <glib.h>
+#include <openssl/bn.h>
+
+#include "hexcodec.h"
+
+/** ベンチマークに使用するデータ長(単位:バイト)
+ */
+#define HEXBENCH_DATA_LEN  (32 * 1024)
+/** 既定の繰り返し回数
+ */
+#define HEXBENCH_DEFAULT_ITERS  (2000)
+
+static const char *hexstr = "0123456789abcdef";
+
+/** 従来のhex文字の値変換(cryptif.c get_hexstr_index相当)
+ *  @param[in]  ch     hex文字
+ *  @param[out] index  値の返却領域
+ *  @retval     0      正常終了
+ *  @retval    -EINVAL hex文字ではない
+ *  @retval    -ESRCH  変換表に見つからない
+ */
+static int
+old_hexstr_index(const char ch, char *index) {
+	char        *found = NULL;
+	int      search_ch = 0;
+
+	if (!isxdigit((int)(unsigned char)ch))
+		return -EINVAL;
+
+	search_ch = tolower((int)(unsigned char)ch);
+	found = strchr(hexstr, search_ch);
+	if (found == NULL)
+		return -ESRCH;
+
+	*index = (char)(found - hexstr);
+
+	return 0;
+}
+
+/** 従来のバイナリ->hex変換(cryptif.c string_bin2hex相当)
+ *  @param[in]  bin    変換するデータ
+ *  @param[in]  len    データ長
+ *  @param[out] out    hex文字列の返却領域(len * 2 + 1バイト以上)
+ */
+static void
+old_bin2hex(const guchar *bin, size_t len, gchar *out) {
+	size_t     i = 0;
+	gchar     *p = out;
+
+	memset(out, 0, len * 2 + 1);
+	for(i = 0; i < len; ++i) {
+		*p++ = hexstr[(bin[i] >> 4) & 0xf];
+		*p++ = hexstr[bin[i] & 0xf];
+	}
+}
+
+/** 従来のBN_bn2hexによるバイナリ->hex変換(pubcrypt.c変更前相当)
+ *  @param[in]  bin    変換するデータ(ビッグエンディアン)
+ *  @param[in]  len    データ長
+ *  @return hex文字列(大文字, OPENSSL_freeで解放する), 失敗時はNULL
+ */
+static char *
+old_bn_bin2hex(const guchar *bin, size_t len) {
+	BIGNUM      *bn = NULL;
+	char       *hex = NULL;
+
+	bn = BN_bin2bn(bin, len, NULL);
+	if (bn == NULL)
+		return NULL;
+
+	hex = BN_bn2hex(bn);
+	BN_free(bn);
+
+	return hex;
+}
+
+/** 従来の小文字変換(cryptif.c wrap_session_key_and_sign変更前相当)
+ *  @param[in,out]  str  変換する文字列
+ *  @param[in]      len  文字列長
+ */
+static void
+old_tolower(gchar *str, size_t len) {
+	size_t     i = 0;
+
+	for(i = 0; i < len; ++i)
+		str[i] = tolower((int)(unsigned char)str[i]);
+}
+
+/** 従来のhex->バイナリ変換(cryptif.c string_hex2bin相当)
+ *  @param[in]  hex    hex文字列
+ *  @param[in]  len    文字列長
+ *  @param[out] out    変換結果の返却領域(len / 2バイト以上)
+ *  @retval     0      正常終了
+ *  @retval    -EINVAL hex文字以外を含む
+ */
+static int
+old_hex2bin(const gchar *hex, size_t len, guchar *out) {
+	size_t     i = 0;
+	char      hi = 0;
+	char      lo = 0;
+	guchar    *p = out;
+
+	for(i = 0; (i + 1) < len; i += 2) {
+		if ( (old_hexstr_index(hex[i], &hi) != 0) ||
+		    (old_hexstr_index(hex[i + 1], &lo) != 0) )
+			return -EINVAL;
+		*p++ = ((hi << 4) & 0xf0) | (lo & 0xf);
+	}
+
+	return 0;
+}
+
+/** 従来の変換とhexcodecの変換結果が一致することを確認する
+ *  @param[in]  bin    変換するデータ
+ *  @param[out] hex    hex文字列の作業領域
+ *  @param[out] tmp    変換結果の作業領域
+ *  @retval     0      一致した
+ *  @retval    -EIO    一致しなかった
+ */
+static int
+check_codec(const guchar *bin, gchar *hex, guchar *tmp) {
+	static const size_t sizes[] = {0, 1, 15, 16, 17, 31, 32, 33, 
+				       63, 64, 65, 100, 128, 256, 1000, 4097};
+	gchar     *old = NULL;
+	gchar  old_hex[4097 * 2 + 1];
+	size_t     i = 0;
+	size_t     n = 0;
+	int        c = 0;
+
+	for(i = 0; i < G_N_ELEMENTS(sizes); ++i) {
+		n = sizes[i];
+
+		old_bin2hex(bin, n, old_hex);
+		hexcodec_encode(bin, n, hex);
+		if (strcmp(old_hex, hex) != 0) {
+			fprintf(stderr, "encode mismatch: len=%lu\n", (unsigned long)n);
+			return -EIO;
+		}
+
+		/*
+		 * BN_bn2hexは先頭の0を出力せず, 大文字で出力する
+		 */
+		if ( (n > 0) && (bin[0] != 0) ) {
+			old = old_bn_bin2hex(bin, n);
+			if (old == NULL)
+				return -EIO;
+			old_tolower(old, strlen(old));
+			c = strcmp(old, hex);
+			OPENSSL_free(old);
+			if (c != 0) {
+				fprintf(stderr, "BN_bn2hex mismatch: len=%lu\n", 
+				    (unsigned long)n);
+				return -EIO;
+			}
+		}
+
+		/*
+		 * 大文字/小文字混在の入力を逆変換する
+		 */
+		for(c = 0; c < (int)(n * 2); c += 3)
+			hex[c] = toupper((int)(unsigned char)hex[c]);
+		if ( (hexcodec_decode(hex, n * 2, tmp) != 0) || 
+		    (memcmp(tmp, bin, n) != 0) ) {
+			fprintf(stderr, "decode mismatch: len=%lu\n", (unsigned long)n);
+			return -EIO;
+		}
+	}
+
+	/*
+	 * hex文字以外の検出
+	 */
+	for(c = 0; c < 256; ++c) {
+		memset(hex, '0', 32);
+		hex[7] = (gchar)c;
+		if ( (hexcodec_decode(hex, 32, tmp) == 0) != 
+		    (old_hex2bin(hex, 32, tmp) == 0) ) {
+			fprintf(stderr, "invalid character not detected: 0x%02x\n", c);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/** 処理時間を表示する
+ *  @param[in]  title   計測項目
+ *  @param[in]  iters   繰り返し回数
+ *  @param[in]  old_sec 従来の処理時間(単位:秒)
+ *  @param[in]  new_sec hexcodecの処理時間(単位:秒)
+ */
+static void
+show_result(const char *title, int iters, gdouble old_sec, gdouble new_sec) {
+
+	printf("%-28s old %8.4f ms/op  new %8.4f ms/op  (x%.1f)\n",
+	    title, old_sec * 1000.0 / iters, new_sec * 1000.0 / iters,
+	    (new_sec > 0.0) ? (old_sec / new_sec) : (0.0));
+}
+
+int
+main(int argc, char **argv) {
+	int                rc = 0;
+	int             iters = HEXBENCH_DEFAULT_ITERS;
+	int                it = 0;
+	size_t              i = 0;
+	guchar           *bin = NULL;
+	guchar           *out = NULL;
+	gchar            *hex = NULL;
+	gchar            *old = NULL;
+	GTimer         *timer = NULL;
+	gdouble       old_sec = 0.0;
+	gdouble       new_sec = 0.0;
+	volatile guint   sink = 0;
+
+	if (argc > 1)
+		iters = atoi(argv[1]);
+	if (iters <= 0)
+		iters = HEXBENCH_DEFAULT_ITERS;
+
+	bin = g_malloc(HEXBENCH_DATA_LEN);
+	out = g_malloc(HEXBENCH_DATA_LEN);
+	hex = g_malloc(HEXBENCH_DATA_LEN * 2 + 1);
+	timer = g_timer_new();
+
+	for(i = 0; i < HEXBENCH_DATA_LEN; ++i)
+		bin[i] = (guchar)g_random_int_range(0, 256);
+	bin[0] |= 0x80;  /*  BN_bn2hexの出力長を揃える  */
+
+	rc = check_codec(bin, hex, out);
+	if (rc != 0)
+		goto free_out;
+	printf("correctness check: ok\n");
+
+	/*
+	 * 符号化: 1文字単位の変換 + 電文全体の2回の小文字変換
+	 */
+	g_timer_start(timer);
+	for(it = 0; it < iters; ++it) {
+		old_bin2hex(bin, HEXBENCH_DATA_LEN, hex);
+		old_tolower(hex, HEXBENCH_DATA_LEN * 2);
+		old_tolower(hex, HEXBENCH_DATA_LEN * 2);
+		sink += hex[it % HEXBENCH_DATA_LEN];
+	}
+	old_sec = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	for(it = 0; it < iters; ++it) {
+		hexcodec_encode(bin, HEXBENCH_DATA_LEN, hex);
+		sink += hex[it % HEXBENCH_DATA_LEN];
+	}
+	new_sec = g_timer_elapsed(timer, NULL);
+	show_result("encode + 2x tolower", iters, old_sec, new_sec);
+
+	/*
+	 * 符号化: BN_bn2hex + 電文全体の2回の小文字変換
+	 */
+	g_timer_start(timer);
+	for(it = 0; it < iters; ++it) {
+		old = old_bn_bin2hex(bin, HEXBENCH_DATA_LEN);
+		if (old == NULL) {
+			rc = -ENOMEM;
+			goto free_out;
+		}
+		old_tolower(old, HEXBENCH_DATA_LEN * 2);
+		old_tolower(old, HEXBENCH_DATA_LEN * 2);
+		sink += old[it % HEXBENCH_DATA_LEN];
+		OPENSSL_free(old);
+	}
+	old_sec = g_timer_elapsed(timer, NULL);
+	show_result("BN_bn2hex + 2x tolower", iters, old_sec, new_sec);
+
+	/*
+	 * 復号化
+	 */
+	g_timer_start(timer);
+	for(it = 0; it < iters; ++it) {
+		old_hex2bin(hex, HEXBENCH_DATA_LEN * 2, out);
+		sink += out[it % HEXBENCH_DATA_LEN];
+	}
+	old_sec = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	for(it = 0; it < iters; ++it) {
+		hexcodec_decode(hex, HEXBENCH_DATA_LEN * 2, out);
+		sink += out[it % HEXBENCH_DATA_LEN];
+	}
+	new_sec = g_timer_elapsed(timer, NULL);
+	show_result("decode", iters, old_sec, new_sec);
+
+	rc = 0; /* 正常終了 */
+
+free_out:
+	g_timer_destroy(timer);
+	g_free(hex);
+	g_free(out);
+	g_free(bin);
+
+	return (rc == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE);
+}
@@ -0,0 +1,259 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif  /*  __SSE2__  */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif  /*  __AVX2__  */
+
+/** @file 
+ * @brief  hex形式(16進文字列)の変換関数群
+ * @author Takeharu KATO
+ * @note 暗号化メッセージの電文形式に合わせて小文字で出力する.
+ *       コンパイル時にSSE2/AVX2が有効な場合はベクトル命令で変換する.
+ */ 
+
+/** バイナリ->16進変換用テーブル
+ * @attention 内部リンケージ
+ */
+static const gchar hexcodec_digits[] = "0123456789abcdef";
+
+/** 16進文字->値変換用テーブル(16進文字以外は-1)
+ * @attention 内部リンケージ
+ */
+static const gint8 hexcodec_values[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+#if defined(__AVX2__)
+/** 32バイトを64文字の16進文字列に変換する
+ *  @param[in]   data    変換元(32バイト)
+ *  @param[out]  output  変換結果格納先(64バイト)
+ *  @attention 内部リンケージ
+ */
+static inline void
+hexcodec_encode_avx2(const guchar *data, gchar *output) {
+	const __m256i  mask = _mm256_set1_epi8(0x0f);
+	const __m256i  nine = _mm256_set1_epi8(9);
+	const __m256i alpha = _mm256_set1_epi8('a' - '0' - 10);
+	const __m256i  zero = _mm256_set1_epi8('0');
+	__m256i  in, hi, lo, a, b;
+
+	in = _mm256_loadu_si256((const __m256i *)data);
+	hi = _mm256_and_si256(_mm256_srli_epi16(in, 4), mask);
+	lo = _mm256_and_si256(in, mask);
+
+	/*
+	 * 上位/下位ニブルを交互に並べる(レーン内で展開されるため,
+	 * 128ビット単位で並べ直して格納する)
+	 */
+	a = _mm256_unpacklo_epi8(hi, lo);
+	b = _mm256_unpackhi_epi8(hi, lo);
+
+	a = _mm256_add_epi8(_mm256_add_epi8(a, zero),
+	    _mm256_and_si256(_mm256_cmpgt_epi8(a, nine), alpha));
+	b = _mm256_add_epi8(_mm256_add_epi8(b, zero),
+	    _mm256_and_si256(_mm256_cmpgt_epi8(b, nine), alpha));
+
+	_mm256_storeu_si256((__m256i *)output,
+	    _mm256_permute2x128_si256(a, b, 0x20));
+	_mm256_storeu_si256((__m256i *)(output + 32),
+	    _mm256_permute2x128_si256(a, b, 0x31));
+}
+#endif  /*  __AVX2__  */
+
+#if defined(__SSE2__)
+/** 16バイトを32文字の16進文字列に変換する
+ *  @param[in]   data    変換元(16バイト)
+ *  @param[out]  output  変換結果格納先(32バイト)
+ *  @attention 内部リンケージ
+ */
+static inline void
+hexcodec_encode_sse2(const guchar *data, gchar *output) {
+	const __m128i  mask = _mm_set1_epi8(0x0f);
+	const __m128i  nine = _mm_set1_epi8(9);
+	const __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+	const __m128i  zero = _mm_set1_epi8('0');
+	__m128i  in, hi, lo, a, b;
+
+	in = _mm_loadu_si128((const __m128i *)data);
+	hi = _mm_and_si128(_mm_srli_epi16(in, 4), mask);
+	lo = _mm_and_si128(in, mask);
+
+	a = _mm_unpacklo_epi8(hi, lo);
+	b = _mm_unpackhi_epi8(hi, lo);
+
+	/*
+	 * 0-9は'0'を, 10-15は'a'-10を加える
+	 */
+	a = _mm_add_epi8(_mm_add_epi8(a, zero),
+	    _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+	b = _mm_add_epi8(_mm_add_epi8(b, zero),
+	    _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+
+	_mm_storeu_si128((__m128i *)output, a);
+	_mm_storeu_si128((__m128i *)(output + 16), b);
+}
+
+/** 16文字の16進文字列を値(ニブル)に変換する
+ *  @param[in]   in      変換元(16文字)
+ *  @param[out]  valid   全て16進文字であればTRUE
+ *  @return      各バイトに0-15の値を格納したベクタ
+ *  @attention 内部リンケージ
+ */
+static inline __m128i
+hexcodec_nibbles_sse2(__m128i in, gboolean *valid) {
+	__m128i  lower, is_digit, is_alpha, digit, alpha;
+
+	/*
+	 * 数字('0'-'9')はビット5が立っているため, ビット5を立てることで
+	 * 英字のみを小文字にそろえる
+	 */
+	lower = _mm_or_si128(in, _mm_set1_epi8(0x20));
+
+	is_digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)),
+	    _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+	is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+	    _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+	*valid = (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) 
+	    == 0xffff);
+
+	digit = _mm_and_si128(is_digit, _mm_sub_epi8(in, _mm_set1_epi8('0')));
+	alpha = _mm_and_si128(is_alpha, 
+	    _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+
+	return _mm_or_si128(digit, alpha);
+}
+
+/** 32文字の16進文字列を16バイトに変換する
+ *  @param[in]   data    変換元(32文字)
+ *  @param[out]  output  変換結果格納先(16バイト)
+ *  @retval  TRUE   正常終了
+ *  @retval  FALSE  16進文字以外の文字を含む
+ *  @attention 内部リンケージ
+ */
+static inline gboolean
+hexcodec_decode_sse2(const gchar *data, guchar *output) {
+	const __m128i  low_byte = _mm_set1_epi16(0x00ff);
+	gboolean   valid_a, valid_b;
+	__m128i          a, b;
+
+	a = hexcodec_nibbles_sse2(_mm_loadu_si128((const __m128i *)data),
+	    &valid_a);
+	b = hexcodec_nibbles_sse2(_mm_loadu_si128((const __m128i *)(data + 16)),
+	    &valid_b);
+	if ( (!valid_a) || (!valid_b) )
+		return FALSE;
+
+	/*
+	 * 2文字(16ビット)毎に, 先頭の文字を上位ニブルとして結合する
+	 */
+	a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, low_byte), 4),
+	    _mm_srli_epi16(a, 8));
+	b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, low_byte), 4),
+	    _mm_srli_epi16(b, 8));
+
+	_mm_storeu_si128((__m128i *)output, _mm_packus_epi16(a, b));
+
+	return TRUE;
+}
+#endif  /*  __SSE2__  */
+
+/** バイナリのバイトストリームを小文字のhex形式に変換する
+ *  @param[in]   data    バイナリのバイトストリーム
+ *  @param[in]   len     バイトストリーム長
+ *  @param[out]  output  変換結果格納先(len * 2 + 1バイト以上)
+ *  @note 変換結果はヌルターミネートする.
+ */
+void
+hexcodec_encode(const guchar *data, size_t len, gchar *output) {
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	for(; (i + 32) <= len; i += 32)
+		hexcodec_encode_avx2(data + i, output + i * 2);
+#endif  /*  __AVX2__  */
+#if defined(__SSE2__)
+	for(; (i + 16) <= len; i += 16)
+		hexcodec_encode_sse2(data + i, output + i * 2);
+#endif  /*  __SSE2__  */
+
+	for(; i < len; ++i) {
+		output[i * 2]     = hexcodec_digits[data[i] >> 4];
+		output[i * 2 + 1] = hexcodec_digits[data[i] & 0x0f];
+	}
+
+	output[len * 2] = '\0';
+}
+
+/** hex形式の文字列をバイナリのバイトストリームに変換する
+ *  @param[in]   data    hex形式の文字列(大文字/小文字を問わない)
+ *  @param[in]   len     変換する文字数(偶数)
+ *  @param[out]  output  変換結果格納先(len / 2バイト以上)
+ *  @retval  0       正常終了
+ *  @retval -EINVAL  16進文字以外の文字を含む
+ */
+int
+hexcodec_decode(const gchar *data, size_t len, guchar *output) {
+	size_t  i = 0;
+	gint8  hi = 0, lo = 0;
+
+#if defined(__SSE2__)
+	for(; (i + 32) <= len; i += 32) {
+		if (!hexcodec_decode_sse2(data + i, output + i / 2))
+			return -EINVAL;
+	}
+#endif  /*  __SSE2__  */
+
+	for(; (i + 1) < len; i += 2) {
+		hi = hexcodec_values[(guchar)data[i]];
+		lo = hexcodec_values[(guchar)data[i + 1]];
+		if ( (hi < 0) || (lo < 0) )
+			return -EINVAL;
+		output[i / 2] = (guchar)( (hi << 4) | lo );
+	}
+
+	return 0;
+}
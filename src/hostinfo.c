@@ -33,8 +33,6 @@ static GConfClient *client=NULL;
 static gchar *groupname=NULL;
 static gchar *nickname=NULL;
 static gchar *hostname=NULL;
-static gchar *logfile_string=NULL;
-static gchar *cite_string=NULL;
 static gboolean current_absent_state=FALSE;
 static int absent_id=-1;
 static GSList *cached_prio;
@@ -44,6 +42,61 @@ static gchar *pubkey_pass_string = NULL;
 static gchar *lock_pass_string = NULL;
 static gchar *encoding_string = NULL;
 
+/** 実行時構成情報のスナップショット
+ *  @note 頻繁に参照される構成情報をGConfに問い合わせずに参照するための
+ *        複製. 読み出し側はロックを獲得せずに参照する.
+ *        スナップショット対象の構成が変更された場合に限り新しい
+ *        スナップショットを作成して差し替える.
+ *        文字列の構成情報は構成情報差し替え排他用ロックを獲得して
+ *        複製を返却し, 差し替え時に旧スナップショットから解放する.
+ *        旧スナップショットの数値の構成情報は終了時まで解放しない.
+ */
+typedef struct _hostinfo_config{
+  int      port;              /* ポート番号  */
+  gboolean debug;             /* デバッグ出力  */
+  gboolean trace_only;        /* デバッグ出力をトレースリングに記録するのみ  */
+  gboolean default_secret;    /* 封書をデフォルトにする  */
+  gboolean default_confirm;   /* 開封確認をデフォルトにする  */
+  gboolean default_popup;     /* 受信時にポップアップする  */
+  gboolean default_sound;     /* 受信時に音を鳴らす  */
+  gboolean default_enclose;   /* 引用時に囲む  */
+  gboolean default_citation;  /* 引用をデフォルトにする  */
+  gboolean ipaddr_logging;    /* IPアドレスをログに記録する  */
+  gboolean logname_logging;   /* ログオン名をログに記録する  */
+  gboolean enable_log;        /* ログを記録する  */
+  gboolean ipv6;              /* IPV6モード  */
+  gboolean get_hlist;         /* ホストリストを取得する  */
+  gboolean allow_hlist;       /* ホストリストを提供する  */
+  gboolean dialup;            /* ダイアルアップモード  */
+  gboolean sort_with_group;   /* グループ単位でソートする  */
+  gint     sub_sort_id;       /* 第2ソートキー  */
+  gboolean group_sort_order;  /* グループソートの順序(TRUEは昇順)  */
+  gboolean sub_sort_order;    /* 第2ソートの順序(TRUEは昇順)  */
+  gint     pbkdf2_iterations; /* パスワード符号化時のくり返し回数  */
+  gchar   *logfile;           /* ログファイルのパス  */
+  gchar   *cite_string;       /* 引用文字列  */
+}hostinfo_config_t;
+
+/** GConfClient生成前に参照される構成情報
+ * @attention 内部リンケージ
+ */
+static hostinfo_config_t default_config = {DEFAULT_PORT, };
+
+/** 現在の構成情報
+ * @attention 内部リンケージ
+ */
+static hostinfo_config_t *current_config = NULL;
+
+/** 差し替え済みの構成情報(文字列は解放済み, 終了時に解放する)
+ * @attention 内部リンケージ
+ */
+static GSList *retired_configs = NULL;
+
+/** 構成情報差し替え排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex config_mutex = G_STATIC_MUTEX_INIT;
+
 static const char *keys[] = {
   HOSTINFO_KEY_PORT,
   HOSTINFO_KEY_GROUP,
@@ -91,36 +144,259 @@ static const char *keys[] = {
   HOSTINFO_KEY_LOCK_MSGLOG,
   HOSTINFO_KEY_ICONIFY_DIALOGS,
   HOSTINFO_KEY_EXTERNAL_ENCODING,
+  HOSTINFO_KEY_RECV_BATCH,
+  HOSTINFO_KEY_RECV_BUFSIZE,
+  HOSTINFO_KEY_NET_THREAD,
+  HOSTINFO_KEY_TRACE_ONLY,
+  HOSTINFO_KEY_PBKDF2_ITER,
   NULL
 };
 
-gboolean
-hostinfo_refer_debug_state(void) {
-  if (!client)
+/** スナップショットに取り込む構成情報のキー
+ * @attention 内部リンケージ
+ */
+static const char *config_keys[] = {
+  HOSTINFO_KEY_PORT,
+  HOSTINFO_KEY_DEBUG,
+  HOSTINFO_KEY_TRACE_ONLY,
+  HOSTINFO_KEY_MSGSEC,
+  HOSTINFO_KEY_CONFIRM_MSG,
+  HOSTINFO_KEY_POPUP,
+  HOSTINFO_KEY_SOUND,
+  HOSTINFO_KEY_ENCLOSE,
+  HOSTINFO_KEY_CITATION,
+  HOSTINFO_KEY_LOG_IPADDR,
+  HOSTINFO_KEY_LOG_NAME,
+  HOSTINFO_KEY_ENABLE_LOG,
+  HOSTINFO_KEY_IPV6,
+  HOSTINFO_KEY_GET_HLIST,
+  HOSTINFO_KEY_ALLOW_HLIST,
+  HOSTINFO_KEY_DIALUP,
+  HOSTINFO_KEY_SORT_GROUP,
+  HOSTINFO_KEY_SUB_SORT_ID,
+  HOSTINFO_KEY_SORT_GROUP_DESCENDING,
+  HOSTINFO_KEY_SUB_SORT_DESCENDING,
+  HOSTINFO_KEY_PBKDF2_ITER,
+  HOSTINFO_KEY_LOGFILEPATH,
+  HOSTINFO_KEY_CITE_STRING,
+  NULL
+};
+
+/** 構成情報のスナップショットを解放する
+ *  @param[in]  data  構成情報
+ *  @attention 内部リンケージ
+ */
+static void
+free_config(gpointer data,gpointer user_data) {
+  hostinfo_config_t *config=(hostinfo_config_t *)data;
+
+  if (!config)
+    return;
+
+  if (config->logfile)
+    g_free(config->logfile);
+  if (config->cite_string)
+    g_free(config->cite_string);
+  g_slice_free(hostinfo_config_t,config);
+}
+
+/** スナップショットに取り込むキーか否かを判定する
+ *  @param[in]  key   GConfのキー
+ *  @retval     TRUE  スナップショットに取り込むキーである
+ *  @retval     FALSE スナップショットに取り込むキーではない
+ *  @attention 内部リンケージ
+ */
+static gboolean
+is_config_key(const char *key) {
+  int i;
+
+  if (!key)
     return FALSE;
-  return gconf_client_get_bool(client,HOSTINFO_KEY_DEBUG,NULL);
+
+  for(i=0;config_keys[i];++i) {
+    if (!strcmp(key,config_keys[i]))
+      return TRUE;
+  }
+
+  return FALSE;
 }
 
-int
-hostinfo_send_broad_cast(const udp_con_t *con,const char *msg,size_t len){
-  GSList *addr_top,*addr_list;
+/** 文字列の構成情報が等しいか否かを判定する
+ *  @param[in]  a     文字列(NULL可)
+ *  @param[in]  b     文字列(NULL可)
+ *  @retval     TRUE  等しい
+ *  @retval     FALSE 等しくない
+ *  @attention 内部リンケージ
+ */
+static gboolean
+config_string_equal(const gchar *a,const gchar *b) {
 
-  udp_send_broadcast(con,msg,len);
+  if ( (!a) || (!b) )
+    return (a == b);
 
-  addr_top=addr_list=hostinfo_get_ipmsg_broadcast_list();
-  while(addr_list != NULL) {
-      gchar *element = addr_list->data;
+  return (!strcmp(a,b));
+}
 
-      dbg_out("Send Broad cast:%s\n",element);
-      udp_send_broadcast_with_addr(con,element,msg,len);
-      g_free(element);
-      addr_list=g_slist_next(addr_list);
+/** 2つの構成情報のスナップショットが等しいか否かを判定する
+ *  @param[in]  a     構成情報
+ *  @param[in]  b     構成情報
+ *  @retval     TRUE  等しい
+ *  @retval     FALSE 等しくない
+ *  @attention 内部リンケージ
+ */
+static gboolean
+config_equal(const hostinfo_config_t *a,const hostinfo_config_t *b) {
+
+  return ( (a->port == b->port) &&
+	   (a->debug == b->debug) &&
+	   (a->trace_only == b->trace_only) &&
+	   (a->default_secret == b->default_secret) &&
+	   (a->default_confirm == b->default_confirm) &&
+	   (a->default_popup == b->default_popup) &&
+	   (a->default_sound == b->default_sound) &&
+	   (a->default_enclose == b->default_enclose) &&
+	   (a->default_citation == b->default_citation) &&
+	   (a->ipaddr_logging == b->ipaddr_logging) &&
+	   (a->logname_logging == b->logname_logging) &&
+	   (a->enable_log == b->enable_log) &&
+	   (a->ipv6 == b->ipv6) &&
+	   (a->get_hlist == b->get_hlist) &&
+	   (a->allow_hlist == b->allow_hlist) &&
+	   (a->dialup == b->dialup) &&
+	   (a->sort_with_group == b->sort_with_group) &&
+	   (a->sub_sort_id == b->sub_sort_id) &&
+	   (a->group_sort_order == b->group_sort_order) &&
+	   (a->sub_sort_order == b->sub_sort_order) &&
+	   (a->pbkdf2_iterations == b->pbkdf2_iterations) &&
+	   (config_string_equal(a->logfile,b->logfile)) &&
+	   (config_string_equal(a->cite_string,b->cite_string)) );
+}
+
+/** GConfから構成情報を読み込み, スナップショットを差し替える
+ *  @note UIスレッドから呼び出すこと.
+ *  @note 構成情報に変更がなければ差し替えない.
+ *  @attention 内部リンケージ
+ */
+static void
+hostinfo_load_config(void) {
+  hostinfo_config_t *config;
+  hostinfo_config_t *old;
+
+  if (!client)
+    return;
+
+  config=g_slice_new0(hostinfo_config_t);
+  if (!config)
+    return;
+
+  config->port=gconf_client_get_int(client,HOSTINFO_KEY_PORT,NULL);
+  if (!(config->port))
+    config->port=DEFAULT_PORT;
+  config->debug=gconf_client_get_bool(client,HOSTINFO_KEY_DEBUG,NULL);
+  config->trace_only=gconf_client_get_bool(client,HOSTINFO_KEY_TRACE_ONLY,NULL);
+  config->default_secret=gconf_client_get_bool(client,HOSTINFO_KEY_MSGSEC,NULL);
+  config->default_confirm=gconf_client_get_bool(client,HOSTINFO_KEY_CONFIRM_MSG,NULL);
+  config->default_popup=gconf_client_get_bool(client,HOSTINFO_KEY_POPUP,NULL);
+  config->default_sound=gconf_client_get_bool(client,HOSTINFO_KEY_SOUND,NULL);
+  config->default_enclose=gconf_client_get_bool(client,HOSTINFO_KEY_ENCLOSE,NULL);
+  config->default_citation=gconf_client_get_bool(client,HOSTINFO_KEY_CITATION,NULL);
+  config->ipaddr_logging=gconf_client_get_bool(client,HOSTINFO_KEY_LOG_IPADDR,NULL);
+  config->logname_logging=gconf_client_get_bool(client,HOSTINFO_KEY_LOG_NAME,NULL);
+  config->enable_log=gconf_client_get_bool(client,HOSTINFO_KEY_ENABLE_LOG,NULL);
+  config->ipv6=gconf_client_get_bool(client,HOSTINFO_KEY_IPV6,NULL);
+  config->get_hlist=gconf_client_get_bool(client,HOSTINFO_KEY_GET_HLIST,NULL);
+  config->allow_hlist=gconf_client_get_bool(client,HOSTINFO_KEY_ALLOW_HLIST,NULL);
+  config->dialup=gconf_client_get_bool(client,HOSTINFO_KEY_DIALUP,NULL);
+  config->sort_with_group=gconf_client_get_bool(client,HOSTINFO_KEY_SORT_GROUP,NULL);
+  config->sub_sort_id=gconf_client_get_int(client,HOSTINFO_KEY_SUB_SORT_ID,NULL);
+  config->group_sort_order=!(gconf_client_get_bool(client,HOSTINFO_KEY_SORT_GROUP_DESCENDING,NULL));
+  config->sub_sort_order=!(gconf_client_get_bool(client,HOSTINFO_KEY_SUB_SORT_DESCENDING,NULL));
+  config->pbkdf2_iterations=gconf_client_get_int(client,HOSTINFO_KEY_PBKDF2_ITER,NULL);
+  if (config->pbkdf2_iterations <= 0)
+    config->pbkdf2_iterations=PBKDF2_ITER_CNT;
+  else if (config->pbkdf2_iterations < PBKDF2_ITER_MIN)
+    config->pbkdf2_iterations=PBKDF2_ITER_MIN;
+  else if (config->pbkdf2_iterations > PBKDF2_ITER_MAX)
+    config->pbkdf2_iterations=PBKDF2_ITER_MAX;
+  config->logfile=gconf_client_get_string(client,HOSTINFO_KEY_LOGFILEPATH,NULL);
+  config->cite_string=gconf_client_get_string(client,HOSTINFO_KEY_CITE_STRING,NULL);
+
+  g_static_mutex_lock(&config_mutex);
+  old=current_config;
+  if ( (old) && (config_equal(old,config)) ) {
+    g_static_mutex_unlock(&config_mutex);
+    free_config(config,NULL);
+    return;
   }
-  if (addr_top)
-    g_slist_free(addr_top);
+  g_atomic_pointer_set(&current_config,config);
+  if (old) {
+    /*
+     * 文字列は本ロック配下でのみ参照されるため, ここで解放する.
+     */
+    if (old->logfile)
+      g_free(old->logfile);
+    if (old->cite_string)
+      g_free(old->cite_string);
+    old->logfile=old->cite_string=NULL;
+    retired_configs=g_slist_prepend(retired_configs,old);
+  }
+  g_static_mutex_unlock(&config_mutex);
 
-  return 0;
+  ipmsg_trace_set_level((config->debug)?(IPMSG_LOG_DEBUG):(IPMSG_LOG_ERR),
+			config->trace_only);
+}
+
+/** 現在の構成情報を参照する
+ *  @return 構成情報のスナップショット
+ *  @attention 内部リンケージ
+ */
+static const hostinfo_config_t *
+refer_config(void) {
+  const hostinfo_config_t *config;
+
+  config=g_atomic_pointer_get(&current_config);
+
+  return (config)?(config):(&default_config);
 }
+
+/** 論理値の構成情報を設定し, スナップショットに反映する
+ *  @param[in]  key  GConfのキー
+ *  @param[in]  val  設定値
+ *  @return gconf_client_set_boolの返り値
+ *  @attention 内部リンケージ
+ */
+static gboolean
+set_config_bool(const gchar *key,gboolean val) {
+  gboolean rc;
+
+  rc=gconf_client_set_bool(client,key,val,NULL);
+  hostinfo_load_config();
+
+  return rc;
+}
+
+/** 整数値の構成情報を設定し, スナップショットに反映する
+ *  @param[in]  key  GConfのキー
+ *  @param[in]  val  設定値
+ *  @return gconf_client_set_intの返り値
+ *  @attention 内部リンケージ
+ */
+static gboolean
+set_config_int(const gchar *key,gint val) {
+  gboolean rc;
+
+  rc=gconf_client_set_int(client,key,val,NULL);
+  hostinfo_load_config();
+
+  return rc;
+}
+
+gboolean
+hostinfo_refer_debug_state(void) {
+
+  return refer_config()->debug;
+}
+
 int
 hostinfo_set_ipmsg_broadcast_list(GSList *list){
   if (!list){
@@ -468,204 +744,203 @@ hostinfo_set_ipmsg_absent(gboolean state) {
 gboolean
 hostinfo_refer_ipmsg_default_secret(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_MSGSEC,NULL);
+  return refer_config()->default_secret;
 }
 gboolean
 hostinfo_set_ipmsg_default_secret(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_MSGSEC,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_MSGSEC,val);
 }
 gboolean
 hostinfo_refer_ipmsg_default_confirm(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_CONFIRM_MSG,NULL);
+  return refer_config()->default_confirm;
 }
 gboolean
 hostinfo_set_ipmsg_default_confirm(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_CONFIRM_MSG,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_CONFIRM_MSG,val);
 }
 gboolean
 hostinfo_refer_ipmsg_default_popup(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_POPUP,NULL);
+  return refer_config()->default_popup;
 }
 gboolean
 hostinfo_set_ipmsg_default_popup(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_POPUP,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_POPUP,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_default_sound(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_SOUND,NULL);
+  return refer_config()->default_sound;
 }
 gboolean
 hostinfo_set_ipmsg_default_sound(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_SOUND,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_SOUND,val);
 }
 gboolean
 hostinfo_refer_ipmsg_default_enclose(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_ENCLOSE,NULL);
+  return refer_config()->default_enclose;
 }
 gboolean
 hostinfo_set_ipmsg_default_enclose(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_ENCLOSE,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_ENCLOSE,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_default_citation(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_CITATION,NULL);
+  return refer_config()->default_citation;
 }
 gboolean
 hostinfo_set_ipmsg_default_citation(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_CITATION,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_CITATION,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_ipaddr_logging(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_LOG_IPADDR,NULL);
+  return refer_config()->ipaddr_logging;
 }
 gboolean
 hostinfo_set_ipmsg_ipaddr_logging(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_LOG_IPADDR,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_LOG_IPADDR,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_logname_logging(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_LOG_NAME,NULL);
+  return refer_config()->logname_logging;
 }
 gboolean
 hostinfo_set_ipmsg_logname_logging(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_LOG_NAME,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_LOG_NAME,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_enable_log(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_ENABLE_LOG,NULL);
+  return refer_config()->enable_log;
 }
 
 gboolean
 hostinfo_set_ipmsg_enable_log(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_ENABLE_LOG,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_ENABLE_LOG,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_ipv6_mode(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_IPV6,NULL);
+  return refer_config()->ipv6;
 }
 gboolean
 hostinfo_set_ipmsg_ipv6_mode(gboolean val) {
 
-  return gconf_client_set_bool(client,HOSTINFO_KEY_IPV6,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_IPV6,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_is_get_hlist(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_GET_HLIST,NULL);
+  return refer_config()->get_hlist;
 }
 gboolean
 hostinfo_set_ipmsg_is_get_hlist(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_GET_HLIST,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_GET_HLIST,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_is_allow_hlist(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_ALLOW_HLIST,NULL);
+  return refer_config()->allow_hlist;
 }
 gboolean
 hostinfo_set_ipmsg_is_allow_hlist(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_ALLOW_HLIST,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_ALLOW_HLIST,val);
 }
 
 gboolean
 hostinfo_refer_ipmsg_dialup_mode(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_DIALUP,NULL);
+  return refer_config()->dialup;
 }
 gboolean
 hostinfo_set_ipmsg_dialup_mode(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_DIALUP,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_DIALUP,val);
 }
 gboolean
 hostinfo_refer_ipmsg_is_sort_with_group(void) {
 
-  return gconf_client_get_bool(client,HOSTINFO_KEY_SORT_GROUP,NULL);
+  return refer_config()->sort_with_group;
 }
 gboolean
 hostinfo_set_ipmsg_sort_with_group(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_SORT_GROUP,val,NULL);
+  return set_config_bool(HOSTINFO_KEY_SORT_GROUP,val);
 }
 
 gint
 hostinfo_refer_ipmsg_sub_sort_id(void) {
 
-  return gconf_client_get_int(client,HOSTINFO_KEY_SUB_SORT_ID,NULL);
+  return refer_config()->sub_sort_id;
 }
 gboolean
 hostinfo_set_ipmsg_sub_sort_id(gint val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_int(client,HOSTINFO_KEY_SUB_SORT_ID,val,NULL);
+  return set_config_int(HOSTINFO_KEY_SUB_SORT_ID,val);
 }
 gboolean
 hostinfo_refer_ipmsg_group_sort_order(void) {
 
-  return !(gconf_client_get_bool(client,HOSTINFO_KEY_SORT_GROUP_DESCENDING,NULL));
+  return refer_config()->group_sort_order;
 }
 gboolean
 hostinfo_set_ipmsg_group_sort_order(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_SORT_GROUP_DESCENDING,(!(val)),NULL);
+  return set_config_bool(HOSTINFO_KEY_SORT_GROUP_DESCENDING,(!(val)));
 }
 gboolean
 hostinfo_refer_ipmsg_sub_sort_order(void) {
 
-  return !(gconf_client_get_bool(client,HOSTINFO_KEY_SUB_SORT_DESCENDING,NULL));
+  return refer_config()->sub_sort_order;
 }
 gboolean
 hostinfo_set_ipmsg_sub_sort_order(gboolean val) {
 
   gconf_client_clear_cache(client);
-  return gconf_client_set_bool(client,HOSTINFO_KEY_SUB_SORT_DESCENDING,(!(val)),NULL);
+  return set_config_bool(HOSTINFO_KEY_SUB_SORT_DESCENDING,(!(val)));
 }
 
 int 
 hostinfo_set_ipmsg_logfile(const char *file) {
-  gchar *string;
   int rc;
 
   if (!file)
@@ -675,77 +950,61 @@ hostinfo_set_ipmsg_logfile(const char *file) {
   if (rc)
     return rc;
 
-  g_static_mutex_lock(&hostinfo_mutex);  
+  gconf_client_set_string(client,HOSTINFO_KEY_LOGFILEPATH,file,NULL);
+  gconf_client_clear_cache(client);
+  hostinfo_load_config();
 
-  if (logfile_string)
-    g_free(logfile_string);
+  dbg_out("gconf return logfile %s\n",file);
 
-  logfile_string=NULL;
+  return 0;
+}
+/** 文字列の構成情報の複製を取得する
+ *  @param[in]  offset   構成情報中の文字列へのオフセット
+ *  @param[in]  defval   未設定時の値
+ *  @param[out] string_p 文字列の返却領域(g_freeで解放する)
+ *  @retval     0        正常終了
+ *  @retval    -EINVAL   引数異常
+ *  @retval    -ENOMEM  メモリ不足
+ *  @attention 内部リンケージ
+ */
+static int
+get_config_string(size_t offset,const char *defval,char **string_p) {
+  const hostinfo_config_t *config;
+  const gchar *string;
+  char *ret_string;
 
-  gconf_client_set_string(client,HOSTINFO_KEY_LOGFILEPATH,file,NULL);
+  if (!string_p)
+    return -EINVAL;
 
-  string=gconf_client_get_string(client,HOSTINFO_KEY_LOGFILEPATH,NULL);
-  if (string) {
-    dbg_out("gconf return logfile %s\n",string);
-    g_static_mutex_unlock(&hostinfo_mutex);  
-    logfile_string=string;
-    gconf_client_clear_cache(client);
-    return 0;
-  }
-  g_static_mutex_unlock(&hostinfo_mutex);  
-  return -ENOMEM;
-}
-const char *
-hostinfo_refer_ipmsg_logfile(void) {
-  char *string;
+  g_static_mutex_lock(&config_mutex);
+  config=refer_config();
+  string=G_STRUCT_MEMBER(const gchar *,config,offset);
+  ret_string=g_strdup((string)?(string):(defval));
+  g_static_mutex_unlock(&config_mutex);
 
-  g_static_mutex_lock(&hostinfo_mutex);  
-  if (logfile_string)
-    goto unlock_out;
+  if (!ret_string)
+    return -ENOMEM;
 
-  string=gconf_client_get_string(client,HOSTINFO_KEY_LOGFILEPATH,NULL);
+  *string_p=ret_string;
 
-  if (string) {
-    dbg_out("gconf return logfile %s\n",string);
-    g_static_mutex_unlock(&hostinfo_mutex);  
-    logfile_string=string;
-  }  
- unlock_out:
-  g_static_mutex_unlock(&hostinfo_mutex);  
-  return (logfile_string)?(logfile_string):("");
+  return 0;
 }
 
-const char *
-hostinfo_refer_ipmsg_cite_string(void) {
-  char *string;
+int
+hostinfo_get_ipmsg_logfile(char **path_p) {
 
-  if (cite_string)
-    return cite_string;
+  return get_config_string(G_STRUCT_OFFSET(hostinfo_config_t,logfile),"",path_p);
+}
 
-  g_static_mutex_lock(&hostinfo_mutex);
-  string=gconf_client_get_string(client,HOSTINFO_KEY_CITE_STRING,NULL);
+int
+hostinfo_get_ipmsg_cite_string(char **cite_p) {
 
-  if (string) {
-    dbg_out("gconf return cite string:%s\n",string);
-    cite_string=string;
-    g_static_mutex_unlock(&hostinfo_mutex);  
-    return (const char *)cite_string;
-  }
-  g_static_mutex_unlock(&hostinfo_mutex);  
-  return ">";
+  return get_config_string(G_STRUCT_OFFSET(hostinfo_config_t,cite_string),">",cite_p);
 }
 int
 hostinfo_refer_ipmsg_port(void){
-  int port;
 
-  g_static_mutex_lock(&hostinfo_mutex);  
-  port=gconf_client_get_int(client,HOSTINFO_KEY_PORT,NULL);
-  dbg_out("gconf return port:%d\n",port);
-  g_static_mutex_unlock(&hostinfo_mutex);  
-  if (!port) 
-    return DEFAULT_PORT;
-  
-  return port;
+  return refer_config()->port;
 }
 int
 hostinfo_set_ipmsg_port(int port){
@@ -755,6 +1014,7 @@ hostinfo_set_ipmsg_port(int port){
   gconf_client_set_int(client,HOSTINFO_KEY_PORT,port,NULL);
   gconf_client_clear_cache(client);
   new=gconf_client_get_int(client,HOSTINFO_KEY_PORT,NULL);
+  hostinfo_load_config();
   dbg_out("gconf return port:%d\n",new);
   g_static_mutex_unlock(&hostinfo_mutex);  
   if (!new)
@@ -873,7 +1133,19 @@ ret:
 static void
 hostinfo_gconf_notify_func(GConfClient *client, guint cnxn_id, GConfEntry  *entry,
 			   gpointer user_data){
-  dbg_out("Configuration is changed: key=%s\n",(char *)user_data);
+  const char *key = (const char *)user_data;
+
+  dbg_out("Configuration is changed: key=%s\n",key);
+
+  if (is_config_key(key))
+    hostinfo_load_config();
+
+  if ( (key != NULL) && 
+       ( (!strcmp(key, HOSTINFO_KEY_BROADCASTS)) || 
+	 (!strcmp(key, HOSTINFO_KEY_PORT)) ) ) {
+    ipmsg_bcast_invalidate_config_targets();
+    ipmsg_bcast_invalidate_dialup_targets();
+  }
 }
 unsigned long 
 hostinfo_get_normal_send_flags(void){
@@ -882,10 +1154,10 @@ hostinfo_get_normal_send_flags(void){
   g_static_mutex_lock(&hostinfo_mutex);  
   flags=G2IPMSG_DEFAULT_SEND_FLAGS; /* 受信確認をデフォルト  */
 
-  if (gconf_client_get_bool(client,HOSTINFO_KEY_MSGSEC,NULL))
+  if (hostinfo_refer_ipmsg_default_secret())
     flags|=IPMSG_SECRETOPT;
 
-  if (gconf_client_get_bool(client,HOSTINFO_KEY_CONFIRM_MSG,NULL))
+  if (hostinfo_refer_ipmsg_default_confirm())
     flags|=IPMSG_SENDCHECKOPT;
 
   dbg_out("gconf return flags:%x\n",flags);
@@ -904,6 +1176,13 @@ hostinfo_get_normal_entry_flags(void){
     flags |= IPMSG_ABSENCEOPT;
     dbg_out("Inabsense mode :%x\n",flags);
   }
+#if defined(USE_OPENSSL)
+  /*
+   * 鍵の生成が完了するまでは暗号化能力を通知しない
+   */
+  if (!pcrypt_crypt_keys_ready())
+    flags &= ~IPMSG_ENCRYPTOPT;
+#endif  /*  USE_OPENSSL  */
   dbg_out("gconf return flags:%x\n",flags);
   g_static_mutex_unlock(&hostinfo_mutex);  
   return flags;
@@ -1593,6 +1872,53 @@ hostinfo_refer_encoding(void) {
   return encoding_string;
 }
 
+int
+hostinfo_refer_ipmsg_recv_batch(void) {
+  int batch;
+
+  batch = gconf_client_get_int(client, HOSTINFO_KEY_RECV_BATCH, NULL);
+  dbg_out("gconf return recv batch:%d\n", batch);
+  if (batch <= 0)
+    return UDP_RECV_BATCH_DEFAULT;
+
+  if (batch > UDP_RECV_BATCH_MAX)
+    return UDP_RECV_BATCH_MAX;
+
+  return batch;
+}
+
+int
+hostinfo_refer_ipmsg_recv_bufsize(void) {
+  int size;
+
+  size = gconf_client_get_int(client, HOSTINFO_KEY_RECV_BUFSIZE, NULL);
+  dbg_out("gconf return recv bufsize:%d\n", size);
+  if (size <= 0)
+    return UDP_RECV_BUFSIZE_DEFAULT;
+
+  if (size < _MSG_BUF_MIN_SIZE)
+    return _MSG_BUF_MIN_SIZE;
+
+  return size;
+}
+
+gboolean
+hostinfo_refer_ipmsg_use_net_thread(void) {
+
+  return gconf_client_get_bool(client, HOSTINFO_KEY_NET_THREAD, NULL);
+}
+
+int
+hostinfo_refer_ipmsg_pbkdf2_iterations(void) {
+  int iterations;
+
+  iterations = refer_config()->pbkdf2_iterations;
+  if (iterations <= 0)
+    return PBKDF2_ITER_CNT;  /*  GConfClient生成前  */
+
+  return iterations;
+}
+
 
 int
 hostinfo_init_hostinfo(void){
@@ -1604,6 +1930,9 @@ hostinfo_init_hostinfo(void){
 			PATH,
 			GCONF_CLIENT_PRELOAD_NONE,
 			NULL);
+
+  hostinfo_load_config();
+
   /*
    * Add keys
    */
@@ -1626,6 +1955,12 @@ hostinfo_cleanup_hostinfo(void){
     g_free(nickname);
   if (hostname)
     g_free(hostname);
-  if (cite_string)
-    g_free(cite_string);
+
+  g_static_mutex_lock(&config_mutex);
+  g_slist_foreach(retired_configs,free_config,NULL);
+  g_slist_free(retired_configs);
+  retired_configs=NULL;
+  free_config(current_config,NULL);
+  g_atomic_pointer_set(&current_config,NULL);
+  g_static_mutex_unlock(&config_mutex);
 }
@@ -77,6 +77,11 @@
 #define HOSTINFO_KEY_LOCK_MSGLOG           "/apps/g2ipmsg/loglockedmessage" /* 錠付きメッセージは開封後ログをとる  */
 #define HOSTINFO_KEY_ICONIFY_DIALOGS       "/apps/g2ipmsg/iconify_dialogs" /* 通常ダイアログをアイコン化する  */
 #define HOSTINFO_KEY_EXTERNAL_ENCODING     "/apps/g2ipmsg/external_encoding" /* 外部エンコード形式  */
+#define HOSTINFO_KEY_RECV_BATCH            "/apps/g2ipmsg/recv_batch" /* 一括受信数  */
+#define HOSTINFO_KEY_RECV_BUFSIZE          "/apps/g2ipmsg/recv_bufsize" /* 受信バッファサイズ  */
+#define HOSTINFO_KEY_NET_THREAD            "/apps/g2ipmsg/network_thread" /* 受信処理を専用スレッドで行う  */
+#define HOSTINFO_KEY_TRACE_ONLY            "/apps/g2ipmsg/debug_trace_only" /* デバッグ出力を記録のみ行う  */
+#define HOSTINFO_KEY_PBKDF2_ITER           "/apps/g2ipmsg/pbkdf2_iterations" /* パスワード符号化のくり返し回数  */
 
 #define HOSTINFO_PRIO_SEPARATOR  '@'
 #define HEADER_VISUAL_GROUP_ID     0x1
@@ -98,7 +103,7 @@ const char *hostinfo_refer_user_name(void);
 const char *hostinfo_refer_group_name(void);
 const char *hostinfo_refer_nick_name(void);
 const char *hostinfo_refer_host_name(void);
-const char *hostinfo_refer_ipmsg_cite_string(void);
+int hostinfo_get_ipmsg_cite_string(char **cite_p);
 gboolean hostinfo_refer_ipmsg_default_secret(void);
 gboolean hostinfo_refer_ipmsg_default_confirm(void);
 gboolean hostinfo_refer_ipmsg_default_popup(void);
@@ -140,13 +145,12 @@ gboolean hostinfo_set_ipmsg_sub_sort_order(gboolean val);
 int hostinfo_set_ipmsg_logfile(const char *file);
 int hostinfo_set_ipmsg_broadcast_list(GSList *list);
 GSList* hostinfo_get_ipmsg_broadcast_list(void);
-const char *hostinfo_refer_ipmsg_logfile(void);
+int hostinfo_get_ipmsg_logfile(char **path_p);
 unsigned long hostinfo_get_normal_send_flags(void);
 unsigned long hostinfo_get_normal_entry_flags(void);
 int hostinfo_set_group_name(const char *groupName);
 int hostinfo_set_nick_name(const char *nickName);
 int hostinfo_set_ipmsg_port(int port);
-int hostinfo_send_broad_cast(const udp_con_t *con,const char *msg,size_t len);
 
 gboolean hostinfo_is_ipmsg_absent(void);
 gboolean hostinfo_set_ipmsg_absent(gboolean state);
@@ -195,6 +199,10 @@ gboolean hostinfo_refer_ipmsg_log_locked_message_handling(void);
 gboolean hostinfo_set_log_locked_message_handling(gboolean val);
 int hostinfo_set_encoding(const char *encoding);
 const char *hostinfo_refer_encoding(void);
+int hostinfo_refer_ipmsg_recv_batch(void);
+int hostinfo_refer_ipmsg_recv_bufsize(void);
+gboolean hostinfo_refer_ipmsg_use_net_thread(void);
+int hostinfo_refer_ipmsg_pbkdf2_iterations(void);
 
 int hostinfo_init_hostinfo(void);
 void hostinfo_cleanup_hostinfo(void);
@@ -39,39 +39,168 @@
 
 udp_con_t *udp_con;
 static udp_con_t con;
+static udp_recv_batch_t *recv_batch = NULL;
+static GThread *net_thread = NULL;
+static gint net_thread_stop = 0;
+static int net_thread_wakeup_fd = -1;
+
+static void
+dispatch_received_messages(udp_con_t *con) {
+  int         rc = 0;
+  int        idx = 0;
+  msg_data_t msg;
+
+  for(idx = 0; idx < recv_batch->count; ++idx) {
+
+    if (recv_batch->lens[idx] == 0) {
+      /*
+       * 空のデータグラムは捨てる(受信バッファはスロットに残して再利用する)
+       */
+      dbg_out("Discard empty datagram\n");
+      continue;
+    }
+
+    init_message_data(&msg);
+    dbg_out("Message arrive\n");
+    rc = set_message_peer(&msg, (struct sockaddr *)&recv_batch->addrs[idx], 
+			  recv_batch->addrlens[idx]);
+    if (rc != 0) {
+      /*
+       * 送信元が不明なメッセージは捨てる(受信バッファは再利用する)
+       */
+      dbg_out("Invalid peer address:%d\n", rc);
+      udp_put_msg_buffer(udp_take_batch_buffer(recv_batch, idx));
+      continue;
+    }
+    rc = parse_message_buffer_deferred(refer_peer_addr_from_msg(&msg), &msg, 
+			      udp_take_batch_buffer(recv_batch, idx),
+			      recv_batch->lens[idx], udp_put_msg_buffer);
+    if ( (rc == 0) && (msg.encrypted) ) {
+      /*
+       * 受信済みメッセージの再送は, 復号せずに受信確認のみを返す.
+       */
+      if (ipmsg_filter_resent_message(con, &msg)) {
+	release_message_data(&msg);
+	continue;
+      }
+      /*
+       * 復号/署名検証は復号スレッドで行い, 受信処理を止めない.
+       */
+      rc = ipmsg_recvcrypt_submit(con, &msg);
+      if (rc == 0) {
+	release_message_data(&msg);
+	continue;
+      }
+      if ( (rc == -EEXIST) || 
+	   ( (rc == -EAGAIN) && (msg.command_opts & IPMSG_SENDCHECKOPT) ) ) {
+	/*
+	 * 復号中のメッセージの再送, または, 復号待ちが溢れた場合の
+	 * 再送されるメッセージは捨てる.
+	 */
+	dbg_out("Drop encrypted message:%s:%d (%d)\n", 
+		refer_peer_addr_from_msg(&msg), msg.pkt_seq_no, rc);
+	release_message_data(&msg);
+	continue;
+      }
+      rc = decrypt_message_data(refer_peer_addr_from_msg(&msg), &msg);
+    }
+    if (rc == 0)
+      ipmsg_dispatch_message(con, &msg);
+    release_message_data(&msg);
+  }
+}
 
 void
 read_message(gpointer data,
 	     gint source,
 	     GdkInputCondition condition) {
+  static gboolean in_dispatch = FALSE;
   int         rc = 0;
-  char *msg_buff = NULL;
-  size_t     len = 0;
   udp_con_t *con = NULL;
 
   con = (udp_con_t *) data;
-  if (con == NULL)
+  if ( (con == NULL) || (recv_batch == NULL) )
     return;
 
-  gdk_input_remove(con->target_tag);
-  len=0;
-  msg_buff=NULL;
-  udp_recv_message(udp_con,&msg_buff,&len);
-      if (len>0) {
-	msg_data_t msg;
-
-	init_message_data(&msg);
-	dbg_out("Message arrive\n");
-	rc = parse_message(udp_get_peeraddr(udp_con), &msg, msg_buff, len);
-	g_free(msg_buff);
-	msg_buff=NULL;
-	if (rc == 0)
-	  ipmsg_dispatch_message(udp_con,&msg);
-	release_message_data(&msg);
-      }
-  dbg_out("Add socket:%d\n",udp_con->soc);
-  udp_con->target_tag = gdk_input_add(udp_con->soc,GDK_INPUT_READ,read_message, con);
-  
+  /*
+   * ダイアログ表示などの入れ子のメインループから呼ばれた場合は,
+   * 受信バッファを処理中のため, 外側の処理が終わるまで監視を止める.
+   */
+  if (in_dispatch) {
+    dbg_out("Suspend socket:%d\n", con->soc);
+    gdk_input_remove(con->target_tag);
+    con->target_tag = 0;
+    return;
+  }
+
+  rc = udp_recv_messages(con, recv_batch);
+  if (rc <= 0)
+    return;
+
+  in_dispatch = TRUE;
+  dispatch_received_messages(con);
+  in_dispatch = FALSE;
+
+  if (con->target_tag == 0) {
+    dbg_out("Resume socket:%d\n", con->soc);
+    con->target_tag = 
+      gdk_input_add(con->soc, GDK_INPUT_READ, read_message, con);
+  }
+}
+
+static gpointer
+ipmsg_net_thread(gpointer data){
+  int           rc = 0;
+  int       max_fd = 0;
+  udp_con_t   *con = NULL;
+  fd_set    rd_set;
+  struct timeval tmout_val;
+
+  con = (udp_con_t *)data;
+  g_assert(con != NULL);
+
+  dbg_out("Network thread started:%d\n", con->soc);
+
+  max_fd = MAX(con->soc, net_thread_wakeup_fd);
+
+  while (!g_atomic_int_get(&net_thread_stop)) {
+
+    FD_ZERO(&rd_set);
+    FD_SET(con->soc, &rd_set);
+    if (net_thread_wakeup_fd >= 0)
+      FD_SET(net_thread_wakeup_fd, &rd_set);
+    tmout_val.tv_sec = 0;
+    tmout_val.tv_usec = (IPMSG_NET_THREAD_WAIT_MS * 1000);
+
+    rc = select(max_fd + 1, &rd_set, NULL, NULL, &tmout_val);
+    if (rc < 0) {
+      if (errno == EINTR)
+	continue;
+      err_out("select Fail:%s (%d)\n", strerror(errno), errno);
+      break;
+    }
+    if (rc == 0)
+      continue;  /*  終了要求確認のため定期的に起床する  */
+
+    /*
+     * 復号済みメッセージも平文のメッセージと同じく本スレッドから配送する.
+     */
+    if ( (net_thread_wakeup_fd >= 0) && (FD_ISSET(net_thread_wakeup_fd, &rd_set)) )
+      ipmsg_recvcrypt_poll();
+
+    if (!FD_ISSET(con->soc, &rd_set))
+      continue;
+
+    rc = udp_recv_messages(con, recv_batch);
+    if (rc <= 0)
+      continue;
+
+    dispatch_received_messages(con);
+  }
+
+  dbg_out("Network thread ended\n");
+
+  return NULL;
 }
 
 int
@@ -79,26 +208,76 @@ ipmsg_send_broad_cast(const udp_con_t *con,const char *msg,size_t len){
   if ( (!con) || (!msg) )
     return -EINVAL;
 
-  userdb_send_broad_cast(con,msg,len);
-  hostinfo_send_broad_cast(con,msg,len);
+  ipmsg_bcast_send_message(con,msg,len);
 
   return 0;
 }
 
+/** ユニキャストメッセージを送信する
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  ipaddr       送信先IPアドレス文字列
+ *  @param[in]  msg          送信するメッセージ
+ *  @param[in]  len          送信するメッセージ長
+ *  @retval  0以上   送信したバイト数
+ *  @retval 負の値   送信失敗
+ *  @note ユーザ情報に記録された解決済みアドレスを優先して使用し,
+ *        未解決の場合のみ名前解決を行ってユーザ情報に記録する.
+ *  @attention 内部リンケージ
+ */
+static int
+send_unicast_message(const udp_con_t *con, const char *ipaddr, 
+    const char *msg, size_t len) {
+	int                    rc = 0;
+	struct sockaddr_storage addr;
+	socklen_t           addrlen = 0;
+
+	rc = userdb_refer_peer_sockaddr(ipaddr, &addr, &addrlen);
+	if ( (rc == 0) && (con->family != PF_UNSPEC) && 
+	    (addr.ss_family != con->family) ) {
+		/*
+		 * ソケットのファミリと異なる場合は, 解決をやり直す.
+		 */
+		userdb_invalidate_peer_sockaddr(ipaddr);
+		rc = -ENOENT;
+	}
+
+	if (rc < 0) {
+		rc = udp_resolve_peer_addr(con, ipaddr, 
+		    hostinfo_refer_ipmsg_port(), &addr, &addrlen);
+		if (rc < 0)
+			goto error_out;
+		/*  未登録のユーザの場合は記録しない(-ESRCH)  */
+		userdb_store_peer_sockaddr(ipaddr, &addr, addrlen);
+	}
+
+	dbg_out("send [addr:%s port:%d]:\n %s\n", 
+	    ipaddr, hostinfo_refer_ipmsg_port(), msg);
+
+	rc = udp_send_message_to(con, &addr, addrlen, 
+	    hostinfo_refer_ipmsg_port(), msg, len);
+	if (rc < 0) {
+		/*
+		 * 送信に失敗した場合は, 次回の送信時に解決をやり直す.
+		 */
+		userdb_invalidate_peer_sockaddr(ipaddr);
+	}
+
+error_out:
+	return rc;
+}
+
 int 
 ipmsg_send_message(const udp_con_t *con, const char *ipaddr, const char *msg,size_t len) {
 	int rc = 0;
 
 	if (ipaddr != NULL) {
 		/* ユニキャスト */
-		rc = udp_send_message(con, ipaddr, hostinfo_refer_ipmsg_port(), 
-				      msg, len);
+		rc = send_unicast_message(con, ipaddr, msg, len);
 		if (rc >0 )
 		  rc = 0;
 	} else {
 		/* ブロードキャスト */
-		userdb_send_broad_cast(con,msg,len);
-		hostinfo_send_broad_cast(con,msg,len);
+		ipmsg_bcast_send_message(con,msg,len);
 	}
 
 	return rc;
@@ -197,6 +376,7 @@ init_ipmsg(void){
     rc=-errno;
     goto error_out;
   }
+  ipmsg_trace_init();
   userdb_init_userdb();
   logfile_init_logfile();
   init_message_info_manager();
@@ -213,15 +393,41 @@ init_ipmsg(void){
   if (rc<0)
     goto error_out;
 
-  rc=udp_enable_broadcast(&con);
+  udp_con=&con;
+
+  rc=udp_alloc_recv_batch(&recv_batch, hostinfo_refer_ipmsg_recv_batch());
+  if (rc<0)
+    goto error_out;
+
+  rc=ipmsg_ui_event_init();
   if (rc<0)
     goto error_out;
 
-  udp_con=&con;
+  rc=ipmsg_recvcrypt_init();
+  if (rc<0)
+    goto error_out;
+
+  if (hostinfo_refer_ipmsg_use_net_thread()) {
+    /*
+     * 受信処理をUIから切り離し, 専用スレッドで実施する.
+     */
+    g_atomic_int_set(&net_thread_stop, 0);
+    rc=ipmsg_recvcrypt_enable_poll(&net_thread_wakeup_fd);
+    if (rc == 0)
+      net_thread = g_thread_create(ipmsg_net_thread, udp_con, TRUE, NULL);
+    else
+      err_out("Can not set up decrypt notification:%d\n", rc);
+    if (net_thread == NULL) {
+      ipmsg_recvcrypt_disable_poll();
+      net_thread_wakeup_fd = -1;
+    }
+  }
 
-  dbg_out("Add socket:%d\n", udp_con->soc);
-  udp_con->target_tag = 
-    gdk_input_add(udp_con->soc, GDK_INPUT_READ, read_message, udp_con);
+  if (net_thread == NULL) {
+    dbg_out("Add socket:%d\n", udp_con->soc);
+    udp_con->target_tag = 
+      gdk_input_add(udp_con->soc, GDK_INPUT_READ, read_message, udp_con);
+  }
   ipmsg_send_br_entry(udp_con,0);
 
   rc=0;
@@ -236,7 +442,22 @@ init_ipmsg(void){
 void
 cleanup_ipmsg(void){
   ipmsg_send_br_exit(udp_con,hostinfo_get_normal_send_flags());
+  if (net_thread != NULL) {
+    g_atomic_int_set(&net_thread_stop, 1);
+    g_thread_join(net_thread);
+    net_thread = NULL;
+    net_thread_wakeup_fd = -1;
+  }
+  ipmsg_recvcrypt_cleanup();
+  ipmsg_ui_event_cleanup();
+  ipmsg_cleanup_ans_entry_replies();
+  ipmsg_cleanup_recv_dedup();
+  cleanup_message_info_manager();
+  ipmsg_bcast_cleanup();
   udp_release_connection(udp_con);
+  udp_show_recv_stat();
+  udp_free_recv_batch(&recv_batch);
+  udp_release_msg_buffers();
   logfile_shutdown_logfile();
   dbg_out("UI Thread ended\n");
   cleanup_sound_system();
@@ -245,5 +466,6 @@ cleanup_ipmsg(void){
 #endif  /*  USE_OPENSSL  */
   userdb_cleanup_userdb();
   hostinfo_cleanup_hostinfo();
+  ipmsg_trace_cleanup();
 }
 
@@ -77,16 +77,17 @@ internal_reopen_logfile(const char *filepath){
 }
 int 
 logfile_init_logfile(void){
-  const gchar *filepath;
+  gchar *filepath;
   int new_fd;
   int rc;
 
-  filepath=hostinfo_refer_ipmsg_logfile();
-  if (!filepath)
-    return -EINVAL;
   if (handle>0)
     return -EEXIST;
 
+  rc=hostinfo_get_ipmsg_logfile(&filepath);
+  if (rc)
+    return rc;
+
   rc = open_log_file(filepath,&new_fd);
 
   if(rc == 0){
@@ -94,6 +95,8 @@ logfile_init_logfile(void){
     handle=new_fd;
   }
 
+  g_free(filepath);
+
   return 0;
 }
 int
@@ -127,9 +130,9 @@ confirm_file_existence(void){
     g_assert_not_reached(); /* ロックチェック失敗 */
   }
 
-  fpath=(char *)hostinfo_refer_ipmsg_logfile();
-  if (!fpath)
-    return -EINVAL;
+  rc=hostinfo_get_ipmsg_logfile(&fpath);
+  if (rc)
+    return rc;
 
   memset(&buf,0,sizeof(buf));
   memset(&fd_buf,0,sizeof(fd_buf));
@@ -149,6 +152,8 @@ confirm_file_existence(void){
     rc=internal_reopen_logfile(fpath);
   }
 
+  g_free(fpath);
+
   return rc;
 }
 
@@ -664,15 +664,20 @@ show_ipmsg_log(void){
   if (!hostinfo_refer_ipmsg_enable_log())
     goto error_out;
 
+  rc=hostinfo_get_ipmsg_logfile(&logfile);
+  if (rc)
+    goto error_out;
+
   rc=-ENOMEM;
-  if (g_path_is_absolute ((gchar *)hostinfo_refer_ipmsg_logfile()))
-    logfile=g_strdup((gchar *)hostinfo_refer_ipmsg_logfile());
-  else {
+  if (!g_path_is_absolute (logfile)) {
     gchar *current_dir;
+    gchar *relative_path;
    current_dir=g_get_current_dir();
    if (!current_dir)
-     goto error_out;
-   logfile=g_build_filename (current_dir,hostinfo_refer_ipmsg_logfile(),NULL);
+     goto free_log_file;
+   relative_path=logfile;
+   logfile=g_build_filename (current_dir,relative_path,NULL);
+   g_free(relative_path);
    g_free(current_dir);
    dbg_out("Absolute path:%s\n",logfile);
   }
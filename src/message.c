@@ -70,6 +70,43 @@ pktno_t
 refer_pkt_no_name_from_msg(const msg_data_t *msg){
   return msg->pkt_seq_no;
 }
+/** メッセージの送信元アドレスを参照する
+ *  @param[in]  msg          メッセージ情報
+ *  @return 送信元アドレス(数値表記)
+ *  @retval NULL 送信元不明(TCP経由で受信した場合など)
+ */
+const char *
+refer_peer_addr_from_msg(const msg_data_t *msg){
+  if ( (!msg) || (msg->peer_len == 0) )
+    return NULL;
+  return msg->peer_addr;
+}
+/** メッセージの送信元アドレスを設定する
+ *  @param[in]  msg          メッセージ情報
+ *  @param[in]  addr         送信元アドレス
+ *  @param[in]  len          送信元アドレス長
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @note 数値表記への変換は受信時に一度だけ行う.
+ */
+int
+set_message_peer(msg_data_t *msg, const struct sockaddr *addr, socklen_t len){
+  int rc;
+
+  if ( (!msg) || (!addr) || (len == 0) || (len > sizeof(msg->peer)) )
+    return -EINVAL;
+
+  rc=getnameinfo(addr, len, msg->peer_addr, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
+  if (rc != 0) {
+    war_out("Can not get peer address:%s\n", gai_strerror(rc));
+    return -EINVAL;
+  }
+
+  memcpy(&msg->peer, addr, len);
+  msg->peer_len=len;
+
+  return 0;
+}
 
 int
 init_message_data(msg_data_t *msg){
@@ -81,70 +118,157 @@ init_message_data(msg_data_t *msg){
 
   return 0;
 }
+/** メッセージのフィールドが解析元バッファ外に確保された領域か判定する
+ *  @param[in]  msg          メッセージ情報
+ *  @param[in]  field        フィールド
+ *  @retval     TRUE         個別に確保された領域(解放が必要)
+ *  @retval     FALSE        解析元バッファ内の領域
+ *  @attention 内部リンケージ
+ */
+static gboolean
+is_allocated_field(const msg_data_t *msg, const char *field){
+
+  if (field == NULL)
+    return FALSE;
+
+  if (msg->buffer == NULL)
+    return TRUE;
+
+  return ( (field < msg->buffer) || (field > msg->buffer + msg->buflen) );
+}
 int
 release_message_data(msg_data_t *msg){
 
   if ( (!msg) || (msg->magic!= IPMSG_MSG_MAGIC) )
     return -EINVAL;
   
-  if (msg->username)
+  if (is_allocated_field(msg, msg->username))
     g_free(msg->username);
 
-  if (msg->hostname)
+  if (is_allocated_field(msg, msg->hostname))
     g_free(msg->hostname);
 
-  if (msg->extstring)
+  if (is_allocated_field(msg, msg->extstring))
     g_free(msg->extstring);
 
-  if (msg->message)
+  if (is_allocated_field(msg, msg->message))
     g_free(msg->message);
 
+  if ( (msg->buffer) && (msg->free_buffer) )
+    msg->free_buffer(msg->buffer);
+
+  msg->buffer=NULL;
   msg->magic=0;
 
   return 0;
 }
+/** メッセージのフィールドを複製する
+ *  @param[in]  dest         複製先メッセージ情報
+ *  @param[in]  src          複製元メッセージ情報
+ *  @param[in]  field        複製元のフィールド
+ *  @return 複製先のフィールド(解析元バッファ内のフィールドは
+ *          複製先バッファ内の同じ位置を指す)
+ *  @attention 内部リンケージ
+ */
+static char *
+dup_message_field(const msg_data_t *dest, const msg_data_t *src, const char *field){
+
+  if (field == NULL)
+    return NULL;
+
+  if (!is_allocated_field(src, field))
+    return dest->buffer + (field - src->buffer);
+
+  return g_strdup(field);
+}
+/** メッセージ情報を複製する
+ *  @param[out] dest         複製先メッセージ情報(init_message_data済みであること)
+ *  @param[in]  src          複製元メッセージ情報
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note 複製先はrelease_message_dataで解放する.
+ */
 int
-parse_message(const char *ipaddr,msg_data_t *msg,const char *message_buff,size_t len){
+copy_message_data(msg_data_t *dest, const msg_data_t *src){
+
+  if ( (!dest) || (!src) || (dest->magic != IPMSG_MSG_MAGIC) ||
+       (src->magic != IPMSG_MSG_MAGIC) )
+    return -EINVAL;
+
+  memcpy(dest, src, sizeof(msg_data_t));
+  dest->buffer=NULL;
+  dest->free_buffer=NULL;
+  dest->username=dest->hostname=dest->extstring=dest->message=NULL;
+
+  if (src->buffer) {
+    dest->buffer=g_malloc(src->buflen + 1);
+    if (!dest->buffer)
+      return -ENOMEM;
+    memcpy(dest->buffer, src->buffer, src->buflen + 1);
+    dest->free_buffer=g_free;
+  }
+
+  dest->username=dup_message_field(dest, src, src->username);
+  dest->hostname=dup_message_field(dest, src, src->hostname);
+  dest->extstring=dup_message_field(dest, src, src->extstring);
+  dest->message=dup_message_field(dest, src, src->message);
+
+  return 0;
+}
+/** 受信バッファ上でメッセージを解析する(暗号化された本文は復号しない)
+ *  @param[in]  ipaddr       送信元IPアドレス(TCP経由の場合はNULL)
+ *  @param[out] msg          メッセージ情報
+ *  @param[in]  message_buff 受信バッファ(len + 1バイト以上の領域が必要)
+ *  @param[in]  len          受信長
+ *  @param[in]  free_buffer  受信バッファの解放関数
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常/不正なパケット
+ *  @note 受信バッファの所有権はmsgに移り, release_message_data
+ *        呼び出し時に解放される(エラー時も同様).
+ *        username, hostname, message, extstringは受信バッファ内を指す.
+ *        暗号化されたIPMSG_SENDMSGの場合は, messageは暗号文を指し,
+ *        encryptedをTRUEに設定する(decrypt_message_dataで復号すること).
+ */
+int
+parse_message_buffer_deferred(const char *ipaddr,msg_data_t *msg,char *message_buff,size_t len,GDestroyNotify free_buffer){
   long int_val;
   pktno_t pkt_val;
   char *sp=NULL;
   char *ep=NULL;
   char *buffer;
-  ssize_t remains;
-  char *temp_buffer=NULL;
-  size_t tmp_len;
+  char *end;
   int rc=0;
 
   /*
    * TCP経由でよばれた場合は, ipaddrがNULLになりうる  
    */
-  if  ( (!message_buff) || (!msg)  || (msg->magic!= IPMSG_MSG_MAGIC) )
+  if  ( (!message_buff) || (!msg)  || (msg->magic!= IPMSG_MSG_MAGIC) || (len == 0) ) {
+    if ( (message_buff) && (free_buffer) )
+      free_buffer(message_buff);  /*  所有権は常に移るため, ここで解放する  */
     return -EINVAL;
-  _assert(len>0);
-  buffer=g_malloc(len);
-  if (!buffer)
-    return -ENOMEM;
+  }
+
+  buffer=message_buff;
+  msg->buffer=buffer;
+  msg->buflen=len;
+  msg->free_buffer=free_buffer;
+
+  end=buffer + len;
+  *end='\0';  /* 文字列の終端を保証する  */
 
   gettimeofday(&msg->tv, NULL);
 
-  memcpy(buffer,message_buff,len);
-  remains=len;
   /*
    * バージョン番号   
    */
   sp=buffer;
-  ep=memchr(sp, ':', remains);
+  ep=memchr(sp, ':', end - sp);
   if (!ep) {
     rc=-EINVAL;
     goto error_out;
   }
-
   *ep='\0';
-  remains =len - ((unsigned long)ep-(unsigned long)buffer);
-  if (remains<=0) {
-    rc=-EINVAL;
-    goto error_out;
-  }
   ++ep;
   int_val=strtol(sp, (char **)NULL, 10);
   msg->version=int_val;
@@ -153,17 +277,12 @@ parse_message(const char *ipaddr,msg_data_t *msg,const char *message_buff,size_t
   /*
    * シーケンス番号   
    */
-  ep=memchr(sp, ':', remains);
+  ep=memchr(sp, ':', end - sp);
   if (!ep) {
     rc=-EINVAL;
     goto error_out;
   }
   *ep='\0';
-  remains =len - ((unsigned long)ep-(unsigned long)buffer);
-  if (remains<=0) {
-    rc=-EINVAL;
-    goto error_out;
-  }
   ++ep;
   pkt_val=strtoll(sp, (char **)NULL, 10);
   msg->pkt_seq_no=pkt_val;
@@ -172,43 +291,33 @@ parse_message(const char *ipaddr,msg_data_t *msg,const char *message_buff,size_t
   /*
    * 名前
    */
-  ep=memchr(sp, ':', remains);
+  ep=memchr(sp, ':', end - sp);
   if (!ep) {
     rc=-EINVAL;
     goto error_out;
   }
   *ep='\0';
-  remains =len - ((unsigned long)ep-(unsigned long)buffer);
-  if (remains<=0) {
-    rc=-EINVAL;
-    goto error_out;
-  }
   ++ep;
-  msg->username=g_strdup(sp);
+  msg->username=sp;
   sp=ep;
 
   /*
    * ホスト名
    */
-  ep=memchr(sp, ':', remains);
+  ep=memchr(sp, ':', end - sp);
   if (!ep) {
     rc=-EINVAL;
     goto error_out;
   }
   *ep='\0';
-  remains =len - ((unsigned long)ep-(unsigned long)buffer);
-  if (remains<=0) {
-    rc=-EINVAL;
-    goto error_out;
-  }
   ++ep;
-  msg->hostname=g_strdup(sp);
+  msg->hostname=sp;
   sp=ep;
 
   /*
    * コマンド番号   
    */
-  ep=memchr(sp, ':', remains);
+  ep=memchr(sp, ':', end - sp);
   if (!ep) {
     rc=-EINVAL;
     goto error_out;
@@ -223,57 +332,118 @@ parse_message(const char *ipaddr,msg_data_t *msg,const char *message_buff,size_t
   /*
    *メッセージ本文
    */
-  ep=memchr(sp, '\0', remains);
-  if (!ep) {
-    rc=-EINVAL;
-    goto error_out;
+  ep=memchr(sp, '\0', end - sp + 1);
+  g_assert(ep != NULL);  /* 終端は必ず存在する  */
+
+  msg->message=sp;
+  if ( (msg->command == IPMSG_SENDMSG) && (msg->command_opts & (IPMSG_ENCRYPTOPT)) )
+    msg->encrypted=TRUE;  /*  復号は呼び出し元で行う  */
+  else
+    dbg_out("body:%s\n",msg->message);
+  /*
+   *拡張部
+   */
+  if (ep < end) {
+    ++ep;
+    sp=ep;
+    msg->extstring=sp;
+    dbg_out("extention:%s\n",msg->extstring);
   }
-  if ( (msg->command == IPMSG_SENDMSG) && (msg->command_opts & (IPMSG_ENCRYPTOPT)) )  {
+error_out:
+  return rc;
+}
+/** 暗号化されたメッセージ本文を復号する
+ *  @param[in]  ipaddr       送信元IPアドレス(TCP経由の場合はNULL)
+ *  @param[in,out] msg       parse_message_buffer_deferredで解析したメッセージ情報
+ *  @retval     0            正常終了(暗号化されていない場合も含む)
+ *  @retval    -EINVAL       引数異常/復号不能なメッセージ
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note 復号した本文は個別に確保した領域に格納し, release_message_data
+ *        呼び出し時に解放される. 複数のスレッドから同時に呼び出してよい.
+ */
+int
+decrypt_message_data(const char *ipaddr,msg_data_t *msg){
+  int rc=0;
+
+  if ( (!msg)  || (msg->magic!= IPMSG_MSG_MAGIC) )
+    return -EINVAL;
+
+  if (!(msg->encrypted))
+    return 0;
+
 #if defined(USE_OPENSSL)
+  {
     unsigned char *enc_buff=NULL;
-    char *extend=NULL;
-    char *sep=NULL;
     size_t enc_len;
 
     /* 暗号化がある場合は, NULLを許さない(署名の検証があるので) */
-    if (ipaddr == NULL)
+    if (ipaddr == NULL) {
+      rc=-EINVAL;
       goto error_out; /*  復号不能のためメッセージは捨てる(攻撃とみなす) */
+    }
 
-    dbg_out("This is encrypted message:%s.\n",sp);
-    rc = ipmsg_decrypt_message(ipaddr,sp,&enc_buff,&enc_len);
+    dbg_out("This is encrypted message:%s.\n",msg->message);
+    rc = ipmsg_decrypt_message(ipaddr,msg->message,&enc_buff,&enc_len);
     if (rc) {
       goto error_out;
     }
+    rc=-ENOMEM;
     msg->message=g_strdup(enc_buff);
     if (!(msg->message))
       goto decode_end;
+    msg->encrypted=FALSE;
     dbg_out("body:%s\n",msg->message);
     dbg_out("Decrypt message %s(%d) total=%d.\n",enc_buff,strlen(enc_buff),enc_len);
+    rc=0;
   decode_end:
     if (enc_buff)
       g_free(enc_buff);
+  }
 #else
-    dbg_out("I can not decode encrypted message.Ignore the message.");
-    goto error_out; /*  暗号化されたメッセージは捨てる
+  dbg_out("I can not decode encrypted message.Ignore the message.");
+  rc=-EINVAL;
+  goto error_out; /*  暗号化されたメッセージは捨てる
 		   *  (暗号化できないクライアントに送ってきた方が悪い)  
 		   */    
 #endif  /*  USE_OPENSSL  */
-  }else{
-    msg->message=g_strdup(sp);
-    if (!(msg->message))
-      goto error_out;
-    dbg_out("body:%s\n",msg->message);
-  }
-  /*
-   *拡張部
-   */
-  if ( ((unsigned long)ep - (unsigned long)buffer) < len) {
-    ++ep;
-    sp=ep;
-    msg->extstring=g_strdup(sp);
-    dbg_out("extention:%s\n",msg->extstring);
-  }
+
 error_out:
-  g_free(buffer);
   return rc;
 }
+/** 受信バッファ上でメッセージを解析する
+ *  @param[in]  ipaddr       送信元IPアドレス(TCP経由の場合はNULL)
+ *  @param[out] msg          メッセージ情報
+ *  @param[in]  message_buff 受信バッファ(len + 1バイト以上の領域が必要)
+ *  @param[in]  len          受信長
+ *  @param[in]  free_buffer  受信バッファの解放関数
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常/不正なパケット
+ *  @note 受信バッファの所有権はmsgに移り, release_message_data
+ *        呼び出し時に解放される(エラー時も同様).
+ *        暗号化された本文は, この中で復号する.
+ */
+int
+parse_message_buffer(const char *ipaddr,msg_data_t *msg,char *message_buff,size_t len,GDestroyNotify free_buffer){
+  int rc;
+
+  rc=parse_message_buffer_deferred(ipaddr, msg, message_buff, len, free_buffer);
+  if (rc)
+    return rc;
+
+  return decrypt_message_data(ipaddr, msg);
+}
+int
+parse_message(const char *ipaddr,msg_data_t *msg,const char *message_buff,size_t len){
+  char *buffer;
+
+  if  ( (!message_buff) || (!msg)  || (msg->magic!= IPMSG_MSG_MAGIC) || (len == 0) )
+    return -EINVAL;
+
+  buffer=g_malloc(len + 1);
+  if (!buffer)
+    return -ENOMEM;
+
+  memcpy(buffer,message_buff,len);
+
+  return parse_message_buffer(ipaddr, msg, buffer, len, g_free);
+}
@@ -41,6 +41,13 @@ typedef struct _msg_data{
   char *extstring;
   struct timeval tv;
   char *message;
+  char *buffer;  /*  解析元バッファ(各フィールドはこの中を指す)  */
+  size_t buflen;  /*  解析元バッファ長(終端ヌル文字を含まない)  */
+  GDestroyNotify free_buffer;  /*  解析元バッファの解放関数  */
+  struct sockaddr_storage peer;  /*  送信元アドレス  */
+  socklen_t peer_len;  /*  送信元アドレス長(0の場合は送信元不明)  */
+  char peer_addr[NI_MAXHOST];  /*  送信元アドレス(数値表記)  */
+  gboolean encrypted;  /*  本文が未復号の暗号文ならTRUE  */
 }msg_data_t;
 
 int get_command_from_msg(const msg_data_t *msg, unsigned long *command, unsigned long *command_opts);
@@ -49,7 +56,13 @@ const char *refer_host_name_from_msg(const msg_data_t *msg);
 const char *refer_group_name_from_msg(const msg_data_t *msg);
 const char *refer_nick_name_from_msg(const msg_data_t *msg);
 pktno_t refer_pkt_no_name_from_msg(const msg_data_t *msg);
+const char *refer_peer_addr_from_msg(const msg_data_t *msg);
+int set_message_peer(msg_data_t *msg, const struct sockaddr *addr, socklen_t len);
 int init_message_data(msg_data_t *msg);
 int release_message_data(msg_data_t *msg);
+int copy_message_data(msg_data_t *dest, const msg_data_t *src);
 int parse_message(const char *ipaddr,msg_data_t *msg,const char *message_buff,size_t len);
+int parse_message_buffer(const char *ipaddr,msg_data_t *msg,char *message_buff,size_t len,GDestroyNotify free_buffer);
+int parse_message_buffer_deferred(const char *ipaddr,msg_data_t *msg,char *message_buff,size_t len,GDestroyNotify free_buffer);
+int decrypt_message_data(const char *ipaddr,msg_data_t *msg);
 #endif  /*  MESSAGE_H  */
@@ -22,66 +22,267 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
-
 #include "common.h"
 
-static GList *message_list=NULL;
-GStaticMutex msglst_mutex = G_STATIC_MUTEX_INIT;
-static guint timer_id;
+/** @file 
+ * @brief  送信済みメッセージの再送管理
+ * @author Takeharu KATO
+ */ 
+
+/** 再送待ちメッセージ((送信先, パケット番号) -> メッセージ情報)
+ * @attention 内部リンケージ
+ */
+static GHashTable *message_table=NULL;
+
+/** タイマホイール(第1段: 1刻み毎, 第2段: MSG_INFO_WHEEL_SIZE刻み毎)
+ * @attention 内部リンケージ
+ */
+static GQueue wheel[2][MSG_INFO_WHEEL_SIZE];
+
+/** 現在の刻み
+ * @attention 内部リンケージ
+ */
+static guint64 current_tick=0;
+
+/** タイマホイールに登録されているメッセージ数
+ * @attention 内部リンケージ
+ */
+static guint wheel_count=0;
+
+/** 再送管理排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex msglst_mutex = G_STATIC_MUTEX_INIT;
+
+/** 刻みタイマのID(停止中は0)
+ * @attention 内部リンケージ
+ */
+static guint timer_id=0;
 
-static gint 
-message_info_find_element(gconstpointer a,gconstpointer b) {
-  message_info_t  *msg_a,*msg_b;
+static gboolean retry_message_handler(gpointer data);
+
+/** メッセージ情報のハッシュ値を算出する
+ *  @param[in]  key  メッセージ情報
+ *  @return ハッシュ値
+ *  @attention 内部リンケージ
+ */
+static guint
+message_info_hash(gconstpointer key) {
+	const message_info_t *msg = (const message_info_t *)key;
 
-  if ( (!a) || (!b) )
-    return -EINVAL;
+	return g_str_hash(msg->ipaddr) ^ ((guint)msg->seq_no * 2654435761U);
+}
 
-  msg_a=(message_info_t *)a;
-  msg_b=(message_info_t *)b;
+/** メッセージ情報の(送信先, パケット番号)が等しいか判定する
+ *  @param[in]  a  メッセージ情報
+ *  @param[in]  b  メッセージ情報
+ *  @retval     TRUE   等しい
+ *  @retval     FALSE  異なる
+ *  @attention 内部リンケージ
+ */
+static gboolean
+message_info_equal(gconstpointer a, gconstpointer b) {
+	const message_info_t *msg_a = (const message_info_t *)a;
+	const message_info_t *msg_b = (const message_info_t *)b;
 
-  if (msg_a->seq_no == msg_b->seq_no)
-    return 0; /* found */
+	if (msg_a->seq_no != msg_b->seq_no)
+		return FALSE;
 
-  return 1; /* Not found */
+	return (strcmp(msg_a->ipaddr, msg_b->ipaddr) == 0) ? (TRUE) : (FALSE);
 }
-static int
-free_message_entry(GList *entry){
-  message_info_t *this_msg;
 
-  if (!entry)
-    return -EINVAL;
-  this_msg=entry->data;
+/** メッセージ情報を参照する
+ *  @param[in]  msg  メッセージ情報
+ *  @attention 内部リンケージ
+ */
+static void
+message_info_ref(message_info_t *msg) {
+
+	g_atomic_int_inc(&msg->ref);
+}
+
+/** メッセージ情報の参照を解除し, 最後の参照であれば解放する
+ *  @param[in]  msg  メッセージ情報
+ *  @attention 内部リンケージ
+ */
+static void
+message_info_unref(message_info_t *msg) {
+
+	if (!g_atomic_int_dec_and_test(&msg->ref))
+		return;
+
+	dbg_out("Release seqno %d msg\n", msg->seq_no);
+	g_list_free_1(msg->link);
+	g_free(msg->ipaddr);
+	g_free(msg->ed_msg_string);
+	g_slice_free(message_info_t, msg);
+}
+
+/** メッセージをタイマホイールから外す
+ *  @param[in]  msg  メッセージ情報
+ *  @attention 内部リンケージ
+ *  @attention msglst_mutexを獲得して呼び出すこと
+ */
+static void
+wheel_remove(message_info_t *msg) {
+
+	if (msg->slot == NULL)
+		return;
+
+	g_queue_unlink(msg->slot, msg->link);
+	msg->slot = NULL;
+	--wheel_count;
+}
+
+/** 刻みタイマを起動する(起動済みの場合は何もしない)
+ *  @attention 内部リンケージ
+ *  @attention msglst_mutexを獲得して呼び出すこと
+ */
+static void
+start_tick_timer(void) {
+
+	if (timer_id != 0)
+		return;
+
+	timer_id = g_timeout_add(MSG_INFO_TICK_MS, retry_message_handler, NULL);
+}
+
+/** メッセージをタイマホイールに登録する
+ *  @param[in]  msg  メッセージ情報(expiresを設定済みであること)
+ *  @note 第2段に登録したメッセージは, 該当スロットの処理時に第1段へ移す.
+ *  @attention 内部リンケージ
+ *  @attention msglst_mutexを獲得して呼び出すこと
+ */
+static void
+wheel_insert(message_info_t *msg) {
+	guint64 delta;
+	guint64 expires;
+	GQueue *slot;
+
+	g_assert(msg->slot == NULL);
+
+	expires = msg->expires;
+	if (expires <= current_tick)
+		expires = current_tick + 1;
+
+	delta = expires - current_tick;
+	if (delta < MSG_INFO_WHEEL_SIZE)
+		slot = &wheel[0][expires & MSG_INFO_WHEEL_MASK];
+	else {
+		if (delta >= (MSG_INFO_WHEEL_SIZE * MSG_INFO_WHEEL_SIZE))
+			expires = current_tick + 
+			    (MSG_INFO_WHEEL_SIZE * MSG_INFO_WHEEL_SIZE) - 1;
+		slot = &wheel[1][(expires >> MSG_INFO_WHEEL_BITS) & 
+		    MSG_INFO_WHEEL_MASK];
+	}
+
+	g_queue_push_tail_link(slot, msg->link);
+	msg->slot = slot;
+	++wheel_count;
 
-  _assert(this_msg);
-  dbg_out("Release seqno %d msg\n",this_msg->seq_no);
+	start_tick_timer();
+}
+
+/** 次回の再送期限を設定し, タイマホイールに登録する
+ *  @param[in]  msg  メッセージ情報
+ *  @note 送信先毎に再送時刻が揃わないように, 間隔の1/4までの揺らぎを加える.
+ *  @attention 内部リンケージ
+ *  @attention msglst_mutexを獲得して呼び出すこと
+ */
+static void
+schedule_retry(message_info_t *msg) {
+	guint interval;
+
+	interval = msg->interval + g_random_int_range(0, (msg->interval / 4) + 1);
+	msg->expires = current_tick + 
+	    ((interval + MSG_INFO_TICK_MS - 1) / MSG_INFO_TICK_MS);
+
+	wheel_insert(msg);
 
-  g_free(this_msg->ipaddr);
-  g_free(this_msg->ed_msg_string);
-  dbg_out("Free: %x\n",(unsigned int)this_msg);
-  g_slice_free(message_info_t,this_msg);
+	/* 指数バックオフ */
+	msg->interval = MIN(msg->interval * 2, MSG_INFO_RETRY_INTERVAL_MAX);
+}
 
-  message_list=g_list_remove_link(message_list,entry);
-  g_list_free(entry);
+/** メッセージを再送管理から外す
+ *  @param[in]  msg  メッセージ情報
+ *  @note 再送管理からの参照は呼び出し元が引き継ぐ.
+ *  @attention 内部リンケージ
+ *  @attention msglst_mutexを獲得して呼び出すこと
+ */
+static void
+detach_message(message_info_t *msg) {
 
-  return 0;
+	wheel_remove(msg);
+	if (message_table != NULL)
+		g_hash_table_remove(message_table, msg);
+	msg->acked = TRUE;
 }
+
+/** 受信確認済みのメッセージを再送管理から除去する
+ *  @param[in]  ipaddr  受信確認の送信元IPアドレス
+ *  @param[in]  pktno   受信確認されたパケット番号
+ *  @retval     0       正常終了
+ *  @retval    -EINVAL  引数異常
+ *  @retval    -ESRCH   該当するメッセージがない
+ */
 int
-unregister_sent_message(int pktno){
-  GList *found;
-  message_info_t srch_msg;
+unregister_sent_message(const char *ipaddr, pktno_t pktno){
+	message_info_t  srch_msg;
+	message_info_t *found;
+
+	if (ipaddr == NULL)
+		return -EINVAL;
+
+	dbg_out("Try to unregister %s:%d\n", ipaddr, pktno);
+
+	srch_msg.ipaddr = (gchar *)ipaddr;
+	srch_msg.seq_no = pktno;
+
+	g_static_mutex_lock(&msglst_mutex);
+	found = (message_table != NULL) ? 
+	    g_hash_table_lookup(message_table, &srch_msg) : (NULL);
+	if (found != NULL)
+		detach_message(found);
+	g_static_mutex_unlock(&msglst_mutex);
+
+	if (found == NULL)
+		return -ESRCH;
+
+	message_info_unref(found);
+
+	return 0;
+}
+
+/** 再送管理に登録する
+ *  @param[in]  msg  メッセージ情報
+ *  @retval     0       正常終了
+ *  @retval    -EEXIST  (送信先, パケット番号)が登録済み
+ *  @attention 内部リンケージ
+ */
+static int
+attach_message(message_info_t *msg) {
+	int rc;
+
+	g_static_mutex_lock(&msglst_mutex);
+
+	if (message_table == NULL)
+		message_table = g_hash_table_new(message_info_hash, 
+		    message_info_equal);
 
-  dbg_out("Try to unregister %d\n",pktno);
+	rc = -EEXIST;
+	if (g_hash_table_lookup(message_table, msg) != NULL)
+		goto unlock_out;
 
-  srch_msg.seq_no=pktno;
+	msg->acked = FALSE;
+	g_hash_table_insert(message_table, msg, msg);
+	schedule_retry(msg);
 
-  g_static_mutex_lock(&msglst_mutex);
-  found=g_list_find_custom (message_list,&srch_msg,message_info_find_element);  
-  if (found) {
-    free_message_entry(found);
-  }
-  g_static_mutex_unlock(&msglst_mutex);
+	rc = 0; /* 正常終了 */
 
-  return 0;
+unlock_out:
+	g_static_mutex_unlock(&msglst_mutex);
+
+	return rc;
 }
 
 /** 送信済みメッセージを記憶し, 後で再送するように予約する.
@@ -95,50 +296,26 @@ unregister_sent_message(int pktno){
  *  @retval    -ENOMEM       メモリ不足
  */
 int
-register_sent_message(const udp_con_t *con, const char *ipaddr, int pktno, const char *packet, size_t len){
+register_sent_message(const udp_con_t *con, const char *ipaddr, pktno_t pktno, const char *packet, size_t len){
 	message_info_t    *new_msg = NULL;
-	message_info_t *update_msg = NULL;
-	GList               *found = NULL;
-	message_info_t    srch_msg;
 	int                     rc = 0;
 
 	if ( (con == NULL) ||  (ipaddr == NULL) || (packet == NULL) )
 		return -EINVAL;
 
 	dbg_out("register ipaddr=%s\n", ipaddr);
-	srch_msg.seq_no = pktno;
-
-	g_static_mutex_lock(&msglst_mutex);
-	found = g_list_find_custom (message_list, &srch_msg, message_info_find_element);
-	if (found != NULL) { 
-		/*  既に存在する場合は, リトライ回数を減算(ここにはこないはず)  */
-		err_out("pktno duplicated: %d\n", pktno);
-		g_assert_not_reached();
-
-		_assert(found->data);
-		update_msg = found->data;
-
-		--(update_msg->retry_remains);
-		dbg_out("pktno: %d remain:%d\n", pktno, update_msg->retry_remains);
-
-		if (update_msg->retry_remains == 0) 
-			free_message_entry(found);
-		
-
-		g_static_mutex_unlock(&msglst_mutex);
-
-		goto success_out;
-	}
-	g_static_mutex_unlock(&msglst_mutex);
-
 
-	new_msg = g_slice_new(message_info_t);
+	new_msg = g_slice_new0(message_info_t);
 	if (new_msg == NULL) {
 		rc = -ENOMEM;
 		goto error_out;
 	}
-	new_msg->ed_msg_string = NULL;
-	new_msg->ed_msg_string = g_strdup(packet);
+
+	new_msg->ed_msg_string = g_memdup(packet, len);
+	if (new_msg->ed_msg_string == NULL) {
+		rc = -ENOMEM;
+		goto free_message_info;
+	}
 
 	new_msg->ipaddr = g_strdup(ipaddr);
 	if (new_msg->ipaddr == NULL) {
@@ -146,128 +323,286 @@ register_sent_message(const udp_con_t *con, const char *ipaddr, int pktno, const
 		goto free_msg_string;
 	}
 
+	new_msg->link = g_list_alloc();
+	if (new_msg->link == NULL) {
+		rc = -ENOMEM;
+		goto free_ipaddr;
+	}
+	new_msg->link->data    = new_msg;
+
 	new_msg->con           = (udp_con_t *)con;
 	new_msg->len           = len;
 	new_msg->seq_no        = pktno;
 	new_msg->retry_remains = MSG_INFO_MAX_RETRY;
-	new_msg->first         = TRUE;
-
-	g_static_mutex_lock(&msglst_mutex);
-
-	message_list = g_list_append(message_list, new_msg);
-	g_static_mutex_unlock(&msglst_mutex);
+	new_msg->interval      = MSG_INFO_RETRY_INTERVAL;
+	new_msg->ref           = 1;
+
+	rc = attach_message(new_msg);
+	if (rc != 0) {
+		/*  既に存在する場合(ここにはこないはず)  */
+		err_out("pktno duplicated: %s:%d\n", ipaddr, pktno);
+		goto free_link;
+	}
 
 	dbg_out("Add new message:(pktno, packet)=(%d %s)\n", pktno, packet);
 
-success_out:
-	rc = 0;
-
-	return rc; /* 正常終了 */
+	return 0; /* 正常終了 */
 
 	/*
 	 * 異常系 
 	 */
-	if (new_msg->ipaddr != NULL)
-		g_free(new_msg->ipaddr);
+free_link:
+	g_list_free_1(new_msg->link);
+
+free_ipaddr:
+	g_free(new_msg->ipaddr);
 
 free_msg_string:
-	if (new_msg->ed_msg_string != NULL)
-		g_free(new_msg->ed_msg_string);
+	g_free(new_msg->ed_msg_string);
 
 free_message_info:
-	dbg_out("Free: %x\n",(unsigned int)new_msg);
 	g_slice_free(message_info_t,new_msg);
 
 error_out:
 	return rc;
 }
 
-static gboolean 
-retry_message_handler(gpointer data) {
-  retry_messages_once();
-  return TRUE; 
+/** 送信失敗ダイアログの応答を処理する
+ *  @param[in]  dialog       送信失敗ダイアログ
+ *  @param[in]  response_id  応答種別
+ *  @param[in]  user_data    送信に失敗したメッセージ情報
+ *  @note OKの場合は再送回数を戻して再送を再開する.
+ *  @attention 内部リンケージ
+ */
+static void
+on_send_fail_response(GtkDialog *dialog, gint response_id, gpointer user_data) {
+	message_info_t *msg = (message_info_t *)user_data;
+
+	if (response_id == GTK_RESPONSE_OK) {
+		msg->retry_remains = MSG_INFO_MAX_RETRY;
+		msg->interval      = MSG_INFO_RETRY_INTERVAL;
+		dbg_out("reset retry count:seq=%d (remains:%d)\n", 
+		    msg->seq_no, msg->retry_remains);
+		if (attach_message(msg) == 0)
+			msg = NULL;  /* 再送管理に引き継ぐ  */
+	}
+
+	if (msg != NULL) {
+		dbg_out("Free:seq=%d\n", msg->seq_no);
+		message_info_unref(msg);
+	}
+
+	gtk_widget_destroy(GTK_WIDGET(dialog));
 }
-int
-retry_messages_once(void){
-  int rc=0;
-  GList *last;
-  GList *entry;
-  GList *retry_messages=NULL;
-  message_info_t *this_msg;
-
-  g_static_mutex_lock(&msglst_mutex);
-  last=g_list_last(message_list);
-  g_static_mutex_unlock(&msglst_mutex);
-  if (!last) {
-    return 0;
-  }
-  dbg_out("Try to re-send unsent messages.\n");
-  g_source_remove (timer_id);
-  g_static_mutex_lock(&msglst_mutex);
-  while((entry=g_list_first(message_list))) {
-    if (entry->data) {
-      this_msg=entry->data;
-      if (this_msg->first) {
-	this_msg->first=FALSE;
-      } else {
-	dbg_out("retry:%d seq:%d addr:%s port: %d\nmsg:\n%s\n", 
-		this_msg->retry_remains,
-		this_msg->seq_no,
-		this_msg->ipaddr,
-		hostinfo_refer_ipmsg_port(),
-		this_msg->ed_msg_string);
+
+/** 送信失敗を通知する
+ *  @param[in]  msg  送信に失敗したメッセージ情報(参照を引き継ぐ)
+ *  @note 応答を待たずに復帰し, 応答はon_send_fail_responseで処理する.
+ *  @attention 内部リンケージ
+ */
+static void
+notify_send_failure(message_info_t *msg) {
+	GtkWidget   *dialog;
+	GtkWidget   *nameLabel;
+	userdb_t    *user_info = NULL;
+	char        buffer[64];
+
+	dialog = GTK_WIDGET(create_sendFailDialog());
+	if (!userdb_search_user_by_addr(msg->ipaddr, 
+		(const userdb_t **)&user_info)) {
+		nameLabel = lookup_widget(dialog, "SendFailDialogUserLabel");
+		g_assert(nameLabel);
+		snprintf(buffer, 63, "%s@%s (%s)", 
+		    user_info->nickname, user_info->group, user_info->host);
+		buffer[63] = '\0';
+		gtk_label_set_text(GTK_LABEL(nameLabel), buffer);
+		g_assert(!destroy_user_info(user_info));
+	}
+
+	g_signal_connect(G_OBJECT(dialog), "response",
+	    G_CALLBACK(on_send_fail_response), msg);
+	gtk_widget_show(dialog);
+}
+
+/** タイマホイールを1刻み進め, 期限に達したメッセージを取り出す
+ *  @param[in,out]  expired  期限に達したメッセージの追加先
+ *  @attention 内部リンケージ
+ *  @attention msglst_mutexを獲得して呼び出すこと
+ */
+static void
+advance_wheel(GList **expired) {
+	GQueue *slot;
+	GList  *link;
+	message_info_t *msg;
+
+	++current_tick;
+
 	/*
-	 * メッセージの再登録を避けるために, udp_send_messageを直接呼び出す.
+	 * 第1段が一巡したら, 第2段の該当スロットを第1段に振り分け直す
 	 */
-	rc = ipmsg_send_message(udp_con, this_msg->ipaddr, 
-				this_msg->ed_msg_string, this_msg->len);
-	if (rc<0) {
-	  rc*=-1;
-	  ipmsg_err_dialog("%s: %s %d\n", _("Can not send"), strerror(rc), rc);
-	}else{
-	  --this_msg->retry_remains;
+	if ( (current_tick & MSG_INFO_WHEEL_MASK) == 0 ) {
+		slot = &wheel[1][(current_tick >> MSG_INFO_WHEEL_BITS) & 
+		    MSG_INFO_WHEEL_MASK];
+		while( (link = g_queue_peek_head_link(slot)) != NULL ) {
+			msg = (message_info_t *)link->data;
+			wheel_remove(msg);
+			wheel_insert(msg);
+		}
+	}
+
+	slot = &wheel[0][current_tick & MSG_INFO_WHEEL_MASK];
+	while( (link = g_queue_peek_head_link(slot)) != NULL ) {
+		msg = (message_info_t *)link->data;
+		wheel_remove(msg);
+		if (msg->expires > current_tick) {
+			/* 期限前のメッセージは登録し直す */
+			wheel_insert(msg);
+			continue;
+		}
+		*expired = g_list_prepend(*expired, msg);
 	}
-      }
-      if (!(this_msg->retry_remains)) {
-	GtkWidget *dialog;
-	GtkWidget *nameLabel;
-	userdb_t *user_info=NULL;
-	char buffer[64];
-
-	dialog=GTK_WIDGET(create_sendFailDialog ());
-	if (!userdb_search_user_by_addr(this_msg->ipaddr,(const userdb_t **)&user_info)) {
-	  nameLabel=lookup_widget(dialog,"SendFailDialogUserLabel");
-	  g_assert(nameLabel);
-	  snprintf(buffer,63,"%s@%s (%s)",user_info->nickname,user_info->group,user_info->host);
-	  buffer[63]='\0';
-	  gtk_label_set_text(GTK_LABEL(nameLabel),buffer);
-	  g_assert(!destroy_user_info(user_info));
+}
+
+/** 期限に達したメッセージを再送し, 再送回数を使い切ったメッセージの送信失敗を通知する
+ *  @retval     0       正常終了
+ */
+int
+retry_messages_once(void){
+	int rc;
+	GList *expired = NULL;
+	GList *failed = NULL;
+	GList *node;
+	message_info_t *msg;
+
+	g_static_mutex_lock(&msglst_mutex);
+	advance_wheel(&expired);
+	for(node = expired; node != NULL; node = g_list_next(node)) {
+		msg = (message_info_t *)node->data;
+		if (msg->retry_remains <= 0) {
+			/* 再送管理からの参照を通知側に引き継ぐ */
+			detach_message(msg);
+			failed = g_list_prepend(failed, msg);
+			node->data = NULL;
+		} else
+			message_info_ref(msg);
 	}
-	if (gtk_dialog_run (GTK_DIALOG (dialog))==GTK_RESPONSE_OK) {
-	  this_msg->retry_remains=MSG_INFO_MAX_RETRY;
-	  dbg_out("reset retry count:seq=%d (remains:%d)\n", this_msg->seq_no,this_msg->retry_remains);
-	  this_msg->first=TRUE; /* 再登録 */
-	}else{
-	  dbg_out("Free:seq=%d\n", this_msg->seq_no);
-	  free_message_entry(entry);
-	  gtk_widget_destroy (dialog);
-	  continue;
+	g_static_mutex_unlock(&msglst_mutex);
+
+	/*
+	 * ロックを解放してから再送する
+	 */
+	for(node = expired; node != NULL; node = g_list_next(node)) {
+		msg = (message_info_t *)node->data;
+		if (msg == NULL)
+			continue;
+
+		dbg_out("retry:%d seq:%d addr:%s\n", 
+		    msg->retry_remains, msg->seq_no, msg->ipaddr);
+		/*
+		 * メッセージの再登録を避けるために, ipmsg_send_messageを直接呼び出す.
+		 */
+		rc = ipmsg_send_message(udp_con, msg->ipaddr, 
+		    msg->ed_msg_string, msg->len);
+		if (rc < 0) {
+			rc *= -1;
+			ipmsg_err_dialog("%s: %s %d\n", _("Can not send"), 
+			    strerror(rc), rc);
+		}
+
+		g_static_mutex_lock(&msglst_mutex);
+		if (!(msg->acked)) {
+			--msg->retry_remains;
+			schedule_retry(msg);
+		}
+		g_static_mutex_unlock(&msglst_mutex);
+
+		message_info_unref(msg);
 	}
-	gtk_widget_destroy (dialog);
-      }
-      message_list=g_list_remove_link(message_list,entry);
-      retry_messages=g_list_concat(retry_messages,entry);
-    }
-  }
-  message_list=g_list_concat(message_list,retry_messages);
-  g_static_mutex_unlock(&msglst_mutex);
-  timer_id=g_timeout_add(MSG_INFO_RETRY_INTERVAL,retry_message_handler,NULL);
-  return 0;
+	g_list_free(expired);
+
+	for(node = failed; node != NULL; node = g_list_next(node))
+		notify_send_failure((message_info_t *)node->data);
+	g_list_free(failed);
+
+	return 0;
+}
+
+/** 刻みタイマハンドラ
+ *  @param[in]  data  未使用
+ *  @retval     TRUE   再送待ちのメッセージがある
+ *  @retval     FALSE  再送待ちのメッセージがない(タイマを停止する)
+ *  @attention 内部リンケージ
+ */
+static gboolean 
+retry_message_handler(gpointer data) {
+	gboolean rc;
 
+	retry_messages_once();
+
+	g_static_mutex_lock(&msglst_mutex);
+	rc = (wheel_count > 0) ? (TRUE) : (FALSE);
+	if (!rc)
+		timer_id = 0;
+	g_static_mutex_unlock(&msglst_mutex);
+
+	return rc; 
 }
+
+/** 再送管理を初期化する
+ *  @retval     0       正常終了
+ *  @note 刻みタイマは再送待ちのメッセージがある間だけ動作する.
+ */
 int
 init_message_info_manager(void){
-  dbg_out("Start retry handler\n");
-  timer_id=g_timeout_add(MSG_INFO_RETRY_INTERVAL,retry_message_handler,NULL);
-  return 0;
+	int i;
+
+	dbg_out("Start retry handler\n");
+
+	g_static_mutex_lock(&msglst_mutex);
+	for(i = 0; i < MSG_INFO_WHEEL_SIZE; ++i) {
+		g_queue_init(&wheel[0][i]);
+		g_queue_init(&wheel[1][i]);
+	}
+	current_tick = 0;
+	wheel_count = 0;
+	g_static_mutex_unlock(&msglst_mutex);
+
+	return 0;
+}
+
+/** 再送待ちのメッセージを破棄する
+ *  @param[in]  key        メッセージ情報
+ *  @param[in]  value      メッセージ情報
+ *  @param[in]  user_data  未使用
+ *  @retval     TRUE       常に削除する
+ *  @attention 内部リンケージ
+ */
+static gboolean
+release_pending_message(gpointer key, gpointer value, gpointer user_data) {
+	message_info_t *msg = (message_info_t *)value;
+
+	wheel_remove(msg);
+	msg->acked = TRUE;
+	message_info_unref(msg);
+
+	return TRUE;
+}
+
+/** 再送管理を終了し, 再送待ちのメッセージを破棄する
+ */
+void
+cleanup_message_info_manager(void){
+
+	g_static_mutex_lock(&msglst_mutex);
+	if (timer_id != 0) {
+		g_source_remove(timer_id);
+		timer_id = 0;
+	}
+	if (message_table != NULL) {
+		g_hash_table_foreach_remove(message_table, 
+		    release_pending_message, NULL);
+		g_hash_table_destroy(message_table);
+		message_table = NULL;
+	}
+	g_static_mutex_unlock(&msglst_mutex);
 }
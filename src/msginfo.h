@@ -32,7 +32,13 @@
 
 
 #define MSG_INFO_MAX_RETRY  5
-#define MSG_INFO_RETRY_INTERVAL (5*1000) /* 5秒 */
+#define MSG_INFO_RETRY_INTERVAL (2*1000) /* 初回の再送間隔(2秒) */
+#define MSG_INFO_RETRY_INTERVAL_MAX (16*1000) /* 再送間隔の上限(16秒) */
+#define MSG_INFO_TICK_MS     (100)   /* タイマホイールの刻み(ms) */
+#define MSG_INFO_WHEEL_BITS  (6)     /* 1段あたりのスロット数(2の冪)のビット数 */
+#define MSG_INFO_WHEEL_SIZE  (1 << MSG_INFO_WHEEL_BITS)
+#define MSG_INFO_WHEEL_MASK  (MSG_INFO_WHEEL_SIZE - 1)
+
 typedef struct _message_info{
   udp_con_t *con;
   pktno_t  seq_no;         /* パケット番号  */
@@ -40,15 +46,23 @@ typedef struct _message_info{
   gchar *ed_msg_string; /*  外部形式で表した送信伝文(のコピー)  */
   size_t len;
   int  retry_remains;  /*  残回数  */
-  gboolean first;
+  guint interval;      /*  次回の再送間隔(ms)  */
+  guint64 expires;     /*  再送期限(タイマホイールの刻み)  */
+  GQueue *slot;        /*  登録先スロット(未登録時はNULL)  */
+  GList  *link;        /*  スロット内のリンク  */
+  gboolean acked;      /*  受信確認済み/登録解除済み  */
+  gint ref;            /*  参照カウンタ  */
 }message_info_t;
 typedef struct _send_info{
   char *msg;
   int flags;
   GtkWidget *attachment_editor;
+  struct _attach_file_block *attach_tmpl; /*  添付ファイル情報の雛形  */
+  gchar *ext_part;                        /*  添付ファイルの拡張部  */
 }send_info_t;
 int register_sent_message(const udp_con_t *con,const char *ipaddr,pktno_t pktno,const char *message,size_t len);
-int unregister_sent_message(int pktno);
+int unregister_sent_message(const char *ipaddr, pktno_t pktno);
 int retry_messages_once(void);
 int init_message_info_manager(void);
+void cleanup_message_info_manager(void);
 #endif /*  MSG_INFO_H */
@@ -34,28 +34,21 @@
     fflush(stderr);              \
   }while(0)
 #else
-#define dbg_out(fmt,arg...) do{         \
-    if (hostinfo_refer_debug_state()){	\
-      fprintf(stderr, "[file:%s function: %s line:%d ] " fmt,__FILE__,__FUNCTION__,__LINE__,##arg); \
-      syslog(LOG_INFO|LOG_USER, "[file:%s function: %s line:%d ] " fmt,__FILE__,__FUNCTION__,__LINE__,##arg); \
-      fflush(stderr);							\
-    }                            \
+#define dbg_out(fmt,arg...) do{                                                               \
+    if (ipmsg_log_enabled(IPMSG_LOG_DEBUG))                                                \
+      ipmsg_trace_out(IPMSG_LOG_DEBUG, __FILE__, __FUNCTION__, __LINE__, fmt, ##arg);      \
   }while(0)      
 #endif
-#define war_out(fmt,arg...) do{                                                                                  \
-    if (hostinfo_refer_debug_state()){					                                         \
-      fprintf(stderr, "Warning : [file:%s line:%d ] " fmt,__FILE__,__LINE__,##arg);                              \
-      fflush(stderr);							                                         \
-      syslog(LOG_WARNING|LOG_USER, "[file:%s function: %s line:%d ] " fmt,__FILE__,__FUNCTION__,__LINE__,##arg); \
-    }                                                                                                            \
+#define war_out(fmt,arg...) do{                                                               \
+    if (ipmsg_log_enabled(IPMSG_LOG_WARN))                                                 \
+      ipmsg_trace_out(IPMSG_LOG_WARN, __FILE__, __FUNCTION__, __LINE__, fmt, ##arg);       \
   }while(0)
 
 #define err_out(fmt,arg...) do{                                                        \
       fprintf(stderr, "Error : [file:%s line:%d ] " fmt,__FILE__,__LINE__,##arg);      \
       fflush(stderr);							               \
-    if (hostinfo_refer_debug_state()){	                                               \
-      syslog(LOG_ERR|LOG_USER, "[file:%s function: %s line:%d ] " fmt,__FILE__,__FUNCTION__,__LINE__,##arg); \
-    }                                                                                 \
+    if (ipmsg_log_enabled(IPMSG_LOG_DEBUG))                                             \
+      ipmsg_trace_out(IPMSG_LOG_ERR, __FILE__, __FUNCTION__, __LINE__, fmt, ##arg);     \
   }while(0)
 
 #define _assert(cond) do{                                                   \
@@ -76,6 +76,51 @@ sock_set_buffer(int soc, unsigned long min_buf, unsigned long max_buf){
   dbg_out("Set buffer size:%lu\n",size);
   return 0;
 }
+/** 受信バッファサイズを設定する
+ *  @param[in]  soc          ソケット
+ *  @param[in]  min_buf      最低限必要なサイズ
+ *  @param[in]  max_buf      設定したいサイズ
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    負の値        設定失敗(-errno)
+ *  @note カーネルの上限(net.core.rmem_max)に丸められた場合は,
+ *        SO_RCVBUFFORCEによる設定を試みる(特権がなければ丸められた値のまま).
+ */
+int
+sock_set_recv_buffer(int soc, unsigned long min_buf, unsigned long max_buf){
+  int          rc = 0;
+  int        size = 0;
+  int      actual = 0;
+  socklen_t   len = 0;
+
+  if (soc<0)
+    return -EINVAL;
+
+  rc = internal_set_buffer(soc, SO_RCVBUF, max_buf, min_buf, &size);
+  if (rc < 0)
+    return rc;
+
+  len = sizeof(actual);
+  rc = getsockopt(soc, SOL_SOCKET, SO_RCVBUF, (void *)&actual, &len);
+  if (rc < 0)
+    return -errno;
+
+#if defined(SO_RCVBUFFORCE)
+  /*  Linuxは設定値の2倍を返却する  */
+  if ( (unsigned long)actual < max_buf ) {
+    size = max_buf;
+    if (setsockopt(soc, SOL_SOCKET, SO_RCVBUFFORCE, 
+	    (void *)&size, sizeof(int)) == 0) {
+      len = sizeof(actual);
+      getsockopt(soc, SOL_SOCKET, SO_RCVBUF, (void *)&actual, &len);
+    }
+  }
+#endif  /*  SO_RCVBUFFORCE  */
+
+  dbg_out("Set recv buffer size:requested %lu actual %d\n", max_buf, actual);
+
+  return 0;
+}
 static int
 internal_set_timeout(const int soc,int type,unsigned long msec){
   int rc;
@@ -31,6 +31,7 @@
 #define WAIT_UNIT_MS   (500UL)
 int wait_socket(int soc,int wait_for,int sec);
 int sock_set_buffer(int soc, unsigned long min_buf, unsigned long max_buf);
+int sock_set_recv_buffer(int soc, unsigned long min_buf, unsigned long max_buf);
 int sock_recv_time_out(int soc,long msec);
 int sock_send_time_out(int soc,long msec);
 int setup_addr_info(struct addrinfo **infop, const char *ipaddr,int port,int stype,int family);
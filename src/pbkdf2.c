@@ -42,84 +42,147 @@
 #include "common.h"
 
 /*  pkcs5  */
+/*
+ * HMAC-SHA1の内側/外側パッドを処理したハッシュ状態
+ * (くり返し毎にパスワードからパッドを作り直さないよう, 一度だけ計算して
+ *  複製して使用する)
+ */
+typedef struct _pbkdf2_hmac_state{
+  SHA_CTX inner;
+  SHA_CTX outer;
+}pbkdf2_hmac_state_t;
+
 static void
-pkcs5_initial_prf(unsigned char *p,
-		  size_t plen,
-		  unsigned char *salt,
-		  size_t saltlen,
-		  size_t i,
-		  unsigned char *out,
-		  size_t *outlen){
-  size_t swapped_i;
-  HMAC_CTX ctx;
-
-  HMAC_CTX_init(&ctx);
-  HMAC_Init(&ctx,p,plen,EVP_sha1());
-  HMAC_Update(&ctx,salt,saltlen);
-  swapped_i=htonl(i);
-  HMAC_Update(&ctx,(unsigned char *)&swapped_i,sizeof(swapped_i));
-  HMAC_Final(&ctx,out,(unsigned int *)outlen);
-  HMAC_CTX_cleanup(&ctx);
+pbkdf2_hmac_setup(const unsigned char *p,size_t plen,pbkdf2_hmac_state_t *state){
+  size_t i;
+  unsigned char key[PBKDF2_HMAC_BLOCK_LEN];
+  unsigned char pad[PBKDF2_HMAC_BLOCK_LEN];
+
+  memset(key,0,PBKDF2_HMAC_BLOCK_LEN);
+  if (plen > PBKDF2_HMAC_BLOCK_LEN)
+    SHA1(p,plen,key);
+  else
+    memcpy(key,p,plen);
+
+  for(i=0;i<PBKDF2_HMAC_BLOCK_LEN;++i)
+    pad[i] = key[i] ^ 0x36;
+  SHA1_Init(&state->inner);
+  SHA1_Update(&state->inner,pad,PBKDF2_HMAC_BLOCK_LEN);
+
+  for(i=0;i<PBKDF2_HMAC_BLOCK_LEN;++i)
+    pad[i] = key[i] ^ 0x5c;
+  SHA1_Init(&state->outer);
+  SHA1_Update(&state->outer,pad,PBKDF2_HMAC_BLOCK_LEN);
+
+  OPENSSL_cleanse(key,PBKDF2_HMAC_BLOCK_LEN);
+  OPENSSL_cleanse(pad,PBKDF2_HMAC_BLOCK_LEN);
 }
 
 static void
-pkcs5_subsequent_prf(unsigned char *p,
-		     size_t plen,
-		     unsigned char *v,
-		     size_t vlen,
-		     unsigned char *o,
-		     size_t *olen){
-  HMAC_CTX ctx;
-
-  HMAC_CTX_init(&ctx);
-  HMAC_Init(&ctx,p,plen,EVP_sha1());
-  HMAC_Update(&ctx,v,vlen);
-  HMAC_Final(&ctx,o,(unsigned int *)olen);
-  HMAC_CTX_cleanup(&ctx);
+pbkdf2_hmac_final(const pbkdf2_hmac_state_t *state,SHA_CTX *inner,unsigned char *out){
+  SHA_CTX ctx;
+
+  SHA1_Final(out,inner);
+  ctx = state->outer;
+  SHA1_Update(&ctx,out,PBKDF2_PRF_OUT_LEN);
+  SHA1_Final(out,&ctx);
 }
 
 static void
-pkcs5_F(unsigned char *p,
-	size_t plen,
-	unsigned char *salt,
+pkcs5_F(const pbkdf2_hmac_state_t *state,
+	const unsigned char *salt,
 	size_t saltlen,
-	size_t ic,
-	size_t bix,
+	uint32_t ic,
+	uint32_t bix,
 	unsigned char *out){
-  size_t i,j,outlen;
+  uint32_t i,j;
+  uint32_t swapped_i;
+  SHA_CTX ctx;
   unsigned char ulast[PBKDF2_PRF_OUT_LEN];
-  
-  memset(out,0,PBKDF2_PRF_OUT_LEN);
-  pkcs5_initial_prf(p,plen,salt,saltlen,bix,ulast,&outlen);
-  for(i=1;i<=ic;++i){
+
+  /*  U1 = PRF(P, S || INT(i))  */
+  ctx = state->inner;
+  SHA1_Update(&ctx,salt,saltlen);
+  swapped_i=htonl(bix);
+  SHA1_Update(&ctx,(unsigned char *)&swapped_i,sizeof(swapped_i));
+  pbkdf2_hmac_final(state,&ctx,ulast);
+  memcpy(out,ulast,PBKDF2_PRF_OUT_LEN);
+
+  /*  Uc = PRF(P, Uc-1)  */
+  for(i=1;i<ic;++i){
+    ctx = state->inner;
+    SHA1_Update(&ctx,ulast,PBKDF2_PRF_OUT_LEN);
+    pbkdf2_hmac_final(state,&ctx,ulast);
     for(j=0;j<PBKDF2_PRF_OUT_LEN;j++)
       out[j] ^= ulast[j];
-    pkcs5_subsequent_prf(p,plen,ulast,PBKDF2_PRF_OUT_LEN,ulast,&outlen);
   }
 
-  for(j=0;j<PBKDF2_PRF_OUT_LEN;j++)
-    out[j] ^= ulast[j];
+  OPENSSL_cleanse(ulast,PBKDF2_PRF_OUT_LEN);
+  OPENSSL_cleanse(&ctx,sizeof(ctx));
 }
 
 static void 
-spc_pbkdf2(unsigned char *pw, size_t pwlen, char *salt, uint64_t saltlen, uint32_t ic, unsigned char *dk,uint64_t dklen){
+spc_pbkdf2(unsigned char *pw, size_t pwlen, unsigned char *salt, uint64_t saltlen, uint32_t ic, unsigned char *dk,uint64_t dklen){
   uint32_t i,l,r;
+  pbkdf2_hmac_state_t state;
   unsigned char final[PBKDF2_PRF_OUT_LEN]={0,};
   
-  if (dklen > (((unsigned long long)1)<<32 -1) * PBKDF2_PRF_OUT_LEN){
+  if (dklen > ((((unsigned long long)1)<<32) - 1) * PBKDF2_PRF_OUT_LEN){
     abort();
   }
+  pbkdf2_hmac_setup(pw,pwlen,&state);
   l=dklen / PBKDF2_PRF_OUT_LEN;
   r=dklen % PBKDF2_PRF_OUT_LEN;
   for(i=1;i<=l;++i)
-    pkcs5_F(pw,pwlen,salt,saltlen,ic,i,dk + (i-1) * PBKDF2_PRF_OUT_LEN);
+    pkcs5_F(&state,salt,saltlen,ic,i,dk + (i-1) * PBKDF2_PRF_OUT_LEN);
   if (r) {
-    pkcs5_F(pw,pwlen,salt,saltlen,ic,i,final);
+    pkcs5_F(&state,salt,saltlen,ic,i,final);
     for(l=0;l<r;++l)
       *(dk + (i-1) * PBKDF2_PRF_OUT_LEN + l) = final[l];
+    OPENSSL_cleanse(final,PBKDF2_PRF_OUT_LEN);
   }
+  OPENSSL_cleanse(&state,sizeof(state));
 }
 
+/*
+ * 旧形式(導出鍵ではなく, パスワード自身を格納していた)の符号化パスワードか
+ */
+static gboolean
+pbkdf2_is_legacy_passwd(const char *crypt_passwd){
+
+  return (strncmp(crypt_passwd,PBKDF2_LEGACY_PREFIX,PBKDF2_PREFIX_LEN) == 0);
+}
+
+/*
+ * 旧形式の符号化パスワードと照合する
+ * 旧形式の接頭辞を持つ場合のみ照合する(導出鍵自身をパスワードとして
+ * 照合させないため).
+ */
+static gboolean
+pbkdf2_legacy_passwd_match(const char *key,const char *crypt_passwd){
+  int rc;
+  gboolean match = FALSE;
+  const char *digest;
+  gchar *base64_key=NULL;
+
+  if (!pbkdf2_is_legacy_passwd(crypt_passwd))
+    return FALSE;
+
+  digest = strrchr(crypt_passwd,'$');
+  if (!digest)
+    return FALSE;
+
+  rc=base64_encode((const guchar *)key,strlen(key)+1,&base64_key);
+  if (rc)
+    return FALSE;
+
+  match = (strcmp(digest + 1,base64_key) == 0);
+
+  OPENSSL_cleanse(base64_key,strlen(base64_key));
+  g_free(base64_key);
+
+  return match;
+}
 
 int
 pbkdf2_encoded_passwd_configured(const char *enc_pass) {
@@ -127,7 +190,9 @@ pbkdf2_encoded_passwd_configured(const char *enc_pass) {
   if (enc_pass == NULL)
     return -EINVAL;
   dbg_out("check:%s, and %s\n", enc_pass, PBKDF2_PREFIX);
-  if ( (enc_pass[0] == '\0') || (strncmp(enc_pass, PBKDF2_PREFIX, PBKDF2_PREFIX_LEN)) )
+  if ( (enc_pass[0] == '\0') || 
+       ( (strncmp(enc_pass, PBKDF2_PREFIX, PBKDF2_PREFIX_LEN)) && 
+	 (!pbkdf2_is_legacy_passwd(enc_pass)) ) )
     return -ENOENT;
 
   return 0;
@@ -169,11 +234,11 @@ pbkdf2_encrypt(const char *key, const char *salt, char **enc_pass) {
     if (rc)
       goto free_raw_salt;
 
-    iterations=PBKDF2_ITER_CNT;
+    iterations=hostinfo_refer_ipmsg_pbkdf2_iterations();
     salt_len=PBKDF2_SALT_LEN;
   } else {
     if (strncmp(salt,PBKDF2_PREFIX,PBKDF2_PREFIX_LEN))
-      return -EINVAL;
+      return -EINVAL;  /*  旧形式のsaltでは符号化しない  */
     salt_end = strchr(salt + PBKDF2_PREFIX_LEN,'$');
     if (!salt_end)
       return -EINVAL;
@@ -207,8 +272,8 @@ pbkdf2_encrypt(const char *key, const char *salt, char **enc_pass) {
     goto free_base64_encoded_salt;
   key_len=strlen(key);
 
-  spc_pbkdf2((unsigned char *)key,key_len,raw_salt,salt_len,iterations,output,PBKDF2_KEY_LEN);
-  rc=base64_encode(key,key_len+1,(gchar **)&base64_out);
+  spc_pbkdf2((unsigned char *)key,key_len,raw_salt,salt_len,iterations,(unsigned char *)output,PBKDF2_KEY_LEN);
+  rc=base64_encode((const guchar *)output,PBKDF2_KEY_LEN,(gchar **)&base64_out);
   if (rc)
     goto free_output;
 
@@ -231,8 +296,10 @@ pbkdf2_encrypt(const char *key, const char *salt, char **enc_pass) {
   if (base64_out)
     g_free(base64_out);
  free_output:
-  if (output)
+  if (output) {
+    OPENSSL_cleanse(output,PBKDF2_KEY_LEN);
     g_free(output);
+  }
  free_base64_encoded_salt:
   if (base64_salt)
     g_free(base64_salt);
@@ -243,6 +310,87 @@ pbkdf2_encrypt(const char *key, const char *salt, char **enc_pass) {
   return rc;
 }
 
+/** 符号化したパスワードからくり返し回数を取り出す
+ *  @param[in]  crypt_passwd  符号化したパスワード
+ *  @retval     くり返し回数(解析できない場合は0)
+ */
+static unsigned int
+pbkdf2_refer_iterations(const char *crypt_passwd){
+  const char *salt_end;
+  unsigned long iterations;
+
+  salt_end = strchr(crypt_passwd + PBKDF2_PREFIX_LEN,'$');
+  if (!salt_end)
+    return 0;
+
+  iterations = strtoul(salt_end + 1,NULL,10);
+  if (iterations > UINT_MAX)
+    return 0;
+
+  return (unsigned int)iterations;
+}
+
+/** パスワードを照合し, 必要に応じて符号化しなおす
+ *  @param[in]  plain_passwd  入力されたパスワード
+ *  @param[in]  crypt_passwd  符号化したパスワード
+ *  @param[out] upgraded_p    符号化しなおしたパスワードの返却先
+ *                            (不要な場合はNULLを返却する. 呼び出し元で解放する)
+ *  @retval     0             パスワード一致
+ *  @retval    -EINVAL        引数異常
+ *  @retval    -EPERM         パスワード不一致
+ *  @retval    -ENOMEM        メモリ不足
+ *  @note 旧形式で格納されていた場合, または, くり返し回数が構成情報の値より
+ *        少ない場合は, 新しいsaltと構成情報のくり返し回数で符号化しなおした
+ *        パスワードを返却する. 呼び出し元で構成情報に格納すること.
+ */
+int
+pbkdf2_verify_and_upgrade(const char *plain_passwd,const char *crypt_passwd,char **upgraded_p){
+  int rc;
+  gboolean upgrade = FALSE;
+  char *pbkdf2_result = NULL;
+
+  if ( (!plain_passwd) || (!crypt_passwd) || (!upgraded_p) )
+    return -EINVAL;
+
+  *upgraded_p = NULL;
+
+  if (pbkdf2_is_legacy_passwd(crypt_passwd)) {
+    if (!pbkdf2_legacy_passwd_match(plain_passwd,crypt_passwd)) {
+      rc = -EPERM;
+      goto error_out;
+    }
+    dbg_out("Legacy encoded password\n");
+    upgrade = TRUE;
+  } else {
+    rc = pbkdf2_encrypt(plain_passwd,crypt_passwd,&pbkdf2_result);
+    if (rc != 0)
+      goto error_out;
+
+    if (strcmp(pbkdf2_result,crypt_passwd) != 0) {
+      rc = -EPERM;
+      goto error_out;
+    }
+    upgrade = 
+      (pbkdf2_refer_iterations(crypt_passwd) < hostinfo_refer_ipmsg_pbkdf2_iterations());
+  }
+
+  if (upgrade) {
+    rc = pbkdf2_encrypt(plain_passwd,NULL,upgraded_p);
+    if (rc != 0)
+      goto error_out;
+  }
+
+  rc = 0;
+
+ error_out:
+  if (pbkdf2_result != NULL)
+    g_free(pbkdf2_result);
+
+  dbg_out("comp:%d\n",rc);
+
+  return rc;
+}
+
 int
 pbkdf2_verify(const char *plain_passwd,const char *crypt_passwd){
   int rc;
@@ -252,6 +400,12 @@ pbkdf2_verify(const char *plain_passwd,const char *crypt_passwd){
   if ( (!plain_passwd) || (!crypt_passwd) )
     return -EINVAL;
 
+  if (pbkdf2_is_legacy_passwd(crypt_passwd)) {
+    if (pbkdf2_legacy_passwd_match(plain_passwd,crypt_passwd))
+      match = 0;
+    goto error_out;
+  }
+
   rc = pbkdf2_encrypt(plain_passwd,crypt_passwd,&pbkdf2_result);
   if (rc != 0)
     goto error_out;
@@ -35,18 +35,24 @@
 #define PBKDF2_PRF_OUT_LEN 20
 #define PBKDF2_SALT_LEN 8
 #define PBKDF2_KEY_LEN  16
-#define PBKDF2_PREFIX   "$10$"
+#define PBKDF2_PREFIX   "$11$"
+#define PBKDF2_LEGACY_PREFIX "$10$" /* 旧形式(パスワード自身を格納していた) */
 #define PBKDF2_FORMAT   PBKDF2_PREFIX "%s$%u$%s"
 #define PBKDF2_PREFIX_LEN       (4)
-#define PBKDF2_FORMAT_ADDED_LEN (PBKDF2_PREFIX_LEN+2) /* strlen("$10$")+strlen("$")*2 */
+#define PBKDF2_FORMAT_ADDED_LEN (PBKDF2_PREFIX_LEN+2) /* strlen("$11$")+strlen("$")*2 */
 #define PBKDF2_ITER_CNT 10000
+#define PBKDF2_ITER_MIN 1000
+#define PBKDF2_ITER_MAX 10000000
+#define PBKDF2_HMAC_BLOCK_LEN 64
 #if defined(USE_OPENSSL)
 int pbkdf2_encrypt(const char *key, const char *salt,char **enc_pass);
 int pbkdf2_encoded_passwd_configured(const char *enc_pass);
 int pbkdf2_verify(const char *plain_passwd,const char *crypt_passwd);
+int pbkdf2_verify_and_upgrade(const char *plain_passwd,const char *crypt_passwd,char **upgraded_p);
 #else
 #define pbkdf2_encrypt(key, salt, enc_pass)        (-ENOSYS)
 #define pbkdf2_verify(plain_passwd, crypt_passwd)  (-ENOSYS)
+#define pbkdf2_verify_and_upgrade(plain_passwd, crypt_passwd, upgraded_p)  (-ENOSYS)
 #define pbkdf2_encoded_passwd_configured(enc_pass) (-ENOSYS)
 #endif  /*  USE_OPENSSL  */
 #endif  /*  IPMSG_PBKDF2_H  */
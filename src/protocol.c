@@ -41,8 +41,339 @@ static pktno_t pkt_no = 0;
  */
 GStaticMutex pktno_mutex = G_STATIC_MUTEX_INIT;
 
+/** IPMSG_ANSENTRY応答予約
+ */
+typedef struct _ans_entry_reply{
+	const udp_con_t  *con;  /*  UDPコネクション情報  */
+	char          *ipaddr;  /*  応答先IPアドレス  */
+	int             flags;  /*  パケット送信フラグ  */
+	guint        timer_id;  /*  タイマID  */
+	gboolean    cancelled;  /*  応答取り消し済みならTRUE  */
+}ans_entry_reply_t;
+
+/** IPMSG_ANSENTRY応答予約(応答先IPアドレスをキーとする)
+ * @attention 内部リンケージ
+ */
+static GHashTable *ans_entry_replies = NULL;
 
-/** IPMSGのメッセージパケットを生成し, 送信先のコードセットに変換する
+/** IPMSG_ANSENTRY応答予約排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex ans_entry_mutex = G_STATIC_MUTEX_INIT;
+
+/** 受信済みIPMSG_SENDMSGの記録
+ */
+typedef struct _recv_dedup_entry{
+	char      *ipaddr;  /*  送信元IPアドレス(NULLの場合は未使用)  */
+	pktno_t     pktno;  /*  パケット番号  */
+	glong        seen;  /*  最後に受信した時刻(秒)  */
+}recv_dedup_entry_t;
+
+/** 受信済みIPMSG_SENDMSGの記録領域(古いものから上書きする)
+ * @attention 内部リンケージ
+ */
+static recv_dedup_entry_t recv_dedup_ring[IPMSG_PROTOCOL_DEDUP_ENTRIES];
+
+/** 次に上書きする記録の位置
+ * @attention 内部リンケージ
+ */
+static guint recv_dedup_next = 0;
+
+/** 受信済みIPMSG_SENDMSGの索引((送信元, パケット番号)をキーとする)
+ * @attention 内部リンケージ
+ */
+static GHashTable *recv_dedup_table = NULL;
+
+/** 受信済みIPMSG_SENDMSG記録排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex recv_dedup_mutex = G_STATIC_MUTEX_INIT;
+
+/** パケット共通部の"ユーザ名:ホスト名"部分(外部形式)
+ */
+typedef struct _packet_prefix{
+	gchar        *names;  /*  変換後の"ユーザ名:ホスト名"  */
+	gchar     *encoding;  /*  変換時のエンコーディング(UTF-8の場合はNULL)  */
+}packet_prefix_t;
+
+/** パケット共通部の"ユーザ名:ホスト名"部分(内部形式)
+ * @attention 内部リンケージ
+ */
+static gchar *packet_prefix_names = NULL;
+
+/** パケット共通部の"ユーザ名:ホスト名"部分がASCII文字のみならTRUE
+ * @attention 内部リンケージ
+ */
+static gboolean packet_prefix_ascii = FALSE;
+
+/** パケット共通部の変換結果([0]:UTF-8ホスト向け, [1]:それ以外)
+ * @attention 内部リンケージ
+ */
+static packet_prefix_t packet_prefixes[2];
+
+/** パケット共通部変換結果排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex packet_prefix_mutex = G_STATIC_MUTEX_INIT;
+
+/** 送信パケット組み立て用のスレッド毎のバッファ
+ * @attention 内部リンケージ
+ */
+static GStaticPrivate packet_scratch = G_STATIC_PRIVATE_INIT;
+
+/** 複数宛先送信中の宛先に依存しない文字列の変換結果
+ */
+typedef struct _send_batch_conv{
+	const char     *source;  /*  変換元文字列(呼び出し元の領域を指す)  */
+	gchar    *converted[2];  /*  [0]:UTF-8ホスト向け, [1]:それ以外  */
+}send_batch_conv_t;
+
+/** 複数宛先送信の状態
+ */
+typedef struct _send_batch{
+	send_batch_conv_t conv[2];  /*  [0]:メッセージ部, [1]:拡張部  */
+	GHashTable   *encrypted;  /*  暗号化済みメッセージ(宛先IPアドレスをキーとする)  */
+}send_batch_t;
+
+/** 実行中の複数宛先送信(スレッド毎)
+ * @attention 内部リンケージ
+ */
+static GStaticPrivate send_batch_key = G_STATIC_PRIVATE_INIT;
+
+
+/** 7ビットASCII文字のみから成る文字列か判定する
+ *  @param[in]  string       判定対象の文字列
+ *  @retval     TRUE         ASCII文字のみ(コードセット変換不要)
+ *  @retval     FALSE        ASCII以外の文字を含む
+ *  @attention 内部リンケージ
+ */
+static gboolean
+is_ascii_string(const char *string) {
+	const guchar *p;
+
+	for(p = (const guchar *)string; *p != '\0'; ++p) {
+		if (*p & 0x80)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/** パケット共通部の"ユーザ名:ホスト名"部分を外部形式でバッファに格納する
+ *  @param[in]  ipaddr       送信先IPアドレス(コードセット判定に使用)
+ *  @param[out] buf          格納先
+ *  @param[in]  bufsiz       格納先の大きさ
+ *  @param[out] len_p        格納した長さ(ヌルターミネート含まず)の返却先
+ *  @retval     0            正常終了
+ *  @retval    -ENOSPC       格納先が不足している(len_pに必要な長さを返す)
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note ユーザ名/ホスト名は実行中に変化しないため, 内部形式と変換結果を保持する.
+ *        ASCII文字のみの場合は変換しない.
+ *  @attention 内部リンケージ
+ */
+static int
+copy_packet_prefix_names(const char *ipaddr, char *buf, size_t bufsiz, 
+    size_t *len_p) {
+	int                   rc = 0;
+	int              variant = 0;
+	const char     *encoding = NULL;
+	gchar         *converted = NULL;
+	packet_prefix_t  *prefix = NULL;
+	const char        *names = NULL;
+	size_t               len = 0;
+
+	g_static_mutex_lock(&packet_prefix_mutex);
+
+	if (packet_prefix_names == NULL) {
+		packet_prefix_names = g_strdup_printf("%s:%s", 
+		    hostinfo_refer_user_name(), hostinfo_refer_host_name());
+		if (packet_prefix_names == NULL) {
+			rc = -ENOMEM;
+			goto unlock_out;
+		}
+		packet_prefix_ascii = is_ascii_string(packet_prefix_names);
+	}
+
+	names = packet_prefix_names;
+	if (!packet_prefix_ascii) {
+		/*
+		 * UTF-8ホスト向けとデフォルトコードセット向けの変換結果を保持する
+		 */
+		variant = (ipmsg_is_utf8_peer(ipaddr)) ? (0) : (1);
+		if (variant != 0)
+			encoding = hostinfo_refer_encoding();
+		prefix = &packet_prefixes[variant];
+
+		if ( (prefix->names == NULL) || 
+		    ( (encoding != NULL) && (prefix->encoding != NULL) && 
+			(strcmp(encoding, prefix->encoding) != 0) ) ) {
+			rc = ipmsg_convert_string_external(ipaddr, 
+			    packet_prefix_names, (const char **)&converted);
+			if (rc != 0)
+				goto unlock_out;
+			if (prefix->names != NULL)
+				g_free(prefix->names);
+			if (prefix->encoding != NULL)
+				g_free(prefix->encoding);
+			prefix->names = converted;
+			prefix->encoding = (encoding != NULL) ? 
+			    (g_strdup(encoding)) : (NULL);
+		}
+		names = prefix->names;
+	}
+
+	len = strlen(names);
+	*len_p = len;
+
+	rc = -ENOSPC;
+	if (len >= bufsiz)
+		goto unlock_out;
+
+	memcpy(buf, names, len + 1);
+
+	rc = 0; /* 正常終了 */
+
+unlock_out:
+	g_static_mutex_unlock(&packet_prefix_mutex);
+
+	return rc;
+}
+
+/** 文字列を外部形式に変換する(複数宛先送信中は変換結果を再利用する)
+ *  @param[in]  ipaddr       送信先IPアドレス(コードセット判定に使用)
+ *  @param[in]  string       変換する文字列(内部形式)
+ *  @param[out] converted_p  変換後の文字列を指すポインタの返却先
+ *  @param[out] allocated_p  返却した文字列を呼び出し元で解放する必要がある場合にTRUE
+ *  @retval     0            正常終了
+ *  @retval    負の値        変換失敗(ipmsg_convert_string_externalの返却値)
+ *  @note ipmsg_send_batch_beginで登録された文字列(アドレスで判定する)は,
+ *        送信先コードセット毎に1度だけ変換する.
+ *  @attention 内部リンケージ
+ */
+static int
+convert_string_external_batched(const char *ipaddr, const char *string, 
+    const char **converted_p, gboolean *allocated_p) {
+	int                   rc = 0;
+	int                    i = 0;
+	int              variant = 0;
+	send_batch_t      *batch = NULL;
+	send_batch_conv_t  *conv = NULL;
+
+	batch = g_static_private_get(&send_batch_key);
+	for(i = 0; (batch != NULL) && (i < 2); ++i) {
+		conv = &batch->conv[i];
+		if ( (conv->source == NULL) || (conv->source != string) )
+			continue;
+
+		variant = (ipmsg_is_utf8_peer(ipaddr)) ? (0) : (1);
+		if (conv->converted[variant] == NULL) {
+			rc = ipmsg_convert_string_external(ipaddr, string, 
+			    (const char **)&conv->converted[variant]);
+			if (rc != 0)
+				goto error_out;
+		}
+		*converted_p = conv->converted[variant];
+		*allocated_p = FALSE;
+		rc = 0; /* 正常終了 */
+		goto error_out;
+	}
+
+	rc = ipmsg_convert_string_external(ipaddr, string, converted_p);
+	if (rc != 0)
+		goto error_out;
+	*allocated_p = TRUE;
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	return rc;
+}
+
+#if defined(USE_OPENSSL)
+/** 複数宛先送信中に暗号化済みのメッセージを取り出す
+ *  @param[in]  ipaddr       送信先IPアドレス
+ *  @param[out] message_p    暗号化済みメッセージを指すポインタの返却先
+ *                           (呼び出し元で解放する)
+ *  @param[out] len_p        暗号化済みメッセージ長の返却先
+ *  @retval     0            正常終了
+ *  @retval    -ENOENT       暗号化済みメッセージが無い
+ *  @attention 内部リンケージ
+ */
+static int
+send_batch_take_encrypted(const char *ipaddr, char **message_p, 
+    size_t *len_p) {
+	send_batch_t      *batch = NULL;
+	gpointer             key = NULL;
+	gpointer           value = NULL;
+
+	batch = g_static_private_get(&send_batch_key);
+	if ( (batch == NULL) || (batch->encrypted == NULL) )
+		return -ENOENT;
+
+	if (!g_hash_table_lookup_extended(batch->encrypted, ipaddr, 
+		&key, &value))
+		return -ENOENT;
+
+	g_hash_table_steal(batch->encrypted, ipaddr);
+	g_free(key);
+
+	*message_p = value;
+	*len_p = strlen(value);
+
+	return 0;
+}
+#endif  /*  USE_OPENSSL  */
+
+/** 文字列を外部形式でバッファに格納する
+ *  @param[in]  ipaddr       送信先IPアドレス(コードセット判定に使用)
+ *  @param[in]  string       格納する文字列(内部形式)
+ *  @param[out] buf          格納先
+ *  @param[in]  bufsiz       格納先の大きさ
+ *  @param[out] len_p        格納した長さ(ヌルターミネート含まず)の返却先
+ *  @retval     0            正常終了
+ *  @retval    -ENOSPC       格納先が不足している(len_pに必要な長さを返す)
+ *  @retval    負の値        変換失敗(ipmsg_convert_string_externalの返却値)
+ *  @note ASCII文字のみの場合は変換せずに複写する.
+ *  @attention 内部リンケージ
+ */
+static int
+copy_external_string(const char *ipaddr, const char *string, char *buf, 
+    size_t bufsiz, size_t *len_p) {
+	int                   rc = 0;
+	const char    *converted = NULL;
+	const char          *src = NULL;
+	size_t               len = 0;
+	gboolean       allocated = FALSE;
+
+	src = string;
+	if (!is_ascii_string(string)) {
+		rc = convert_string_external_batched(ipaddr, string, 
+		    &converted, &allocated);
+		if (rc != 0)
+			goto error_out;
+		src = converted;
+	}
+
+	len = strlen(src);
+	*len_p = len;
+
+	rc = -ENOSPC;
+	if (len >= bufsiz)
+		goto free_converted_out;
+
+	memcpy(buf, src, len + 1);
+
+	rc = 0; /* 正常終了 */
+
+free_converted_out:
+	if (allocated)
+		g_free((gchar *)converted);
+error_out:
+	return rc;
+}
+
+/** IPMSGのメッセージパケットを生成し, 送信先のコードセットに変換して
+ *  指定されたバッファに格納する
  *  @param[in]  ipaddr      送信先IPアドレス(送信先コードセット判定に使用)
  *                          (NULLの場合は, ブロードキャスト用として
  *                           扱い, デフォルトコードセットを使用する).
@@ -50,33 +381,36 @@ GStaticMutex pktno_mutex = G_STATIC_MUTEX_INIT;
  *  @param[in]  flags        送信フラグ
  *  @param[in]  message      メッセージ部に格納する文字列を設定する.
  *  @param[in]  extension    拡張部に格納する文字列を設定する.
- *  @param[out]  external    外部形式のパケット文字列を指すためのポインタのアドレス
+ *  @param[out] buf          パケットの格納先
+ *  @param[in]  bufsiz       格納先の大きさ
  *  @param[out]  len_p       送信パケット長(ヌルターミネート含む)返却先アドレス
+ *                           -ENOSPC返却時は, 必要な大きさの目安を返す.
  *  @param[out]  pkt_ret     割り当てたパケット番号の返却先アドレス
  *                           IPMSG_PROTOCOL_MSG_NONEED_PKTNOが指定された場合は,
- *                           パケット番号の返却を実施しない
- *  @retval  0       正常終了
- *  @retval -EINVAL 引数異常
- *                  
+ *                           返却しない.
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    -ENOSPC       格納先が不足している
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note ASCII文字のみの部分は変換せず, 共通部のユーザ名/ホスト名は変換結果を
+ *        再利用するため, 通常はメモリを獲得しない.
  *  @attention 内部リンケージ
  */
 static int
-build_ipmsg_packet(const char *ipaddr, const pktno_t pkt_arg, 
-		   const ipmsg_send_flags_t flags, const char *message, 
-		   const char *extension, char **external, size_t *len_p, 
-		   pktno_t *pkt_ret) {
+build_ipmsg_packet_into(const char *ipaddr, const pktno_t pkt_arg, 
+    const ipmsg_send_flags_t flags, const char *message, 
+    const char *extension, char *buf, size_t bufsiz, size_t *len_p, 
+    pktno_t *pkt_ret) {
 	int                      rc = 0;
+	int                       n = 0;
 	pktno_t              pkt_no = 0;
+	size_t                  pos = 0;
 	size_t                  len = 0;
-	gchar     *converted_common = NULL;
-	gchar    *converted_message = NULL;
-	gchar  *converted_extension = NULL;
-	gchar *converted_all_packet = NULL;
-	gchar               *common = NULL;
-
-	if ( (ipaddr == NULL)  || (external == NULL) || 
-	    (*external != NULL) || (len_p == NULL) ) {
+	size_t                 part = 0;
+
+	if ( (buf == NULL) || (len_p == NULL) ) {
 		rc = -EINVAL;
+		goto error_out;
 	}
 
 	/*
@@ -87,117 +421,261 @@ build_ipmsg_packet(const char *ipaddr, const pktno_t pkt_arg,
 	else
 		pkt_no = pkt_arg;
 
-	common = g_malloc(IPMSG_BUFSIZ);
-	if (common == NULL)
-	  goto error_out;
-	
-	  
 	/* 
-	 * 共通部分生成
-	 */
-	snprintf(common, IPMSG_BUFSIZ, IPMSG_PROTOCOL_COMMON_MSG_FMT, 
-	    pkt_no, hostinfo_refer_user_name(), 
-	    hostinfo_refer_host_name(), flags);
-
-	/*
-	 * 外部形式に変換
+	 * 共通部分生成(IPMSG_PROTOCOL_COMMON_MSG_FMTの形式)
 	 */
+	n = snprintf(buf, bufsiz, IPMSG_PROTOCOL_PKTNO_FMT, (long)pkt_no);
+	if ( (n < 0) || ((size_t)n >= bufsiz) ) 
+		goto nospace_out;
+	pos = n;
 
-	len = 0; /* 出力長を初期化  */
-
-
-	/* 共通部分 */
-	rc = ipmsg_convert_string_external(ipaddr, common, 
-	    (const char **)&converted_common);
+	rc = copy_packet_prefix_names(ipaddr, buf + pos, bufsiz - pos, &part);
+	if (rc == -ENOSPC)
+		goto nospace_out;
 	if (rc != 0) {
 		ipmsg_err_dialog("%s:%s\n", 
 		    _("Can not convert common into external representation"), 
-		    common);
-		goto free_common_out;
-	} else {
-		/*
-		 * 末尾のヌルターミネートを含めて送信するため1加える
-		 */
-		len += (strlen(converted_common) + 1);
+		    hostinfo_refer_user_name());
+		goto error_out;
 	}
+	pos += part;
 
-	/* メッセージ本体  */
+	n = snprintf(buf + pos, bufsiz - pos, IPMSG_PROTOCOL_FLAGS_FMT, 
+	    (unsigned long)flags);
+	if ( (n < 0) || ((size_t)n >= (bufsiz - pos)) ) 
+		goto nospace_out;
+	pos += n;
+	/*
+	 * 送信長は各部の末尾のヌルターミネートを含めて数える
+	 * (従来の送信パケット長と合わせるため)
+	 */
+	len = pos + 1;
+
+	/* メッセージ本体(共通部の直後に連結する)  */
 	if (message != NULL) {
-		rc = ipmsg_convert_string_external(ipaddr, message, 
-		    (const char **)&converted_message);
+		rc = copy_external_string(ipaddr, message, buf + pos, 
+		    bufsiz - pos, &part);
+		if (rc == -ENOSPC)
+			goto nospace_out;
 		if (rc != 0) {
 			ipmsg_err_dialog("%s\n", 
 			    _("Can not convert message into external representation"));
-			goto free_converted_common;
-		} else {
-			/*
-			 * 末尾のヌルターミネートを含めて送信するため1加える
-			 */
-			len += (strlen(converted_message) + 1);
+			goto error_out;
 		}
+		pos += part;
+		len += part + 1;
 	}
 
-	/* 拡張部  */
+	/* 拡張部(メッセージ部との区切りはIPMSG_PROTOCOL_MSG_EXT_DELIM)  */
+	if ( (pos + 1) >= bufsiz ) 
+		goto nospace_out;
+	buf[pos++] = IPMSG_PROTOCOL_MSG_EXT_DELIM;
+	buf[pos] = '\0';
 	if (extension != NULL) {
-		rc = ipmsg_convert_string_external(ipaddr, extension, 
-		    (const char **)&converted_extension);
+		rc = copy_external_string(ipaddr, extension, buf + pos, 
+		    bufsiz - pos, &part);
+		if (rc == -ENOSPC)
+			goto nospace_out;
 		if (rc != 0) {
 			ipmsg_err_dialog("%s:%s\n", 
 			    _("Can not convert extension into external representation"), 
 			    extension);
-			goto free_converted_message;
-		} else {
-			/*
-			 * 末尾のヌルターミネートを含めて送信するため1加える
-			 */
-			len += (strlen(converted_extension) + 1);
+			goto error_out;
 		}
+		pos += part;
+		len += part + 1;
 	}
 
 	/*
-	 * パケットを組み立てる
+	 * 送信長に満たない部分はヌル文字で埋める
 	 */
-	converted_all_packet = g_malloc(len);
-	if (converted_all_packet == NULL) {
-		rc = -ENOMEM;
-		goto free_converted_extension;
-	}
-
-	memset(converted_all_packet, 0, len);
-	snprintf(converted_all_packet, len, IPMSG_PROTOCOL_ALLMSG_PACKET_FMT,
-	    converted_common, 
-	    (converted_message != NULL) ? (converted_message) : (""),
-	    IPMSG_PROTOCOL_MSG_EXT_DELIM,
-	    (converted_extension != NULL) ? (converted_extension) : (""));
+	if (len > bufsiz) 
+		goto nospace_out;
+	if (pos < len)
+		memset(buf + pos, 0, len - pos);
 
-	dbg_out("New packet:" IPMSG_PROTOCOL_ALLMSG_PACKET_FMT,
-	    common, message, IPMSG_PROTOCOL_MSG_EXT_DELIM_SYM, extension);
+	dbg_out("New packet:" IPMSG_PROTOCOL_COMMON_MSG_FMT "%s%c%s\n",
+	    (long)pkt_no, hostinfo_refer_user_name(), 
+	    hostinfo_refer_host_name(), (unsigned long)flags,
+	    (message != NULL) ? (message) : (""), 
+	    IPMSG_PROTOCOL_MSG_EXT_DELIM_SYM, 
+	    (extension != NULL) ? (extension) : (""));
 
 	/*
 	 * 返却
 	 */
-	*external = converted_all_packet;
 	*len_p = len;
 	if (pkt_ret != IPMSG_PROTOCOL_MSG_NONEED_PKTNO) 
 		*pkt_ret = pkt_no;
 
 	rc = 0; /* 正常終了 */
 
-free_converted_extension:
-	if (converted_extension != NULL)
-		g_free(converted_extension);
+error_out:
+	return rc;
 
-free_converted_message:
-	if (converted_message != NULL)
-		g_free(converted_message);
+nospace_out:
+	/* 呼び出し元が再試行できるよう, 格納先の倍の大きさを目安として返す */
+	*len_p = MAX(bufsiz * 2, IPMSG_BUFSIZ);
+	return -ENOSPC;
+}
+
+/** 送信パケット組み立て用のスレッド毎のバッファを参照する
+ *  @return     組み立て用バッファ(大きさはIPMSG_PROTOCOL_SCRATCH_SIZE)
+ *              獲得できなかった場合はNULL
+ *  @attention 内部リンケージ
+ */
+static char *
+refer_packet_scratch(void) {
+	char *scratch;
+
+	scratch = g_static_private_get(&packet_scratch);
+	if (scratch != NULL)
+		return scratch;
 
-free_converted_common:
-	if (converted_common != NULL)
-		g_free(converted_common);
-  
-free_common_out:
-	if (common != NULL)
-		g_free(common);
+	scratch = g_try_malloc(IPMSG_PROTOCOL_SCRATCH_SIZE);
+	if (scratch == NULL)
+		return NULL;
+
+	g_static_private_set(&packet_scratch, scratch, g_free);
+
+	return scratch;
+}
+
+/** IPMSGのメッセージパケットを生成する
+ *  @param[in]  ipaddr       送信先IPアドレス
+ *  @param[in]  pkt_arg      パケット番号(0の場合は, 自動生成する)
+ *  @param[in]  flags        送信フラグ
+ *  @param[in]  message      メッセージ部に格納する文字列を設定する.
+ *  @param[in]  extension    拡張部に格納する文字列を設定する.
+ *  @param[out] packet_p     パケットを指すポインタの返却先
+ *  @param[out] len_p        送信パケット長(ヌルターミネート含む)返却先アドレス
+ *  @param[out] pkt_ret      割り当てたパケット番号の返却先アドレス
+ *  @param[out] allocated_p  返却したパケットを呼び出し元で解放する必要がある場合にTRUE
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note 通常はスレッド毎のバッファに組み立てる. 収まらない場合のみ
+ *        メモリを獲得する. 返却したパケットは, 同じスレッドで次の
+ *        パケットを組み立てるまで有効.
+ *  @attention 内部リンケージ
+ */
+static int
+build_ipmsg_packet_scratch(const char *ipaddr, const pktno_t pkt_arg, 
+    const ipmsg_send_flags_t flags, const char *message, 
+    const char *extension, char **packet_p, size_t *len_p, 
+    pktno_t *pkt_ret, gboolean *allocated_p) {
+	int                      rc = 0;
+	char                   *buf = NULL;
+	size_t               bufsiz = 0;
+	size_t                  len = 0;
+	pktno_t              pkt_no = 0;
+
+	/*
+	 * 再試行時に同じパケット番号を使用するため, 先に割り当てる
+	 */
+	pkt_no = (pkt_arg == IPMSG_PROTOCOL_PKTNUM_AUTO) ? 
+	    (ipmsg_get_pkt_no()) : (pkt_arg);
+
+	*allocated_p = FALSE;
+	buf = refer_packet_scratch();
+	bufsiz = IPMSG_PROTOCOL_SCRATCH_SIZE;
+	if (buf == NULL) {
+		bufsiz = IPMSG_BUFSIZ;
+		buf = g_malloc(bufsiz);
+		*allocated_p = TRUE;
+	}
+
+	for( ; ; ) {
+		rc = build_ipmsg_packet_into(ipaddr, pkt_no, flags, message, 
+		    extension, buf, bufsiz, &len, pkt_ret);
+		if (rc != -ENOSPC)
+			break;
+		/*
+		 * 収まらない場合は, メモリを獲得して再度組み立てる
+		 */
+		if (*allocated_p)
+			g_free(buf);
+		bufsiz = len;
+		buf = g_try_malloc(bufsiz);
+		*allocated_p = TRUE;
+		if (buf == NULL) {
+			*allocated_p = FALSE;
+			rc = -ENOMEM;
+			break;
+		}
+	}
+
+	if (rc != 0) {
+		if (*allocated_p)
+			g_free(buf);
+		*allocated_p = FALSE;
+		goto error_out;
+	}
+
+	*packet_p = buf;
+	*len_p = len;
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	return rc;
+}
+
+/** IPMSGのメッセージパケットを生成し, 送信先のコードセットに変換する
+ *  @param[in]  ipaddr      送信先IPアドレス(送信先コードセット判定に使用)
+ *                          (NULLの場合は, ブロードキャスト用として
+ *                           扱い, デフォルトコードセットを使用する).
+ *  @param[in]  pkt_arg      パケット番号(0の場合は, 自動生成する)
+ *  @param[in]  flags        送信フラグ
+ *  @param[in]  message      メッセージ部に格納する文字列を設定する.
+ *  @param[in]  extension    拡張部に格納する文字列を設定する.
+ *  @param[out]  external    外部形式のパケット文字列を指すためのポインタのアドレス
+ *  @param[out]  len_p       送信パケット長(ヌルターミネート含む)返却先アドレス
+ *  @param[out]  pkt_ret     割り当てたパケット番号の返却先アドレス
+ *                           IPMSG_PROTOCOL_MSG_NONEED_PKTNOが指定された場合は,
+ *                           返却しない.
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note 呼び出し元に所有権を渡すパケット用. 送信のみ行う場合は
+ *        build_ipmsg_packet_scratchを使用すること.
+ *  @attention 内部リンケージ
+ */
+static int
+build_ipmsg_packet(const char *ipaddr, const pktno_t pkt_arg, 
+		   const ipmsg_send_flags_t flags, const char *message, 
+		   const char *extension, char **external, size_t *len_p, 
+		   pktno_t *pkt_ret) {
+	int                      rc = 0;
+	char                *packet = NULL;
+	size_t                  len = 0;
+	gboolean          allocated = FALSE;
+
+	if ( (external == NULL) || (*external != NULL) || (len_p == NULL) ) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	rc = build_ipmsg_packet_scratch(ipaddr, pkt_arg, flags, message, 
+	    extension, &packet, &len, pkt_ret, &allocated);
+	if (rc != 0)
+		goto error_out;
+
+	if (!allocated) {
+		packet = g_memdup(packet, len);
+		if (packet == NULL) {
+			rc = -ENOMEM;
+			goto error_out;
+		}
+	}
+
+	/*
+	 * 返却
+	 */
+	*external = packet;
+	*len_p = len;
+
+	rc = 0; /* 正常終了 */
 
 error_out:
 	return rc;
@@ -226,6 +704,7 @@ ipmsg_send_packet(const udp_con_t *con, const char *ipaddr, const pktno_t pktno,
 	int                    rc = 0;
 	size_t                len = 0;
 	pktno_t       sent_pkt_no = 0;
+	gboolean        allocated = FALSE;
 
 	if ( (ipaddr == IPMSG_PROTOCOL_ENTRY_PKT_ADDR) && (con == NULL) ){
 		rc = -EINVAL;
@@ -233,10 +712,10 @@ ipmsg_send_packet(const udp_con_t *con, const char *ipaddr, const pktno_t pktno,
 	}
 
 	/*
-	 * パケット構築
+	 * パケット構築(スレッド毎のバッファに組み立てる)
 	 */
-	rc = build_ipmsg_packet(ipaddr, pktno, flags, message, extension, 
-	    &packet, &len, &sent_pkt_no);
+	rc = build_ipmsg_packet_scratch(ipaddr, pktno, flags, message, 
+	    extension, &packet, &len, &sent_pkt_no, &allocated);
 	
 	if (rc != 0) {
 		g_assert(packet == NULL);  /* エラー時は獲得しない前提 */
@@ -278,7 +757,8 @@ ipmsg_send_packet(const udp_con_t *con, const char *ipaddr, const pktno_t pktno,
 	rc = 0; /* 正常終了 */
 
 free_packet_out:
-	g_free(packet);
+	if (allocated)
+		g_free(packet);
 
 error_out:
 	return rc;
@@ -475,7 +955,7 @@ ipmsg_send_recv_msg(const udp_con_t *con, const msg_data_t *orig_msg){
 	/*
 	 * ピアのIPアドレスを参照する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(orig_msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -502,6 +982,28 @@ error_out:
 	return rc;
 }
 
+/** 開封通知ダイアログを表示する
+ *  @param[in]  msg          受信したメッセージのメッセージ情報
+ *  @param[in]  ipaddr       送信元IPアドレス
+ *  @retval  0       正常終了
+ *  @attention 内部リンケージ
+ *  @attention UIスレッドで実行する
+ */
+static int
+ipmsg_show_read_message_dialog(const msg_data_t *msg, const char *ipaddr) {
+	gchar       *user = NULL;
+
+	user = g_strdup(refer_user_name_from_msg(msg)); /* ユーザ名獲得 */
+
+	/* 
+	 *  メモリ不足の場合, ユーザ名にNULLを送信。
+	 *  user領域の開放は受け手責任で実施する.
+	 */
+	read_message_dialog(user, ipaddr, msg->tv.tv_sec);
+
+	return 0;
+}
+
 /** IPMSGのIPMSG_READMSGパケットを処理する
  *  @param[in]  con          UDPコネクション情報
  *  @param[in]  msg          受信したメッセージのメッセージ情報
@@ -514,37 +1016,29 @@ static int
 ipmsg_proc_read_msg(const udp_con_t *con,const msg_data_t *msg) {
 	int            rc = 0;
 	pktno_t     pktno = 0;
-	gchar       *user = NULL;
-	struct timeval tv;
 
-	if (con == NULL) {
+	if ( (con == NULL) || (msg == NULL) ) {
 		rc = -EINVAL;
 		goto error_out;
 	}
 
-	gettimeofday(&tv, NULL); /* 受信確認時刻取得  */
-
-	if (msg != NULL) {
-		errno = 0;
-		pktno = strtol(msg->message, (char **)NULL, 10);
-		if (errno == 0) {
-			dbg_out("read mssage:seq %ld\n", pkt_no);
-		} else {
-			war_out("Gan not optain packet number:%s\n", msg->message);
-			rc = -errno;
-			goto error_out;
-		}
-
-		dbg_out("read mssage:seq %s\n", msg->message);
-		
-		user = g_strdup(refer_user_name_from_msg(msg)); /* ユーザ名獲得 */
+	errno = 0;
+	pktno = strtol(msg->message, (char **)NULL, 10);
+	if (errno == 0) {
+		dbg_out("read mssage:seq %ld\n", pkt_no);
+	} else {
+		war_out("Gan not optain packet number:%s\n", msg->message);
+		rc = -errno;
+		goto error_out;
 	}
 
-	/* 
-	 *  メモリ不足の場合やmsgがNULLの場合, ユーザ名にNULLを送信。
-	 *  user領域の開放は受け手責任で実施する.
+	dbg_out("read mssage:seq %s\n", msg->message);
+
+	/*
+	 * 受信確認時刻には, メッセージの受信時刻を使用する.
 	 */
-	read_message_dialog(user, udp_get_peeraddr(con), tv.tv_sec);
+	ipmsg_ui_event_call_message(ipmsg_show_read_message_dialog, msg, 
+	    refer_peer_addr_from_msg(msg));
 
 	rc = 0; /* 正常終了 */
 	
@@ -577,7 +1071,7 @@ ipmsg_proc_anspubkey(const udp_con_t *con,const msg_data_t *msg){
 	/*
 	 * ピアのIPアドレスを取得する.
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -650,7 +1144,7 @@ ipmsg_proc_get_public_key(const udp_con_t *con,const msg_data_t *msg) {
 	/*
 	 * ピアのIPアドレスを取得する.
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -771,7 +1265,8 @@ ipmsg_proc_recv_msg(const udp_con_t *con, const msg_data_t *msg) {
 
 	dbg_out("recv mssage:seq %ld\n", pkt_no);
 
-	unregister_sent_message(pktno); /*  送信完了パケットを再送登録から除去する  */
+	/*  送信完了パケットを再送登録から除去する  */
+	unregister_sent_message(refer_peer_addr_from_msg(msg), pktno);
 
 	rc = 0; /* 正常終了 */
 
@@ -807,7 +1302,7 @@ ipmsg_proc_br_isgetlist2(const udp_con_t *con, const msg_data_t *msg){
 	/*
 	 * ピアのIPアドレスを参照する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -879,7 +1374,7 @@ ipmsg_proc_getlist(const udp_con_t *con,const msg_data_t *msg){
 	/*
 	 * ピアのIPアドレスを参照する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -965,7 +1460,8 @@ ipmsg_protocol_user_opration(const udp_con_t *con, const msg_data_t *msg,
 		break;
 	}
 
-	userdb_print_user_list();
+	if (ipmsg_log_enabled(IPMSG_LOG_DEBUG))
+		userdb_print_user_list();
 
 	return rc;
 }
@@ -1024,12 +1520,12 @@ ipmsg_proc_okgetlist(const udp_con_t *con, const msg_data_t *msg){
 		goto error_out;
 	}
 
-	dbg_out("OK_GETLIST from %s.\n",udp_get_peeraddr(con));
+	dbg_out("OK_GETLIST from %s.\n",refer_peer_addr_from_msg(msg));
 	
 	/*
 	 * ピアのIPアドレスを参照する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -1166,7 +1662,7 @@ create_message:
 	/*
 	 * パケット送信
 	 */
-	rc = ipmsg_send_packet(con, IPMSG_PROTOCOL_ENTRY_PKT_ADDR, 
+	rc = ipmsg_send_packet(con, ipaddr, 
 	    IPMSG_PROTOCOL_PKTNUM_AUTO, local_flags, message, extension);
 	if (rc != 0) {
 		goto free_extension_out;
@@ -1200,28 +1696,137 @@ error_out:
  *                  ニックネーム<空白>'['不在種別']' (不在モード時)
  *    - 拡張部      : グループ名
  */
-static int
-ipmsg_send_ans_entry_common(const udp_con_t *con, const char *ipaddr, 
-    const ipmsg_send_flags_t flags){
-	int                         rc = 0;
-	ipmsg_send_flags_t local_flags = 0;
+static int
+ipmsg_send_ans_entry_common(const udp_con_t *con, const char *ipaddr, 
+    const ipmsg_send_flags_t flags){
+	int                         rc = 0;
+	ipmsg_send_flags_t local_flags = 0;
+
+	local_flags  = flags;
+	local_flags |= IPMSG_ANSENTRY;
+
+	rc = ipmsg_send_entry_packets(con, ipaddr, local_flags);
+	if (rc != 0) {
+		goto error_out;
+	}
+
+	rc = 0; /* 正常終了 */
+
+error_out:	
+	return rc;
+}
+
+/** IPMSG_ANSENTRY応答予約を解放する
+ *  @param[in]  data         IPMSG_ANSENTRY応答予約
+ *  @attention 内部リンケージ
+ */
+static void
+free_ans_entry_reply(gpointer data) {
+	ans_entry_reply_t *reply = (ans_entry_reply_t *)data;
+
+	if (reply == NULL)
+		return;
+
+	if (reply->timer_id != 0)
+		g_source_remove(reply->timer_id);
+
+	if (reply->ipaddr != NULL)
+		g_free(reply->ipaddr);
+
+	g_slice_free(ans_entry_reply_t, reply);
+}
+
+/** 予約したIPMSG_ANSENTRY応答を送出する(タイマハンドラ)
+ *  @param[in]  data         IPMSG_ANSENTRY応答予約
+ *  @retval     FALSE        タイマを解除する
+ *  @note 送出時に予約を破棄する. 以降に同一ホストから受信した
+ *        IPMSG_BR_ENTRYには改めて応答する(再起動や一覧の再取得に備える).
+ *  @attention 内部リンケージ
+ */
+static gboolean
+ans_entry_reply_handler(gpointer data) {
+	int                         rc = 0;
+	ans_entry_reply_t       *reply = (ans_entry_reply_t *)data;
+	const udp_con_t           *con = NULL;
+	char                   *ipaddr = NULL;
+	ipmsg_send_flags_t local_flags = 0;
+
+	g_static_mutex_lock(&ans_entry_mutex);
+
+	reply->timer_id = 0;  /*  本タイマはFALSE返却により解除される  */
+
+	if (!(reply->cancelled)) {
+		con = reply->con;
+		ipaddr = g_strdup(reply->ipaddr);
+		local_flags = reply->flags;
+	}
+	g_hash_table_remove(ans_entry_replies, reply->ipaddr); /* replyを解放 */
+
+	g_static_mutex_unlock(&ans_entry_mutex);
+
+	if (ipaddr == NULL)
+		goto no_send_out;  /*  応答取り消し, または, メモリ不足  */
+
+	/*
+	 * 不在状態は送信時点のものを使用する.
+	 */
+	local_flags |= hostinfo_get_normal_entry_flags();
+
+	dbg_out("ANS-Entry to %s Flag :%x\n", ipaddr, local_flags);
+
+	rc = ipmsg_send_ans_entry_common(con, ipaddr, local_flags);
+	if (rc != 0)
+		war_out("Can not send ANSENTRY to %s:%d\n", ipaddr, rc);
+
+	g_free(ipaddr);
+
+no_send_out:
+	return FALSE;
+}
+
+/** 予約済みのIPMSG_ANSENTRY応答を取り消す
+ *  @param[in]  ipaddr       応答先IPアドレス
+ *  @attention 内部リンケージ
+ */
+static void
+cancel_ans_entry_reply(const char *ipaddr) {
+	ans_entry_reply_t *reply = NULL;
 
-	local_flags  = flags;
-	local_flags |= IPMSG_ANSENTRY;
+	if (ipaddr == NULL)
+		return;
 
-	rc = ipmsg_send_entry_packets(con, ipaddr, local_flags);
-	if (rc != 0) {
-		goto error_out;
+	g_static_mutex_lock(&ans_entry_mutex);
+
+	if (ans_entry_replies != NULL) {
+		reply = g_hash_table_lookup(ans_entry_replies, ipaddr);
+		if (reply != NULL) {
+			dbg_out("Cancel ANS-Entry to %s\n", ipaddr);
+			reply->cancelled = TRUE;
+		}
 	}
 
-	rc = 0; /* 正常終了 */
+	g_static_mutex_unlock(&ans_entry_mutex);
+}
 
-error_out:	
-	return rc;
+/** 予約済みのIPMSG_ANSENTRY応答を全て破棄する
+ *  @note UIスレッド(メインループ)から呼び出すこと.
+ */
+void
+ipmsg_cleanup_ans_entry_replies(void) {
+
+	g_static_mutex_lock(&ans_entry_mutex);
+
+	if (ans_entry_replies != NULL) {
+		g_hash_table_destroy(ans_entry_replies);
+		ans_entry_replies = NULL;
+	}
+
+	g_static_mutex_unlock(&ans_entry_mutex);
 }
 
 /** IPMSG_BR_ENTRYへの応答として, IPMSG_ANSENTRYパケットを送出する
  *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  msg          受信したIPMSG_BR_ENTRYのメッセージ情報
  *  @param[in]  flags        パケット送信フラグ
  *  @retval     0            正常終了
  *  @retval    -EINVAL       引数異常
@@ -1234,26 +1839,63 @@ error_out:
  *    - 拡張部      : グループ名
  */
 static int
-ipmsg_send_ans_entry(const udp_con_t *con,const int flags){
+ipmsg_send_ans_entry(const udp_con_t *con, const msg_data_t *msg, const int flags){
 	int                         rc = 0;
-	ipmsg_send_flags_t local_flags = 0;
+	const char             *ipaddr = NULL;
+	ans_entry_reply_t       *reply = NULL;
 
-	local_flags  = flags;
-	local_flags |= hostinfo_get_normal_entry_flags();
+	ipaddr = refer_peer_addr_from_msg(msg);
+	if (ipaddr == NULL) {
+		rc = -ENOENT;
+		goto error_out;
+	}
+
+	g_static_mutex_lock(&ans_entry_mutex);
+
+	if (ans_entry_replies == NULL)
+		ans_entry_replies = g_hash_table_new_full(g_str_hash, 
+		    g_str_equal, NULL, free_ans_entry_reply);
+
+	reply = g_hash_table_lookup(ans_entry_replies, ipaddr);
+	if (reply != NULL) {
+		/*
+		 * 応答予約済みのため, 予約済みの応答に集約する.
+		 */
+		dbg_out("Coalesce ANS-Entry to %s\n", ipaddr);
+		reply->flags |= flags;
+		reply->cancelled = FALSE;
+		goto unlock_out;
+	}
+
+	reply = g_slice_new0(ans_entry_reply_t);
+	if (reply == NULL) {
+		rc = -ENOMEM;
+		goto unlock_out;
+	}
 
-	dbg_out("ANS-Entry Flag :%x\n", local_flags);
+	reply->ipaddr = g_strdup(ipaddr);
+	if (reply->ipaddr == NULL) {
+		g_slice_free(ans_entry_reply_t, reply);
+		rc = -ENOMEM;
+		goto unlock_out;
+	}
+	reply->con   = con;
+	reply->flags = flags;
 
 	/*
-	 * 応答用ANS_ENTRYを返す.
+	 * 応答用ANS_ENTRYを, 応答集中を避けるために遅延させて
+	 * 要求元にユニキャストで返す.
 	 */
-	rc = ipmsg_send_ans_entry_common(con, udp_get_peeraddr(con), 
-	    local_flags);
-	if (rc != 0) {
-		goto error_out;
-	}
+	reply->timer_id = g_timeout_add(
+		g_random_int_range(0, IPMSG_PROTOCOL_ANSENTRY_JITTER_MS + 1), 
+		ans_entry_reply_handler, reply);
+	g_hash_table_insert(ans_entry_replies, reply->ipaddr, reply);
 
 	rc = 0; /* 正常終了 */
 
+unlock_out:
+	g_static_mutex_unlock(&ans_entry_mutex);
+
 error_out:
 	return rc;
 }
@@ -1316,7 +1958,7 @@ ipmsg_proc_br_entry(const udp_con_t *con,const msg_data_t *msg) {
 		goto error_out;
 	}
 
-	ipmsg_send_ans_entry(con, 0);
+	ipmsg_send_ans_entry(con, msg, 0);
 
 	/* ユーザーリストを更新する */
 	rc = ipmsg_protocol_user_opration(con, msg, IPMSG_PROTOCOL_USR_ADD);
@@ -1328,7 +1970,7 @@ ipmsg_proc_br_entry(const udp_con_t *con,const msg_data_t *msg) {
 	/*
 	 * ピアのIPアドレスを取得する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -1376,6 +2018,9 @@ ipmsg_proc_br_exit(const udp_con_t *con,const msg_data_t *msg) {
 	    refer_nick_name_from_msg(msg),
 	    refer_group_name_from_msg(msg));
 
+	/* 退出したホストへの応答は不要 */
+	cancel_ans_entry_reply(refer_peer_addr_from_msg(msg));
+
 	/* ユーザーリストを更新する */
 	rc = ipmsg_protocol_user_opration(con, msg, IPMSG_PROTOCOL_USR_DEL);
 	if (rc != 0) {
@@ -1425,7 +2070,7 @@ ipmsg_proc_ans_entry(const udp_con_t *con,const msg_data_t *msg) {
 	/*
 	 * ピアのIPアドレスを取得する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -1483,6 +2128,7 @@ ipmsg_send_sendmsg_packets(const udp_con_t *con, const char *ipaddr,
 	ipmsg_cap_t                peer_cap = 0;
 	ipmsg_cap_t          peer_crypt_cap = 0;
 	ipmsg_send_flags_t      local_flags = 0;
+	gboolean        converted_allocated = FALSE;
 
 	if ( (con == NULL) || (ipaddr == NULL) || (message == NULL) ) {
 		rc = -EINVAL;
@@ -1539,11 +2185,21 @@ ipmsg_send_sendmsg_packets(const udp_con_t *con, const char *ipaddr,
 		}
 
 		if (peer_cap & IPMSG_ENCRYPTOPT) {
+			/*
+			 * 複数宛先送信時に暗号化済みであれば, それを使用する
+			 */
+			rc = send_batch_take_encrypted(ipaddr, &sent_message, 
+			    &sent_msg_len);
+			if (rc == 0) {
+				logfile_send_log(ipaddr, local_flags, message);
+				goto end_encryption;
+			}
+
 			/*
 			 * 暗号化を実施する場合は, 先にエンコード変換が必要
 			 */
-			rc = ipmsg_convert_string_external(ipaddr, message, 
-			    (const gchar **)&converted_message);
+			rc = convert_string_external_batched(ipaddr, message, 
+			    (const char **)&converted_message, &converted_allocated);
 			if (rc != 0) {
 				ipmsg_err_dialog("%s:%s\n", 
 				    _("Can not convert common into external representation"), 
@@ -1608,7 +2264,7 @@ free_sent_message_out:
 	if ( (message != sent_message) && (sent_message != NULL) )
 		g_free(sent_message);
 
-	if (converted_message != NULL)
+	if ( (converted_message != NULL) && (converted_allocated) )
 		g_free(converted_message);
 errot_out:
 	return rc;
@@ -1616,13 +2272,15 @@ errot_out:
 
 /** IPMSGのIPMSG_SENDABSENCEINFOパケットを送出する
  *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  orig_msg     不在通知の契機となった受信メッセージ情報
  *  @param[in]  flags        パケット送信フラグ
  *  @retval     0            正常終了
  *  @retval    -EINVAL       引数異常
  *  @retval    -ENOMEM       メモリ不足
  */
 static int
-ipmsg_send_absence_msg(const udp_con_t *con, const int flags) {
+ipmsg_send_absence_msg(const udp_con_t *con, const msg_data_t *orig_msg, 
+    const int flags) {
 	char        *absence_message = NULL;
 	const char          *ipaddr = NULL;
 	int             local_flags = 0;
@@ -1642,7 +2300,7 @@ ipmsg_send_absence_msg(const udp_con_t *con, const int flags) {
 	/*
 	 * ピアのIPアドレスを取得する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(orig_msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto no_need_free_out;
@@ -1676,6 +2334,31 @@ no_need_free_out:
 	return rc;
 }
 
+/** 情報/不在情報ウィンドウを表示する
+ *  @param[in]  msg          受信したメッセージ情報
+ *  @param[in]  ipaddr       送信元IPアドレス
+ *  @retval     0            正常終了
+ *  @retval    -ENOMEM       メモリ不足
+ *  @attention 内部リンケージ
+ *  @attention UIスレッドで実行する
+ */
+static int
+ipmsg_show_info_message_window(const msg_data_t *msg, const char *ipaddr) {
+	gchar       *peer_name = NULL;
+
+	/* ユーザ名をメッセージから抽出する  */
+	peer_name = g_strdup(refer_user_name_from_msg(msg));
+	if (peer_name == NULL)
+		return -ENOMEM;
+
+	/*  
+	 * peer_nameの開放は, 受け手で実施  
+	 */
+	info_message_window(peer_name, ipaddr, msg->command, msg->message);
+
+	return 0;
+}
+
 /** IPMSGのIPMSG_SENDABSENCEINFO/IPMSG_SENDINFOパケットを処理する
  *  @param[in]  con          UDPコネクション情報
  *  @param[in]  msg          受信したメッセージ情報
@@ -1687,7 +2370,6 @@ static int
 ipmsg_proc_send_info_packets(const udp_con_t *con, const msg_data_t *msg) {
 	int                           rc = 0;
 	ipmsg_command_t received_command = 0;
-	gchar                 *peer_name = NULL;
 
 	dbg_out("here\n");
 
@@ -1703,25 +2385,16 @@ ipmsg_proc_send_info_packets(const udp_con_t *con, const msg_data_t *msg) {
 	if (rc != 0)
 		goto error_out;
 
-	/* ユーザ名をメッセージから抽出する  */
-	peer_name = g_strdup(refer_user_name_from_msg(msg));
-	if (peer_name == NULL) {
-		rc = -ENOMEM;
-		goto error_out;
-	}
-
 	/*  
 	 * 受信したメッセージを処理
-	 * peer_nameの開放は, 受け手で実施  
 	 */
 	switch (received_command) {
 	case IPMSG_SENDABSENCEINFO:
-		info_message_window(peer_name, udp_get_peeraddr(con), 
-		    IPMSG_SENDABSENCEINFO, msg->message);
-		break;
 	case IPMSG_SENDINFO:
-		info_message_window(peer_name, udp_get_peeraddr(con), 
-		    IPMSG_SENDINFO, msg->message);		
+		rc = ipmsg_ui_event_call_message(ipmsg_show_info_message_window, 
+		    msg, refer_peer_addr_from_msg(msg));
+		if (rc != 0)
+			goto error_out;
 		break;
 	default:
 		break;
@@ -1823,7 +2496,7 @@ ipmsg_proc_get_absence_info(const udp_con_t *con, const msg_data_t *orig_msg) {
 	/*
 	 * 不在通知文送信
 	 */
-	rc = ipmsg_send_absence_msg(con, local_flags);
+	rc = ipmsg_send_absence_msg(con, orig_msg, local_flags);
 	if (rc != 0)
 		goto error_out;
 
@@ -1866,7 +2539,7 @@ ipmsg_proc_get_info(const udp_con_t *con, const msg_data_t *orig_msg){
 	/*
 	 * ピアのIPアドレスを取得する
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(orig_msg);
 	if (ipaddr == NULL) {
 		rc = -ENOENT;
 		goto error_out;
@@ -1924,6 +2597,204 @@ error_out:
 	return rc;
 }
 
+/** 受信ウィンドウを生成する
+ *  @param[in]  msg          受信したメッセージ情報
+ *  @param[in]  ipaddr       送信元IPアドレス
+ *  @retval     0            正常終了
+ *  @attention 内部リンケージ
+ *  @attention UIスレッドで実行する
+ */
+static int
+ipmsg_show_receive_window(const msg_data_t *msg, const char *ipaddr) {
+
+	if (hostinfo_refer_ipmsg_default_popup()) 
+		store_message_window(msg, ipaddr);
+	else
+		recv_message_window(msg, ipaddr);
+
+	return 0;
+}
+
+/** 受信済みIPMSG_SENDMSGの記録のハッシュ値を算出する
+ *  @param[in]  key          受信済みIPMSG_SENDMSGの記録
+ *  @return     ハッシュ値
+ *  @attention 内部リンケージ
+ */
+static guint
+recv_dedup_hash(gconstpointer key) {
+	const recv_dedup_entry_t *entry = (const recv_dedup_entry_t *)key;
+
+	return g_str_hash(entry->ipaddr) ^ ((guint)entry->pktno * 2654435761U);
+}
+
+/** 受信済みIPMSG_SENDMSGの記録の(送信元, パケット番号)が等しいか判定する
+ *  @param[in]  a            受信済みIPMSG_SENDMSGの記録
+ *  @param[in]  b            受信済みIPMSG_SENDMSGの記録
+ *  @retval     TRUE         等しい
+ *  @retval     FALSE        異なる
+ *  @attention 内部リンケージ
+ */
+static gboolean
+recv_dedup_equal(gconstpointer a, gconstpointer b) {
+	const recv_dedup_entry_t *entry_a = (const recv_dedup_entry_t *)a;
+	const recv_dedup_entry_t *entry_b = (const recv_dedup_entry_t *)b;
+
+	if (entry_a->pktno != entry_b->pktno)
+		return FALSE;
+
+	return (strcmp(entry_a->ipaddr, entry_b->ipaddr) == 0) ? (TRUE) : (FALSE);
+}
+
+/** IPMSG_SENDMSGを受信済みか判定する
+ *  @param[in]  ipaddr       送信元IPアドレス
+ *  @param[in]  pktno        パケット番号
+ *  @retval     TRUE         重複受信判定時間内に受信済み
+ *  @retval     FALSE        未受信
+ *  @attention 内部リンケージ
+ */
+static gboolean
+recv_dedup_is_duplicate(const char *ipaddr, pktno_t pktno) {
+	recv_dedup_entry_t   key;
+	recv_dedup_entry_t *found = NULL;
+	GTimeVal           now;
+
+	key.ipaddr = (char *)ipaddr;
+	key.pktno = pktno;
+	g_get_current_time(&now);
+
+	g_static_mutex_lock(&recv_dedup_mutex);
+	if (recv_dedup_table != NULL)
+		found = g_hash_table_lookup(recv_dedup_table, &key);
+	if ( (found != NULL) && 
+	    ( (now.tv_sec - found->seen) > IPMSG_PROTOCOL_DEDUP_WINDOW_SEC ) )
+		found = NULL;
+	g_static_mutex_unlock(&recv_dedup_mutex);
+
+	return (found != NULL) ? (TRUE) : (FALSE);
+}
+
+/** IPMSG_SENDMSGを受信済みとして記録する
+ *  @param[in]  ipaddr       送信元IPアドレス
+ *  @param[in]  pktno        パケット番号
+ *  @note 記録数がIPMSG_PROTOCOL_DEDUP_ENTRIESに達した場合は最も古い記録を消去する.
+ *  @attention 内部リンケージ
+ */
+static void
+recv_dedup_record(const char *ipaddr, pktno_t pktno) {
+	recv_dedup_entry_t   key;
+	recv_dedup_entry_t *entry = NULL;
+	GTimeVal           now;
+
+	key.ipaddr = (char *)ipaddr;
+	key.pktno = pktno;
+	g_get_current_time(&now);
+
+	g_static_mutex_lock(&recv_dedup_mutex);
+
+	if (recv_dedup_table == NULL)
+		recv_dedup_table = g_hash_table_new(recv_dedup_hash, 
+		    recv_dedup_equal);
+
+	entry = g_hash_table_lookup(recv_dedup_table, &key);
+	if (entry != NULL) {
+		entry->seen = now.tv_sec;
+		goto unlock_out;
+	}
+
+	entry = &recv_dedup_ring[recv_dedup_next];
+	if (entry->ipaddr != NULL) {
+		g_hash_table_remove(recv_dedup_table, entry);
+		g_free(entry->ipaddr);
+	}
+
+	entry->ipaddr = g_strdup(ipaddr);
+	if (entry->ipaddr == NULL)
+		goto unlock_out;
+	entry->pktno = pktno;
+	entry->seen = now.tv_sec;
+	g_hash_table_insert(recv_dedup_table, entry, entry);
+
+	recv_dedup_next = (recv_dedup_next + 1) % IPMSG_PROTOCOL_DEDUP_ENTRIES;
+
+unlock_out:
+	g_static_mutex_unlock(&recv_dedup_mutex);
+}
+
+/** 受信済みIPMSG_SENDMSGの記録を破棄する
+ */
+void
+ipmsg_cleanup_recv_dedup(void) {
+	int i;
+
+	g_static_mutex_lock(&recv_dedup_mutex);
+
+	if (recv_dedup_table != NULL) {
+		g_hash_table_destroy(recv_dedup_table);
+		recv_dedup_table = NULL;
+	}
+	for(i = 0; i < IPMSG_PROTOCOL_DEDUP_ENTRIES; ++i) {
+		if (recv_dedup_ring[i].ipaddr != NULL) {
+			g_free(recv_dedup_ring[i].ipaddr);
+			recv_dedup_ring[i].ipaddr = NULL;
+		}
+	}
+	recv_dedup_next = 0;
+
+	g_static_mutex_unlock(&recv_dedup_mutex);
+}
+
+/** 再送されたIPMSG_SENDMSGか判定し, 再送であれば受信確認のみを返す
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  msg          受信したメッセージ情報
+ *  @retval     TRUE         再送されたパケット(以降の処理は不要)
+ *  @retval     FALSE        新規のパケット
+ *  @note 受信確認が送信元に届かなかった場合に, 文字列変換, 復号,
+ *        ログ記録, 受信ウィンドウ生成を繰り返さないようにする.
+ *  @attention 内部リンケージ
+ */
+static gboolean
+ipmsg_proc_resent_send_msg(const udp_con_t *con, const msg_data_t *msg) {
+	const gchar     *ipaddr = NULL;
+	pktno_t           pktno = 0;
+
+	ipaddr = refer_peer_addr_from_msg(msg);
+	if (ipaddr == NULL)
+		return FALSE;
+
+	pktno = refer_pkt_no_name_from_msg(msg);
+	if (!recv_dedup_is_duplicate(ipaddr, pktno))
+		return FALSE;
+
+	dbg_out("Discard resent message: (ipaddr, pktno) = (%s, %d)\n", 
+	    ipaddr, pktno);
+
+	if ( ( msg->command_opts & IPMSG_SENDCHECKOPT ) &&
+	    ( !( msg->command_opts & IPMSG_NO_REPLY_OPTS ) ) )
+		ipmsg_send_recv_msg(con, msg);
+
+	return TRUE;
+}
+
+/** 受信済みのIPMSG_SENDMSGの再送を復号前に破棄する
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  msg          受信したメッセージ情報(復号前でよい)
+ *  @retval     TRUE         再送されたパケット(受信確認を返送済み)
+ *  @retval     FALSE        再送ではない, または, IPMSG_SENDMSG以外
+ *  @note ヘッダ部(コマンド, パケット番号, 送信元)のみを参照するため,
+ *        暗号化されたメッセージを復号スレッドに渡す前に呼び出せる.
+ */
+gboolean
+ipmsg_filter_resent_message(const udp_con_t *con, const msg_data_t *msg) {
+
+	if ( (con == NULL) || (msg == NULL) )
+		return FALSE;
+
+	if (msg->command != IPMSG_SENDMSG)
+		return FALSE;
+
+	return ipmsg_proc_resent_send_msg(con, msg);
+}
+
 /** IPMSG_SENDMSGパケットを処理する.
  *  @param[in]  con          UDPコネクション情報
  *  @param[in]  flags        パケット送信フラグ
@@ -1942,7 +2813,7 @@ ipmsg_proc_send_msg(const udp_con_t *con, const msg_data_t *msg) {
 	/*
 	 * 文字列変換のためにピアのIPアドレスを取得する.
 	 */
-	ipaddr = udp_get_peeraddr(con);
+	ipaddr = refer_peer_addr_from_msg(msg);
 	if (ipaddr == NULL) {
 		rc = -EINVAL;
 		goto error_out;
@@ -1993,17 +2864,14 @@ ipmsg_proc_send_msg(const udp_con_t *con, const msg_data_t *msg) {
 		if (hostinfo_refer_ipmsg_default_secret())
 			local_flags |= IPMSG_SECRETOPT;
 
-		ipmsg_send_absence_msg(con, local_flags);
+		ipmsg_send_absence_msg(con, msg, local_flags);
 	}
 
 show_receive_win:
 	/*
 	 * 受信ウィンドウを生成する.
 	 */
-	if (hostinfo_refer_ipmsg_default_popup()) 
-		store_message_window(msg, ipaddr);
-	else
-		recv_message_window(msg, ipaddr);
+	ipmsg_ui_event_call_message(ipmsg_show_receive_window, msg, ipaddr);
 
 	rc = 0; /* 正常終了 */
 
@@ -2077,6 +2945,37 @@ error_out:
 	return rc;
 }
 
+/** 自発的なIPMSG_ANSENTRYパケットをブロードキャストする
+ *  自ホストの暗号化能力などが変化したことを通知するのに使用する.
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  flags        パケット送信フラグ
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note  IPMSG_BR_ENTRYと異なり, ピアからの応答を要求しない.
+ *         送信フラグには現在のエントリフラグを付加する.
+ */
+int
+ipmsg_send_br_ans_entry(const udp_con_t *con, const int flags){
+	int rc = 0;
+
+	if (con == NULL)
+		return -EINVAL;
+
+	dbg_out("Send broadcast ANS_ENTRY with 0x%08x\n", flags);
+
+	rc = ipmsg_send_ans_entry_common(con, IPMSG_PROTOCOL_ENTRY_PKT_ADDR, 
+	    flags);
+	if (rc != 0) {
+		goto error_out;
+	}
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	return rc;
+}
+
 /** IPMSGのIPMSG_BR_ENTRYパケットを送出する.
  *  @param[in]  con          UDPコネクション情報
  *  @param[in]  flags        パケット送信フラグ
@@ -2289,6 +3188,177 @@ error_out:
 	return rc;
 }
 
+/** 複数宛先へのIPMSG_SENDMSG送信を開始する
+ *  @param[in]  message      全宛先に送信するメッセージ本文
+ *  @param[in]  extension    全宛先に送信する拡張部(無い場合はNULL)
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    -EBUSY        このスレッドで既に開始されている
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note ipmsg_send_batch_endを呼び出すまでの間, 同一スレッドから
+ *        同じ領域のmessage/extensionを指定して送信したパケットについては,
+ *        外部形式への変換結果を送信先コードセット毎に再利用する.
+ */
+int
+ipmsg_send_batch_begin(const char *message, const char *extension) {
+	int                         rc = 0;
+	send_batch_t            *batch = NULL;
+
+	if (message == NULL) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	if (g_static_private_get(&send_batch_key) != NULL) {
+		rc = -EBUSY;
+		goto error_out;
+	}
+
+	batch = g_slice_new0(send_batch_t);
+	if (batch == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+
+	batch->conv[0].source = message;
+	batch->conv[1].source = extension;
+	g_static_private_set(&send_batch_key, batch, NULL);
+
+	rc = 0; /* 正常終了  */
+
+error_out:
+	return rc;
+}
+
+/** 複数宛先へのIPMSG_SENDMSG送信に先立って, 各宛先向けの暗号化を行う
+ *  @param[in]  addrs        宛先IPアドレスのリスト
+ *  @param[in]  flags        送信フラグ
+ *  @retval     0            正常終了
+ *  @retval    -ENOENT       複数宛先送信が開始されていない
+ *  @retval    -ENOMEM       メモリ不足
+ *  @note 公開鍵を保持している宛先について, 本文の暗号化を暗号種別毎に
+ *        1度だけ行い, 宛先毎のセッションキーの暗号化と署名を並行して行う.
+ *        ここで暗号化できなかった宛先は, 送信時に個別に暗号化する.
+ */
+int
+ipmsg_send_batch_prepare(const GList *addrs, int flags) {
+	int                         rc = 0;
+#if defined(USE_OPENSSL)
+	int                          i = 0;
+	int                      count = 0;
+	send_batch_t            *batch = NULL;
+	const GList              *node = NULL;
+	const char             *ipaddr = NULL;
+	const char          *converted = NULL;
+	gboolean             allocated = FALSE;
+	ipmsg_cap_t           peer_cap = 0;
+	ipmsg_cap_t     peer_crypt_cap = 0;
+	ipmsg_encrypt_req_t      *reqs = NULL;
+
+	if ( ( !(flags & IPMSG_ENCRYPTOPT) ) || 
+	    ( flags & IPMSG_PROTOCOL_INFOMSG_TYPE ) ) 
+		goto no_encrypt_out;
+
+	batch = g_static_private_get(&send_batch_key);
+	if (batch == NULL) {
+		rc = -ENOENT;
+		goto error_out;
+	}
+
+	reqs = g_new0(ipmsg_encrypt_req_t, g_list_length((GList *)addrs) + 1);
+	if (reqs == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+
+	for(node = addrs; node != NULL; node = g_list_next(node)) {
+		ipaddr = (const char *)node->data;
+
+		rc = userdb_get_cap_by_addr(ipaddr, &peer_cap, &peer_crypt_cap);
+		if ( (rc != 0) || ( !(peer_cap & IPMSG_ENCRYPTOPT) ) || 
+		    (peer_crypt_cap == 0) )
+			continue; /* 送信時に個別に処理する  */
+
+		rc = convert_string_external_batched(ipaddr, 
+		    batch->conv[0].source, &converted, &allocated);
+		if (rc != 0)
+			continue;
+		if (allocated) { /* 変換結果を保持できない場合は個別に処理する */
+			g_free((gchar *)converted);
+			continue;
+		}
+
+		reqs[count].peer_addr = ipaddr;
+		reqs[count].message = converted;
+		++count;
+	}
+
+	rc = 0;
+	if (count == 0)
+		goto free_reqs_out;
+
+	rc = ipmsg_encrypt_message_multi(reqs, count);
+	if (rc != 0)
+		goto free_reqs_out;
+
+	if (batch->encrypted == NULL)
+		batch->encrypted = g_hash_table_new_full(g_str_hash, g_str_equal,
+		    g_free, g_free);
+
+	for(i = 0; i < count; ++i) {
+		if (reqs[i].rc != 0)
+			continue;
+		g_hash_table_replace(batch->encrypted, 
+		    g_strdup(reqs[i].peer_addr), reqs[i].result);
+		reqs[i].result = NULL;
+	}
+
+	rc = 0; /* 正常終了  */
+
+free_reqs_out:
+	for(i = 0; i < count; ++i) {
+		if (reqs[i].result != NULL)
+			g_free(reqs[i].result);
+	}
+	g_free(reqs);
+
+error_out:
+	return rc;
+
+no_encrypt_out:
+#endif  /*  USE_OPENSSL  */
+	rc = 0; /* 正常終了  */
+
+	return rc;
+}
+
+/** 複数宛先へのIPMSG_SENDMSG送信を終了する
+ *  @note 保持していた変換結果を解放する.
+ */
+void
+ipmsg_send_batch_end(void) {
+	int                          i = 0;
+	int                          j = 0;
+	send_batch_t            *batch = NULL;
+
+	batch = g_static_private_get(&send_batch_key);
+	if (batch == NULL)
+		return;
+
+	g_static_private_set(&send_batch_key, NULL, NULL);
+
+	if (batch->encrypted != NULL)
+		g_hash_table_destroy(batch->encrypted);
+
+	for(i = 0; i < 2; ++i) {
+		for(j = 0; j < 2; ++j) {
+			if (batch->conv[i].converted[j] != NULL)
+				g_free(batch->conv[i].converted[j]);
+		}
+	}
+	g_slice_free(send_batch_t, batch);
+}
+
 /** IPMSGのIPMSG_RELEASEFILESパケットを送出する
  *  @param[in]  con          UDPコネクション情報
  *  @param[in]  ipaddr       送信先IPアドレス
@@ -2596,7 +3666,12 @@ ipmsg_dispatch_message(const udp_con_t *con, const msg_data_t *msg){
 		break;
 	case IPMSG_SENDMSG:
 		dbg_out("Dispatch send_message\n");
-		ipmsg_proc_send_msg(con, msg);
+		if (ipmsg_proc_resent_send_msg(con, msg))
+			break;
+		/* 処理できたメッセージのみ記録し, 失敗時は再送を受け付ける */
+		if (ipmsg_proc_send_msg(con, msg) == 0)
+			recv_dedup_record(refer_peer_addr_from_msg(msg),
+			    refer_pkt_no_name_from_msg(msg));
 		break;
 	case IPMSG_RECVMSG:
 		dbg_out("Dispatch recv_message\n");
@@ -76,19 +76,27 @@
 #define IPMSG_PROTOCOL_MSG_NONEED_PKTNO (NULL) 
 
 
-/** IPMSGのパケット形式(全コマンド共通部分)を表す書式指定文字列
- * @note 1:pktno:ユーザ名:ホスト名:送信フラグ を表す文字列.
+/** IPMSGのパケット共通部分の先頭(版数:パケット番号:)を表す書式指定文字列
+ */
+#define IPMSG_PROTOCOL_PKTNO_FMT         "1:%ld:"
+/** IPMSGのパケット共通部分の末尾(:送信フラグ:)を表す書式指定文字列
  */
-#define IPMSG_PROTOCOL_COMMON_MSG_FMT    "1:%ld:%s:%s:%lu:"
-/** IPMSGのパケット(全体)を作成するための書式指定文字列
- * @note 共通部メッセージ部\0拡張部という形式. 共通部の末尾にデリミタである:を
- *       入れたため, このような定義としている
+#define IPMSG_PROTOCOL_FLAGS_FMT         ":%lu:"
+/** IPMSGのパケット形式(全コマンド共通部分)を表す書式指定文字列
+ * @note 1:pktno:ユーザ名:ホスト名:送信フラグ: を表す文字列.
+ *       送信パケットは各部を順に組み立てるため, 先頭と末尾の書式を組み合わせて
+ *       定義している.
  */
-#define IPMSG_PROTOCOL_ALLMSG_PACKET_FMT "%s%s%c%s"
+#define IPMSG_PROTOCOL_COMMON_MSG_FMT    \
+	IPMSG_PROTOCOL_PKTNO_FMT "%s:%s" IPMSG_PROTOCOL_FLAGS_FMT
 /** IPMSGのパケットのメッセージ部, 拡張部のデリミタ文字
  * @note 共通部メッセージ部\0拡張部という形式
  */
 #define IPMSG_PROTOCOL_MSG_EXT_DELIM      '\0'
+/** 送信パケット組み立て用のスレッド毎のバッファの大きさ
+ * @note これに収まらないパケットの場合のみ, 組み立て時にメモリを獲得する.
+ */
+#define IPMSG_PROTOCOL_SCRATCH_SIZE       (_MSG_BUF_SIZE)
 /** デバッグ文表示のためのメッセージ部, 拡張部のデリミタ文字
  * @note 共通部メッセージ部\0拡張部という形式
  */
@@ -109,6 +117,19 @@
 #define IPMSG_PROTOCOL_SENDINFO_FMT       "GNOME2 %s (%s)\n%s:%s"
 
 
+/** IPMSG_BR_ENTRYに対するIPMSG_ANSENTRY応答の最大遅延時間(単位:ms)
+ * @note 新規参加時に全ホストの応答が集中しないよう, 0からこの時間までの
+ *       範囲で応答を遅らせる.
+ */
+#define IPMSG_PROTOCOL_ANSENTRY_JITTER_MS (500)
+/** 重複受信判定のために記録するIPMSG_SENDMSGの数
+ */
+#define IPMSG_PROTOCOL_DEDUP_ENTRIES      (1024)
+/** 重複受信とみなす時間(単位:秒)
+ * @note 送信側の再送が終わるまでの時間より長くすること.
+ */
+#define IPMSG_PROTOCOL_DEDUP_WINDOW_SEC   (120)
+
 /** 情報系パケット(情報通知)のコマンドを表すビットマップ
  */
 #define IPMSG_PROTOCOL_INFOMSG_TYPE       (IPMSG_SENDINFO|IPMSG_SENDABSENCEINFO)
@@ -184,11 +205,18 @@ pktno_t ipmsg_get_pkt_no(void);
 int ipmsg_send_release_files(const udp_con_t *, const char *, int );
 int ipmsg_send_br_entry(const udp_con_t *, const int );
 int ipmsg_send_gratuitous_ans_entry(const udp_con_t *, const char *, const int );
+int ipmsg_send_br_ans_entry(const udp_con_t *, const int );
 int ipmsg_send_br_exit(const udp_con_t *, const int );
+void ipmsg_cleanup_ans_entry_replies(void);
+void ipmsg_cleanup_recv_dedup(void);
 int ipmsg_send_br_absence(const udp_con_t *, const int );
 int ipmsg_send_read_msg(const udp_con_t *, const char *, pktno_t );
 int ipmsg_send_send_msg(const udp_con_t *, const char *, int , int , const char *, const char *);
+int ipmsg_send_batch_begin(const char *, const char *);
+int ipmsg_send_batch_prepare(const GList *, int );
+void ipmsg_send_batch_end(void);
 int ipmsg_dispatch_message(const udp_con_t *, const msg_data_t *);
+gboolean ipmsg_filter_resent_message(const udp_con_t *, const msg_data_t *);
 int ipmsg_send_get_info_msg(const udp_con_t *, const char *, ipmsg_command_t );
 int ipmsg_send_getpubkey(const udp_con_t *, const char *);
 int ipmsg_send_get_list(const udp_con_t *, const char *, const int );
@@ -67,6 +67,50 @@ GStaticMutex    rsa_key_mutex = G_STATIC_MUTEX_INIT;
  */
 static RSA *rsa_keys[RSA_KEY_MAX];
 
+/** OpenSSLのスレッド間排他用ロック(CRYPTO_num_locks個)
+ * @attention 内部リンケージ
+ */
+static GMutex **openssl_locks = NULL;
+
+/** OpenSSLのスレッド間排他用ロックの数
+ * @attention 内部リンケージ
+ */
+static int openssl_nr_locks = 0;
+
+/** バックグラウンドでのRSA鍵生成要求
+ */
+typedef struct _rsa_keygen_job{
+	int               index;  /*  鍵種別インデクス  */
+	GThread         *thread;  /*  鍵生成スレッド  */
+	RSA                *rsa;  /*  生成した鍵  */
+	int                  rc;  /*  鍵生成結果  */
+}rsa_keygen_job_t;
+
+/** 生成中のRSA鍵生成要求(鍵種別インデクス毎)
+ * @attention 内部リンケージ
+ */
+static rsa_keygen_job_t *rsa_keygen_jobs[RSA_KEY_MAX];
+
+/** 鍵生成完了キュー
+ * @attention 内部リンケージ
+ */
+static GAsyncQueue *rsa_keygen_done_queue = NULL;
+
+/** 生成中のRSA鍵の数
+ * @attention 内部リンケージ
+ */
+static gint rsa_keygen_pending = 0;
+
+/** 生成または登録に失敗したRSA鍵の数
+ * @attention 内部リンケージ
+ */
+static gint rsa_keygen_failed = 0;
+
+/** 生成した鍵の保存に使用するパスフレーズ
+ * @attention 内部リンケージ
+ */
+static gchar *rsa_keygen_passwd = NULL;
+
 /** 鍵種別インデクスから公開鍵暗号化能力IDへの変換テーブル
  * @attention 内部リンケージ
  */
@@ -758,10 +802,9 @@ generate_rsa_key(RSA **rsa_p, ipmsg_cap_t key_type) {
  *  @retval    0       正常終了
  *  @retval   -EINVAL  引数異常(peer_eまたはpeer_n, rsaのいずれかがNULLである).
  *  @retval   -ENOMEM  メモリ不足
- *  @attention 内部リンケージ
  */
-static int
-convert_peer_key(const char *peer_e,const char *peer_n,RSA **rsa){
+int
+pcrypt_convert_peer_key(const char *peer_e,const char *peer_n,RSA **rsa){
 	int              rc = 0;
 	RSA         *pubkey = NULL;
 	BIGNUM        *bn_e = NULL;
@@ -784,13 +827,12 @@ convert_peer_key(const char *peer_e,const char *peer_n,RSA **rsa){
 	if (bn_n == NULL)
 		goto free_bn_e_out;
 
-	rc = BN_hex2bn(&bn_e, peer_e);
-	if (rc == 0)
-		goto free_bn_e_out;
+	rc = -EINVAL;
+	if (BN_hex2bn(&bn_e, peer_e) == 0)
+		goto free_bn_n_out;
 
-	rc = BN_hex2bn(&bn_n, peer_n);
-	if (rc == 0)
-		goto free_bn_e_out;
+	if (BN_hex2bn(&bn_n, peer_n) == 0)
+		goto free_bn_n_out;
 
 	pubkey->e = bn_e;
 	pubkey->n = bn_n;
@@ -1251,6 +1293,269 @@ pcrypt_crypt_refer_rsa_key(ipmsg_cap_t cap, RSA **rsa_p) {
 	return rc;
 }
 
+/** OpenSSLのロック獲得/解放コールバック
+ *  @param[in]  mode    CRYPTO_LOCKを含む場合は獲得, それ以外は解放
+ *  @param[in]  n       ロック番号
+ *  @param[in]  file    呼び出し元ファイル名(未使用)
+ *  @param[in]  line    呼び出し元行番号(未使用)
+ *  @attention 内部リンケージ
+ */
+static void
+openssl_locking_callback(int mode, int n, const char *file, int line) {
+
+	g_assert( (n >= 0) && (n < openssl_nr_locks) );
+
+	if (mode & CRYPTO_LOCK)
+		g_mutex_lock(openssl_locks[n]);
+	else
+		g_mutex_unlock(openssl_locks[n]);
+}
+
+/** OpenSSLのスレッド識別子取得コールバック
+ *  @return スレッド識別子
+ *  @attention 内部リンケージ
+ */
+static unsigned long
+openssl_thread_id_callback(void) {
+
+	return (unsigned long)g_thread_self();
+}
+
+/** OpenSSLを複数スレッドから使用するためのロックを設定する.
+ *  @note 自ホストの秘密鍵(RSA)は, 複数のスレッドから同時に使用されるため,
+ *        OpenSSL内部の排他を有効にする.
+ *  @attention 内部リンケージ
+ */
+static void
+setup_openssl_locks(void) {
+	int i;
+
+	if (openssl_locks != NULL)
+		return;
+
+	openssl_nr_locks = CRYPTO_num_locks();
+	openssl_locks = g_new0(GMutex *, openssl_nr_locks);
+	for(i = 0; i < openssl_nr_locks; ++i) 
+		openssl_locks[i] = g_mutex_new();
+
+	CRYPTO_set_id_callback(openssl_thread_id_callback);
+	CRYPTO_set_locking_callback(openssl_locking_callback);
+}
+
+/** OpenSSLを複数スレッドから使用するためのロックを解放する.
+ *  @attention 内部リンケージ
+ */
+static void
+cleanup_openssl_locks(void) {
+	int i;
+
+	if (openssl_locks == NULL)
+		return;
+
+	CRYPTO_set_locking_callback(NULL);
+	CRYPTO_set_id_callback(NULL);
+
+	for(i = 0; i < openssl_nr_locks; ++i) 
+		g_mutex_free(openssl_locks[i]);
+	g_free(openssl_locks);
+	openssl_locks = NULL;
+	openssl_nr_locks = 0;
+}
+
+/** 鍵生成用パスフレーズを破棄する
+ *  @attention 内部リンケージ
+ */
+static void
+release_keygen_passwd(void) {
+
+	if (rsa_keygen_passwd == NULL)
+		return;
+
+	memset(rsa_keygen_passwd, 0xdd, strlen(rsa_keygen_passwd));
+	g_free(rsa_keygen_passwd);
+	rsa_keygen_passwd = NULL;
+}
+
+/** 生成したRSA鍵を登録し, 保存する
+ *  @param[in]  index   鍵種別インデクス
+ *  @param[in]  rc      鍵生成結果
+ *  @param[in]  rsa     生成した鍵
+ *  @param[in]  passwd  鍵保存用パスフレーズ(暗号化しない場合はNULL)
+ *  @retval     0       正常終了
+ *  @retval     負      鍵の生成または登録に失敗した
+ *  @note 鍵の保存に失敗しても, 登録した鍵はそのまま使用する.
+ *  @attention 内部リンケージ
+ */
+static int
+register_generated_key(int index, int rc, RSA *rsa, const gchar *passwd) {
+	size_t keylen = 0;
+
+	pcrypt_get_rsa_key_length(key2ipmsg_key_type[index], &keylen);
+
+	if (rc != 0) {
+		err_out("Can not generate key length:%d\n", (int)keylen);
+		goto error_out;
+	}
+
+	rc = pcrypt_crypt_set_rsa_key(key2ipmsg_key_type[index], rsa);
+	if (rc != 0) {
+		err_out("Can not set key length:%d\n", (int)keylen);
+		RSA_free(rsa);
+		goto error_out;
+	}
+
+	/*
+	 * 生成した鍵を保存する
+	 */
+	if (pcrypt_store_rsa_key(key2ipmsg_key_type[index], passwd) != 0)
+		err_out("Can not store key: length: %d\n", (int)keylen);
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	if (rc != 0)
+		g_atomic_int_inc(&rsa_keygen_failed);
+
+	return rc;
+}
+
+/** 生成したRSA鍵を登録する(UIスレッドのアイドルハンドラ)
+ *  @param[in]  data  未使用
+ *  @retval     FALSE ハンドラの登録を解除する
+ *  @note 全ての鍵がそろった時点で, 暗号化能力を付したIPMSG_ANSENTRYを
+ *        ブロードキャストし, ピアに暗号化能力の更新を通知する.
+ *        生成または登録に失敗した鍵がある場合は通知しない.
+ *  @attention 内部リンケージ
+ */
+static gboolean
+rsa_keygen_drain(gpointer data) {
+	rsa_keygen_job_t *job = NULL;
+
+	if (rsa_keygen_done_queue == NULL)
+		return FALSE;
+
+	while ( (job = g_async_queue_try_pop(rsa_keygen_done_queue)) != NULL ) {
+
+		g_thread_join(job->thread);
+		rsa_keygen_jobs[job->index] = NULL;
+
+		register_generated_key(job->index, job->rc, job->rsa, 
+		    rsa_keygen_passwd);
+		g_slice_free(rsa_keygen_job_t, job);
+
+		if (!g_atomic_int_dec_and_test(&rsa_keygen_pending))
+			continue;
+
+		release_keygen_passwd();
+
+		if (g_atomic_int_get(&rsa_keygen_failed) != 0) {
+			err_out("Some RSA keys are unavailable, "
+			    "encryption is not advertised\n");
+			continue;
+		}
+
+		dbg_out("RSA keys are ready\n");
+		if (udp_con != NULL)
+			ipmsg_send_br_ans_entry(udp_con, 0);
+	}
+
+	return FALSE;
+}
+
+/** RSA鍵を生成する(鍵生成スレッド)
+ *  @param[in]  data  鍵生成要求
+ *  @retval     NULL  常にNULLを返す
+ *  @attention 内部リンケージ
+ */
+static gpointer
+rsa_keygen_thread(gpointer data) {
+	rsa_keygen_job_t *job = (rsa_keygen_job_t *)data;
+
+	job->rc = generate_rsa_key(&job->rsa, key2ipmsg_key_type[job->index]);
+
+	g_async_queue_push(rsa_keygen_done_queue, job);
+	g_idle_add(rsa_keygen_drain, NULL);
+
+	return NULL;
+}
+
+/** RSA鍵の生成をバックグラウンドで開始する
+ *  @param[in]  index   鍵種別インデクス
+ *  @retval     0       正常終了
+ *  @retval    -ENOMEM  メモリ不足
+ *  @retval    -EAGAIN  スレッドを生成できなかった
+ *  @attention 内部リンケージ
+ */
+static int
+start_rsa_keygen(int index) {
+	rsa_keygen_job_t *job = NULL;
+
+	if (rsa_keygen_done_queue == NULL) {
+		rsa_keygen_done_queue = g_async_queue_new();
+		if (rsa_keygen_done_queue == NULL)
+			return -ENOMEM;
+	}
+
+	job = g_slice_new0(rsa_keygen_job_t);
+	if (job == NULL)
+		return -ENOMEM;
+
+	job->index = index;
+	rsa_keygen_jobs[index] = job;
+	g_atomic_int_inc(&rsa_keygen_pending);
+
+	job->thread = g_thread_create(rsa_keygen_thread, job, TRUE, NULL);
+	if (job->thread == NULL) {
+		g_atomic_int_add(&rsa_keygen_pending, -1);
+		rsa_keygen_jobs[index] = NULL;
+		g_slice_free(rsa_keygen_job_t, job);
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+/** RSA鍵の生成を待ち合わせ, 生成した鍵を破棄する
+ *  @attention 内部リンケージ
+ */
+static void
+cleanup_rsa_keygen(void) {
+	int                 i = 0;
+	rsa_keygen_job_t *job = NULL;
+
+	for(i = 0; i < RSA_KEY_MAX; ++i) {
+		if (rsa_keygen_jobs[i] != NULL)
+			g_thread_join(rsa_keygen_jobs[i]->thread);
+	}
+
+	if (rsa_keygen_done_queue != NULL) {
+		while ( (job = g_async_queue_try_pop(rsa_keygen_done_queue)) != NULL ) {
+			if (job->rsa != NULL)
+				RSA_free(job->rsa);
+			rsa_keygen_jobs[job->index] = NULL;
+			g_slice_free(rsa_keygen_job_t, job);
+		}
+		g_async_queue_unref(rsa_keygen_done_queue);
+		rsa_keygen_done_queue = NULL;
+	}
+
+	g_atomic_int_set(&rsa_keygen_pending, 0);
+	g_atomic_int_set(&rsa_keygen_failed, 0);
+	release_keygen_passwd();
+}
+
+/** 自ホストのRSA鍵がそろっているか判定する
+ *  @retval  TRUE   全てのRSA鍵の読み込み/生成が完了している
+ *  @retval  FALSE  RSA鍵を生成中, または生成/登録に失敗した鍵がある
+ *  @note 生成中や鍵がそろわない場合は暗号化能力を通知しない.
+ */
+gboolean
+pcrypt_crypt_keys_ready(void) {
+
+	return ( (g_atomic_int_get(&rsa_keygen_pending) == 0) &&
+	    (g_atomic_int_get(&rsa_keygen_failed) == 0) );
+}
+
 /** RSA鍵を初期化する.
  *  
  *  @retval     0       正常終了
@@ -1260,13 +1565,14 @@ int
 pcrypt_crypt_init_keys(void) {
 	int          rc = 0;
 	int           i = 0;
-	int      keylen = 0;
 	RSA        *rsa = NULL;
 	gchar   *passwd = NULL;
 	size_t pass_len = 0;
 
+	setup_openssl_locks();
 	OpenSSL_add_all_algorithms();
 	ERR_load_crypto_strings();
+	generate_rand_init();
 
 	if (hostinfo_refer_ipmsg_encrypt_public_key()) {
 		rc = ipmsg_pem_passwd_dialog(&passwd);
@@ -1283,31 +1589,29 @@ pcrypt_crypt_init_keys(void) {
 		if (rc == 0)
 			continue; /* 鍵をロードした  */
 		dbg_out("Can not load key:rc=%d\n", rc);
-		rc = generate_rsa_key(&rsa, key2ipmsg_key_type[i]);
-		if (rc != 0) {
-			rc = pcrypt_get_rsa_key_length(key2ipmsg_key_type[i], &keylen);
-			if (rc != 0)
-				err_out("Can not generate key length:%d\n", 
-				    keylen);
-			else
-				err_out("Can not generate key length invalid key index:%d\n", i);
-			rsa_keys[i] = NULL;
+
+		/*
+		 * 鍵長毎にスレッドを生成して並行して鍵を生成し,
+		 * 起動を待たせない. 生成した鍵はUIスレッドで登録/保存する.
+		 */
+		if ( (passwd != NULL) && (rsa_keygen_passwd == NULL) )
+			rsa_keygen_passwd = g_strdup(passwd);
+
+		rc = start_rsa_keygen(i);
+		if (rc == 0)
 			continue;
-		}
 
-		rc = pcrypt_crypt_set_rsa_key(key2ipmsg_key_type[i], rsa);
-		if (rc != 0) {
-			err_out("Can not set key length:%d\n", keylen);
-		} else {
-			/*
-			 * 生成した鍵を保存する
-			 */
-			rc = pcrypt_store_rsa_key(key2ipmsg_key_type[i], passwd);
-			if (rc != 0)
-				err_out("Can not store key: length: %d\n", keylen);
-		}
+		dbg_out("Can not start key generation:rc=%d\n", rc);
+		rc = generate_rsa_key(&rsa, key2ipmsg_key_type[i]);
+		rc = register_generated_key(i, rc, rsa, passwd);
+		if (rc != 0)
+			dbg_out("Can not register key:rc=%d\n", rc);
+		rsa = NULL;
 	}
 
+	if (g_atomic_int_get(&rsa_keygen_pending) == 0)
+		release_keygen_passwd();
+
 passwd_free_out:
 	if (passwd != NULL) {
 		pass_len = strlen(passwd);
@@ -1328,6 +1632,7 @@ pcrypt_crypt_release_keys(void) {
 	int      i = 0;
 	int keylen = 0;
 
+	cleanup_rsa_keygen();
 	ERR_free_strings();
 	for(i = 0; key2ipmsg_key_type[i] >= 0; ++i) {
 		rc = pcrypt_get_rsa_key_length(key2ipmsg_key_type[i], &keylen);
@@ -1340,6 +1645,9 @@ pcrypt_crypt_release_keys(void) {
 		}
 	}
 
+	generate_rand_cleanup();
+	cleanup_openssl_locks();
+
 	return 0;
 }
 
@@ -1362,13 +1670,6 @@ pcrypt_encrypt_message(const ipmsg_cap_t peer_cap, const char *peer_e,
 		       char **ret_buff, ipmsg_cap_t *akey_type){
 	int                 rc = 0;
 	RSA            *pubkey = NULL;
-	BIGNUM *bn_encoded_key = NULL;
-	size_t         enc_len = 0;
-	size_t       crypt_len = 0;
-	char    *encrypted_key = NULL;
-	char      *encoded_key = NULL;
-	ipmsg_cap_t   key_type = 0;
-	char            errbuf[G2IPMSG_CRYPT_EBUFSIZ];
 
 	if ( (peer_e == NULL) || (peer_n == NULL) || 
 	    (plain == NULL) || (ret_buff == NULL) )
@@ -1377,20 +1678,88 @@ pcrypt_encrypt_message(const ipmsg_cap_t peer_cap, const char *peer_e,
 	/*
 	 * hex形式のピアの鍵からRSA鍵情報を生成する
 	 */
-	rc = convert_peer_key(peer_e, peer_n, &pubkey);
+	rc = pcrypt_convert_peer_key(peer_e, peer_n, &pubkey);
 	if (rc != 0)
 		return rc;
 
+	rc = pcrypt_encrypt_message_with_key(peer_cap, pubkey, plain, 
+	    plain_length, ret_buff, akey_type);
+
+	RSA_free(pubkey);
+
+	return rc;
+}
+
+/** バイナリ値(ビッグエンディアン)を電文形式のhex文字列に変換する
+ *  @param[in]   bin           変換するバイナリ値
+ *  @param[in]   len           バイナリ値の長さ(バイト長)
+ *  @param[out]  ret_buff      hex文字列(小文字)の返却領域
+ *  @retval     0              正常終了
+ *  @retval    -ENOMEM         メモリ不足
+ *  @note BN_bn2hexと同じく先頭の0のバイトを出力しないが, 小文字で出力する.
+ *        返却した領域はg_freeで解放する.
+ *  @attention 内部リンケージ
+ */
+static int
+pcrypt_bin2hex(const unsigned char *bin, size_t len, char **ret_buff) {
+	char  *hex = NULL;
+
+	while ( (len > 0) && (*bin == 0) ) {  /*  先頭の0を除去  */
+		++bin;
+		--len;
+	}
+
+	hex = g_malloc(len * 2 + 2);
+	if (hex == NULL)
+		return -ENOMEM;
+
+	if (len == 0)
+		strcpy(hex, "0");
+	else
+		hexcodec_encode(bin, len, hex);
+
+	*ret_buff = hex;
+
+	return 0;
+}
+
+/** 解析済みのピアの公開鍵で電文暗号化に使用する共通鍵を暗号化する
+ *  @param[in]   peer_cap      ピアの公開鍵暗号化能力ID
+ *  @param[in]   pubkey        ピアの公開鍵
+ *  @param[in]   plain         平文(電文暗号化に使用する共通鍵)
+ *  @param[in]   plain_length  平文の長さ(バイト長)
+ *  @param[out]  ret_buff      暗号化電文(hex形式)の返却領域
+ *  @param[out]  akey_type     公開鍵暗号鍵種別を表す暗号化ケイパビリティ
+ *  @retval     0              正常終了
+ *  @retval    -EINVAL         引数異常
+ *  @retval    -ENOMEM         メモリ不足
+ *  @note pubkeyは変更しないため, 複数のスレッドで共有してよい.
+ */
+int
+pcrypt_encrypt_message_with_key(const ipmsg_cap_t peer_cap, RSA *pubkey, 
+    const char *plain, size_t plain_length, char **ret_buff, 
+    ipmsg_cap_t *akey_type){
+	int                 rc = 0;
+	size_t         enc_len = 0;
+	size_t       crypt_len = 0;
+	char    *encrypted_key = NULL;
+	char      *encoded_key = NULL;
+	ipmsg_cap_t   key_type = 0;
+	char            errbuf[G2IPMSG_CRYPT_EBUFSIZ];
+
+	if ( (pubkey == NULL) || (plain == NULL) || (ret_buff == NULL) )
+		return -EINVAL;
+
 	/*
 	 * 電文の暗号化に使用する鍵をピアの公開鍵で暗号化する.
 	 */
 	rc = -ENOMEM;
 	enc_len = RSA_size(pubkey);  /*  暗号化電文長を取得する  */
-	dbg_out("Public key:e=%s n=%s len=%d\n",  peer_e,  peer_n,  enc_len);
+	dbg_out("Public key:len=%d\n", enc_len);
 
 	encrypted_key = g_malloc(enc_len);  /*  暗号化した共通鍵格納領域を確保  */
 	if (encrypted_key == NULL)
-		goto free_pubkey_out;
+		goto no_free_out;
 	
 	rc = RSA_public_encrypt(plain_length, plain, encrypted_key, pubkey, 
 	    RSA_PKCS1_PADDING); /* PKCS1パディングによる暗号化を実施  */
@@ -1413,15 +1782,10 @@ pcrypt_encrypt_message(const ipmsg_cap_t peer_cap, const char *peer_e,
 	/*
 	 * 暗号化した共通鍵をhex形式に変換
 	 */
-	rc = -ENOMEM;
-	bn_encoded_key = BN_bin2bn(encrypted_key, enc_len, NULL); /* エンディアン変換 */
-	if (bn_encoded_key == NULL)
+	rc = pcrypt_bin2hex((const unsigned char *)encrypted_key, enc_len, &encoded_key);
+	if (rc != 0)
 		goto free_encrypted_key_out;
 
-	encoded_key = BN_bn2hex(bn_encoded_key); /* hex形式に変換 */
-	if (encoded_key == NULL)
-		goto free_bn_encoded_key_out;
-
 	/*
 	 * 暗号化した共通鍵と使用した鍵種別を返却
 	 */
@@ -1430,23 +1794,11 @@ pcrypt_encrypt_message(const ipmsg_cap_t peer_cap, const char *peer_e,
 
 	rc = 0;
 
-free_bn_encoded_key_out:
-	if (bn_encoded_key != NULL)
-		BN_free(bn_encoded_key);
-
  free_encrypted_key_out:
 	if (encrypted_key != NULL)
 		g_free(encrypted_key);
 
- free_pubkey_out:
-	if (pubkey != NULL) {
-		BN_free(pubkey->n);
-		BN_free(pubkey->e);
-		pubkey->n = NULL;
-		pubkey->e = NULL;    
-		RSA_free(pubkey);
-	}
-
+ no_free_out:
 	return rc;
 }
 
@@ -1594,10 +1946,8 @@ pcrypt_sign(const ipmsg_cap_t cap, const ipmsg_cap_t sign_type,
 	size_t          digest_len = 0;
 	RSA                   *key = NULL;
 	unsigned char         *out = NULL;
-	BIGNUM            *bn_hash = NULL;
 	unsigned char *hash_string = NULL;
 	void                  *ref = NULL;
-	BIGNUM             *bn_ref = NULL;  
 	char                errbuf[G2IPMSG_CRYPT_EBUFSIZ];
 	unsigned char         hash[MD5SHA1_DIGEST_LEN];
 
@@ -1661,41 +2011,16 @@ pcrypt_sign(const ipmsg_cap_t cap, const ipmsg_cap_t sign_type,
 	if (rc < 0)
 		goto out_free_out;
 
-	/*
-	 * 署名をネットワークバイトオーダに変換
-	 */
-	rc = -ENOMEM;
-	bn_hash = BN_new();
-	if (bn_hash == NULL)
-		goto out_free_out;
-
-	bn_ref = BN_bin2bn(out, out_len, bn_hash); /* bin2bnは, 複製を作らないことに注意 */
-	if (bn_ref == NULL) {
-		rc = ERR_get_error();
-		err_out("Can not convert binary sign to BIGNUM: err=%s\n", 
-		    ERR_error_string(rc, errbuf));
-		rc = -rc;
-		goto bn_hash_free_out;
-	}
-
 	/*
 	 * 署名をhex形式に変換
 	 */
-	hash_string = BN_bn2hex(bn_hash);
-	if (hash_string == NULL) {
-		rc = ERR_get_error();
-		err_out("Can not convert BIGNUM sign to hex: err=%s\n", 
-		    ERR_error_string(rc, errbuf));
-		rc = -rc;		
-		goto bn_hash_free_out;
-	}
+	rc = pcrypt_bin2hex(out, out_len, (char **)&hash_string);
+	if (rc != 0)
+		goto out_free_out;
 
 	rc = 0;
 	*ret_buff = hash_string;  /*  署名を返却  */
 
-bn_hash_free_out:
-	if (bn_hash != NULL)
-		BN_free(bn_hash);  
 out_free_out:
 	if (out != NULL)
 		g_free(out);
@@ -1742,7 +2067,7 @@ pcrypt_verify_sign(const ipmsg_cap_t cap, const ipmsg_cap_t sign_type,
 	/*
 	 * ピアの公開鍵からRSA鍵情報を獲得
 	 */
-	rc = convert_peer_key(peer_e, peer_n, &key);
+	rc = pcrypt_convert_peer_key(peer_e, peer_n, &key);
 	if (rc != 0)
 		return rc;
 
@@ -97,9 +97,12 @@ int pcrypt_crypt_generate_anspubkey_string(ipmsg_cap_t , const char **);
 int pcrypt_crypt_generate_getpubkey_string(ipmsg_cap_t , const char **);
 int pcrypt_crypt_init_keys(void);
 int pcrypt_crypt_release_keys(void);
+gboolean pcrypt_crypt_keys_ready(void);
 int pcrypt_crypt_refer_rsa_key_with_index(int , RSA **);
 int pcrypt_crypt_refer_rsa_key(ipmsg_cap_t , RSA **);
+int pcrypt_convert_peer_key(const char *, const char *, RSA **);
 int pcrypt_encrypt_message(const ipmsg_cap_t , const char *, const char *, const char *, size_t , char **, ipmsg_cap_t *);
+int pcrypt_encrypt_message_with_key(const ipmsg_cap_t , RSA *, const char *, size_t , char **, ipmsg_cap_t *);
 int pcrypt_decrypt_message(ipmsg_cap_t , const char *, char **, size_t *);
 int  pcrypt_sign(const ipmsg_cap_t , const ipmsg_cap_t , const unsigned char *, unsigned char **);
 int pcrypt_verify_sign(const ipmsg_cap_t , const ipmsg_cap_t , const unsigned char *, const unsigned char *, const unsigned char *, const unsigned char *);
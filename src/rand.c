@@ -25,6 +25,39 @@
 
 #include "common.h"
 
+/** スレッド毎の乱数プール
+ */
+typedef struct _rand_pool{
+  unsigned char buf[CRYPT_RND_POOL_SIZE];  /*  生成済みの乱数  */
+  size_t        pos;                       /*  次に払い出す位置  */
+  gint          generation;                /*  生成時の再シード世代  */
+}rand_pool_t;
+
+/** 乱数プール(スレッド毎)
+ * @attention 内部リンケージ
+ */
+static GStaticPrivate rand_pool_key = G_STATIC_PRIVATE_INIT;
+
+/** シード設定排他用mutex
+ * @attention 内部リンケージ
+ */
+static GStaticMutex rand_seed_mutex = G_STATIC_MUTEX_INIT;
+
+/** シード設定済みフラグ
+ * @attention 内部リンケージ
+ */
+static gint rand_seeded = 0;
+
+/** 再シード世代(再シード毎に加算し, 古いプールを破棄させる)
+ * @attention 内部リンケージ
+ */
+static gint rand_generation = 0;
+
+/** 再シード用タイマのソースID
+ * @attention 内部リンケージ
+ */
+static guint rand_reseed_tag = 0;
+
 static int
 check_random_seed(void){
   int rc;
@@ -47,22 +80,61 @@ check_random_seed(void){
   return rc;
 }
 
-int 
-add_timing_entropy(void) {
-  /*  FIXME add implementation */
+/** 乱数生成器のシードを設定する(初回のみ)
+ *  @note シードを設定できない場合は続行できないため異常終了する.
+ *  @attention 内部リンケージ
+ */
+static void
+ensure_random_seed(void){
+
+  if (g_atomic_int_get(&rand_seeded))
+    return;
+
+  g_static_mutex_lock(&rand_seed_mutex);
+  if (!g_atomic_int_get(&rand_seeded)) {
+    if (check_random_seed()) {
+      err_out("Can not seed random\n");
+      g_assert_not_reached();
+    }
+    g_atomic_int_set(&rand_seeded, 1);
+  }
+  g_static_mutex_unlock(&rand_seed_mutex);
 }
 
-int
-generate_rand(unsigned char *buf,size_t len){
+/** 乱数生成器に再シードする(タイマハンドラ)
+ *  @param[in]  data  未使用
+ *  @retval     TRUE  タイマを継続する
+ *  @note エントロピー収集はメッセージ送信経路では行わず, ここで
+ *        定期的に行う. 各スレッドのプールは次回の払い出し時に
+ *        再生成する.
+ *  @attention 内部リンケージ
+ */
+static gboolean
+reseed_random(gpointer data){
+
+  g_static_mutex_lock(&rand_seed_mutex);
+  if (check_random_seed())
+    war_out("Can not reseed random\n");
+  else
+    g_atomic_int_inc(&rand_generation);
+  g_static_mutex_unlock(&rand_seed_mutex);
+
+  return TRUE;
+}
+
+/** 乱数を生成する(プールを経由しない)
+ *  @param[out] buf   乱数格納先
+ *  @param[in]  len   生成する長さ
+ *  @retval     0       正常終了
+ *  @retval    -EAGAIN  乱数を生成できなかった
+ *  @attention 内部リンケージ
+ */
+static int
+fill_rand_bytes(unsigned char *buf,size_t len){
   int      rc = -EAGAIN;
   int rand_ok = 0;
   int   retry = CRYPT_RND_MAX_RETRY;
 
-  if (check_random_seed()) {
-    err_out("Can not seed random\n");
-    g_assert_not_reached();
-  }
-
   do{
     memset(buf,0,len);    
     rand_ok = RAND_bytes(buf,len);
@@ -74,3 +146,114 @@ generate_rand(unsigned char *buf,size_t len){
 
   return rc;
 }
+
+/** 乱数プールを解放する
+ *  @param[in]  data  乱数プール
+ *  @attention 内部リンケージ
+ */
+static void
+release_rand_pool(gpointer data){
+  rand_pool_t *pool = (rand_pool_t *)data;
+
+  if (pool == NULL)
+    return;
+
+  OPENSSL_cleanse(pool, sizeof(rand_pool_t));
+  g_slice_free(rand_pool_t, pool);
+}
+
+/** 呼び出したスレッドの乱数プールを参照する
+ *  @retval  乱数プール(メモリ不足の場合はNULL)
+ *  @note 初回は空のプールを獲得する.
+ *  @attention 内部リンケージ
+ */
+static rand_pool_t *
+refer_rand_pool(void){
+  rand_pool_t *pool;
+
+  pool = g_static_private_get(&rand_pool_key);
+  if (pool != NULL)
+    return pool;
+
+  pool = g_slice_new(rand_pool_t);
+  if (pool == NULL)
+    return NULL;
+
+  pool->pos = CRYPT_RND_POOL_SIZE;  /*  空  */
+  pool->generation = -1;
+  g_static_private_set(&rand_pool_key, pool, release_rand_pool);
+
+  return pool;
+}
+
+/** 乱数生成機構を初期化する
+ *  @retval     0       正常終了
+ *  @note シードを設定し, 定期的な再シードを開始する. UIスレッドから呼び出す.
+ */
+int
+generate_rand_init(void){
+
+  ensure_random_seed();
+
+  if (rand_reseed_tag == 0)
+    rand_reseed_tag = g_timeout_add(CRYPT_RND_RESEED_INTERVAL_MS, 
+				    reseed_random, NULL);
+
+  return 0;
+}
+
+/** 乱数生成機構を解放する
+ *  @note 定期的な再シードを停止する. 各スレッドのプールはスレッド終了時に
+ *        破棄される.
+ */
+void
+generate_rand_cleanup(void){
+
+  if (rand_reseed_tag != 0) {
+    g_source_remove(rand_reseed_tag);
+    rand_reseed_tag = 0;
+  }
+}
+
+/** 乱数を生成する
+ *  @param[out] buf   乱数格納先
+ *  @param[in]  len   生成する長さ
+ *  @retval     0       正常終了
+ *  @retval    -EAGAIN  乱数を生成できなかった
+ *  @note 短い要求はスレッド毎のプールから払い出し, プールが尽きた場合に
+ *        まとめて再生成する. 払い出した領域はプールから消去する.
+ */
+int
+generate_rand(unsigned char *buf,size_t len){
+  int             rc = 0;
+  gint    generation = 0;
+  rand_pool_t  *pool = NULL;
+
+  ensure_random_seed();
+
+  if (len > CRYPT_RND_DIRECT_LEN)
+    return fill_rand_bytes(buf, len);
+
+  pool = refer_rand_pool();
+  if (pool == NULL)
+    return fill_rand_bytes(buf, len);
+
+  generation = g_atomic_int_get(&rand_generation);
+  if ( (pool->generation != generation) || 
+       ( (CRYPT_RND_POOL_SIZE - pool->pos) < len ) ) {
+
+    rc = fill_rand_bytes(pool->buf, CRYPT_RND_POOL_SIZE);
+    if (rc != 0) {
+      pool->pos = CRYPT_RND_POOL_SIZE;
+      return rc;
+    }
+    pool->pos = 0;
+    pool->generation = generation;
+  }
+
+  memcpy(buf, &pool->buf[pool->pos], len);
+  OPENSSL_cleanse(&pool->buf[pool->pos], len);
+  pool->pos += len;
+
+  return 0;
+}
@@ -0,0 +1,485 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+/** @file 
+ * @brief  受信した暗号化メッセージの復号処理関数群
+ * @author Takeharu KATO
+ */ 
+
+/** 復号要求
+ */
+typedef struct _ipmsg_recvcrypt_job{
+	const udp_con_t  *con;  /*  受信したコネクション  */
+	msg_data_t        msg;  /*  受信メッセージ情報の複製  */
+	char             *key;  /*  処理中メッセージの識別子  */
+	int                rc;  /*  復号結果  */
+}ipmsg_recvcrypt_job_t;
+
+/** 復号スレッドプール
+ * @attention 内部リンケージ
+ */
+static GThreadPool *recvcrypt_pool = NULL;
+
+/** 復号済みメッセージキュー
+ * @attention 内部リンケージ
+ */
+static GAsyncQueue *recvcrypt_done_queue = NULL;
+
+/** 処理中メッセージ(送信元アドレス:パケット番号)
+ * @attention 内部リンケージ
+ */
+static GHashTable *recvcrypt_pending = NULL;
+
+/** 処理中メッセージ排他用mutex
+ * @attention 内部リンケージ
+ */
+static GStaticMutex recvcrypt_mutex = G_STATIC_MUTEX_INIT;
+
+/** 完了処理用ハンドラ登録済み(受信スレッドへ通知済み)フラグ
+ * @attention 内部リンケージ
+ */
+static gint recvcrypt_drain_scheduled = 0;
+
+/** 受信スレッドへの完了通知用パイプ([0]:読み出し側, [1]:書き込み側)
+ * @note 受信スレッドを使用しない場合は-1.
+ * @attention 内部リンケージ
+ */
+static int recvcrypt_wakeup_fds[2] = {-1, -1};
+
+/** 復号待ち/処理中のメッセージ数
+ * @attention 内部リンケージ
+ */
+static gint recvcrypt_depth = 0;
+
+/** 復号待ち/処理中のメッセージ数の最大値
+ * @attention 内部リンケージ
+ */
+static gint recvcrypt_depth_max = 0;
+
+/** 上限超過により受け付けなかったメッセージ数
+ * @attention 内部リンケージ
+ */
+static gint recvcrypt_rejected = 0;
+
+/** 復号要求を解放する
+ *  @param[in]  job  復号要求
+ *  @attention 内部リンケージ
+ */
+static void
+recvcrypt_job_free(ipmsg_recvcrypt_job_t *job) {
+
+	if (job == NULL)
+		return;
+
+	release_message_data(&job->msg);
+	if (job->key != NULL)
+		g_free(job->key);
+
+	g_slice_free(ipmsg_recvcrypt_job_t, job);
+}
+
+/** 処理中メッセージの登録を解除する
+ *  @param[in]  job  復号要求
+ *  @attention 内部リンケージ
+ */
+static void
+recvcrypt_job_done(ipmsg_recvcrypt_job_t *job) {
+
+	g_static_mutex_lock(&recvcrypt_mutex);
+	if (recvcrypt_pending != NULL)
+		g_hash_table_remove(recvcrypt_pending, job->key);
+	g_static_mutex_unlock(&recvcrypt_mutex);
+
+	g_atomic_int_add(&recvcrypt_depth, -1);
+}
+
+/** 復号済みメッセージを配送する
+ *  @note 平文のメッセージと同じスレッド(受信スレッドを使用する場合は
+ *        受信スレッド, それ以外はUIスレッド)から呼び出す.
+ *  @attention 内部リンケージ
+ */
+static void
+recvcrypt_dispatch_done(void) {
+	ipmsg_recvcrypt_job_t      *job = NULL;
+
+	/*
+	 * 取り出し前にフラグを落とし, 処理中に完了した要求に対して
+	 * 再度通知されるようにする.
+	 */
+	g_atomic_int_set(&recvcrypt_drain_scheduled, 0);
+
+	while ( (job = g_async_queue_try_pop(recvcrypt_done_queue)) != NULL ) {
+
+		if (job->rc == 0)
+			ipmsg_dispatch_message(job->con, &job->msg);
+		else
+			dbg_out("Can not decrypt message from %s:%d (%d)\n",
+			    refer_peer_addr_from_msg(&job->msg), 
+			    job->msg.pkt_seq_no, job->rc);
+		/*
+		 * 受信確認済みの記録が登録されてから処理中の登録を解除し,
+		 * 復号中に届いた再送を二重に処理しないようにする.
+		 */
+		recvcrypt_job_done(job);
+		recvcrypt_job_free(job);
+	}
+}
+
+/** 復号済みメッセージを処理する(UIスレッドのタイマ/アイドルハンドラ)
+ *  @param[in]  data  未使用
+ *  @retval     FALSE ハンドラの登録を解除する
+ *  @note 受信スレッドを使用しない場合に, 受信処理と同じく
+ *        UIスレッドからメッセージを配送する.
+ *  @attention 内部リンケージ
+ */
+static gboolean
+recvcrypt_drain(gpointer data) {
+	static gboolean        in_drain = FALSE;
+
+	if (recvcrypt_done_queue == NULL)
+		return FALSE;
+
+	/*
+	 * ダイアログ表示などの入れ子のメインループから呼ばれた場合は,
+	 * 外側の処理が終わってから再試行する.
+	 */
+	if (in_drain) {
+		g_timeout_add(IPMSG_RECVCRYPT_RETRY_MS, recvcrypt_drain, NULL);
+		return FALSE;
+	}
+
+	in_drain = TRUE;
+	recvcrypt_dispatch_done();
+	in_drain = FALSE;
+
+	return FALSE;
+}
+
+/** メッセージを復号する(復号スレッド)
+ *  @param[in]  data       復号要求
+ *  @param[in]  user_data  未使用
+ *  @attention 内部リンケージ
+ */
+static void
+recvcrypt_worker(gpointer data, gpointer user_data) {
+	ipmsg_recvcrypt_job_t *job = (ipmsg_recvcrypt_job_t *)data;
+
+	job->rc = decrypt_message_data(refer_peer_addr_from_msg(&job->msg),
+	    &job->msg);
+
+	g_async_queue_push(recvcrypt_done_queue, job);
+
+	if (!g_atomic_int_compare_and_exchange(&recvcrypt_drain_scheduled, 0, 1))
+		return;  /*  通知済み  */
+
+	if (recvcrypt_wakeup_fds[1] >= 0) {
+		/*
+		 * 受信スレッドを起床させる(パイプが満杯の場合は通知済み)
+		 */
+		while ( (write(recvcrypt_wakeup_fds[1], "", 1) < 0) && 
+		    (errno == EINTR) )
+			;
+	} else
+		g_idle_add(recvcrypt_drain, NULL);
+}
+
+/** 受信メッセージ復号機構を初期化する
+ *  @retval     0       正常終了
+ *  @retval    -ENOMEM  メモリ不足
+ *  @note UIスレッドから呼び出す.
+ */
+int
+ipmsg_recvcrypt_init(void) {
+	int rc = 0;
+
+	if (recvcrypt_pool != NULL)
+		return 0;
+
+	recvcrypt_done_queue = g_async_queue_new();
+	if (recvcrypt_done_queue == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+
+	g_static_mutex_lock(&recvcrypt_mutex);
+	recvcrypt_pending = g_hash_table_new_full(g_str_hash, g_str_equal, 
+	    g_free, NULL);
+	g_static_mutex_unlock(&recvcrypt_mutex);
+	if (recvcrypt_pending == NULL) {
+		rc = -ENOMEM;
+		goto free_queue_out;
+	}
+
+	recvcrypt_pool = g_thread_pool_new(recvcrypt_worker, NULL, 
+	    IPMSG_RECVCRYPT_WORKERS, FALSE, NULL);
+	if (recvcrypt_pool == NULL) {
+		rc = -ENOMEM;
+		goto free_table_out;
+	}
+
+	g_atomic_int_set(&recvcrypt_depth, 0);
+	g_atomic_int_set(&recvcrypt_depth_max, 0);
+	g_atomic_int_set(&recvcrypt_rejected, 0);
+
+	return 0;
+
+free_table_out:
+	g_static_mutex_lock(&recvcrypt_mutex);
+	g_hash_table_destroy(recvcrypt_pending);
+	recvcrypt_pending = NULL;
+	g_static_mutex_unlock(&recvcrypt_mutex);
+
+free_queue_out:
+	g_async_queue_unref(recvcrypt_done_queue);
+	recvcrypt_done_queue = NULL;
+
+error_out:
+	return rc;
+}
+
+/** 受信メッセージ復号機構を解放する
+ *  @note 処理中の復号の完了を待ち合わせ, 復号済みのメッセージは
+ *        配送せずに破棄する. 受信処理の停止後にUIスレッドから呼び出す.
+ */
+void
+ipmsg_recvcrypt_cleanup(void) {
+	ipmsg_recvcrypt_job_t *job = NULL;
+
+	if (recvcrypt_pool == NULL)
+		return;
+
+	g_thread_pool_free(recvcrypt_pool, FALSE, TRUE);
+	recvcrypt_pool = NULL;
+
+	while ( (job = g_async_queue_try_pop(recvcrypt_done_queue)) != NULL ) {
+		recvcrypt_job_done(job);
+		recvcrypt_job_free(job);
+	}
+
+	g_static_mutex_lock(&recvcrypt_mutex);
+	g_hash_table_destroy(recvcrypt_pending);
+	recvcrypt_pending = NULL;
+	g_static_mutex_unlock(&recvcrypt_mutex);
+
+	g_async_queue_unref(recvcrypt_done_queue);
+	recvcrypt_done_queue = NULL;
+
+	ipmsg_recvcrypt_disable_poll();
+
+	dbg_out("recvcrypt stat: depth-max:%d rejected:%d\n",
+	    g_atomic_int_get(&recvcrypt_depth_max),
+	    g_atomic_int_get(&recvcrypt_rejected));
+}
+
+/** 暗号化された受信メッセージの復号を復号スレッドへ依頼する
+ *  @param[in]  con      受信したコネクション
+ *  @param[in]  msg      parse_message_buffer_deferredで解析したメッセージ情報
+ *  @retval     0        正常終了
+ *  @retval    -EINVAL   引数異常
+ *  @retval    -ENOENT   受信メッセージ復号機構が初期化されていない
+ *  @retval    -EEXIST   同じメッセージを復号中
+ *  @retval    -EAGAIN   復号待ちのメッセージ数が上限に達している
+ *  @retval    -ENOMEM   メモリ不足
+ *  @note msgは複製するため, 呼び出し元で解放する.
+ *        復号後のメッセージは, 受信スレッドを使用する場合は
+ *        ipmsg_recvcrypt_pollの呼び出し元で, それ以外はUIスレッドで
+ *        ipmsg_dispatch_messageに渡す.
+ */
+int
+ipmsg_recvcrypt_submit(const udp_con_t *con, const msg_data_t *msg) {
+	int                       rc = 0;
+	gint                   depth = 0;
+	gint                     max = 0;
+	char                    *key = NULL;
+	ipmsg_recvcrypt_job_t   *job = NULL;
+
+	if ( (con == NULL) || (msg == NULL) ) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	if (recvcrypt_pool == NULL) {
+		rc = -ENOENT;
+		goto error_out;
+	}
+
+	key = g_strdup_printf("%s:%d", refer_peer_addr_from_msg(msg), 
+	    msg->pkt_seq_no);
+	if (key == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+
+	g_static_mutex_lock(&recvcrypt_mutex);
+	if (g_hash_table_lookup(recvcrypt_pending, key) != NULL) {
+		g_static_mutex_unlock(&recvcrypt_mutex);
+		rc = -EEXIST;
+		goto free_key_out;
+	}
+	if (g_atomic_int_get(&recvcrypt_depth) >= IPMSG_RECVCRYPT_QUEUE_MAX) {
+		g_static_mutex_unlock(&recvcrypt_mutex);
+		g_atomic_int_inc(&recvcrypt_rejected);
+		rc = -EAGAIN;
+		goto free_key_out;
+	}
+	g_hash_table_insert(recvcrypt_pending, g_strdup(key), (gpointer)con);
+	depth = g_atomic_int_exchange_and_add(&recvcrypt_depth, 1) + 1;
+	g_static_mutex_unlock(&recvcrypt_mutex);
+
+	do {
+		max = g_atomic_int_get(&recvcrypt_depth_max);
+	} while ( (depth > max) && 
+	    (!g_atomic_int_compare_and_exchange(&recvcrypt_depth_max, 
+		max, depth)) );
+
+	job = g_slice_new0(ipmsg_recvcrypt_job_t);
+	if (job == NULL) {
+		rc = -ENOMEM;
+		goto cancel_out;
+	}
+
+	job->con = con;
+	job->key = key;
+	key = NULL;
+	init_message_data(&job->msg);
+	rc = copy_message_data(&job->msg, msg);
+	if (rc != 0)
+		goto cancel_out;
+
+	g_thread_pool_push(recvcrypt_pool, job, NULL);
+
+	return 0;
+
+cancel_out:
+	if (job != NULL) {
+		recvcrypt_job_done(job);
+		recvcrypt_job_free(job);
+	} else {
+		g_static_mutex_lock(&recvcrypt_mutex);
+		g_hash_table_remove(recvcrypt_pending, key);
+		g_static_mutex_unlock(&recvcrypt_mutex);
+		g_atomic_int_add(&recvcrypt_depth, -1);
+	}
+
+free_key_out:
+	if (key != NULL)
+		g_free(key);
+
+error_out:
+	return rc;
+}
+
+/** 復号待ち/処理中のメッセージ数を参照する
+ *  @retval  復号待ち/処理中のメッセージ数
+ */
+gint
+ipmsg_recvcrypt_refer_queue_depth(void) {
+
+	return g_atomic_int_get(&recvcrypt_depth);
+}
+
+/** 復号済みメッセージを受信スレッドから配送するよう設定する
+ *  @param[out] fdp      完了通知を受け取るファイル記述子の返却領域
+ *  @retval     0        正常終了
+ *  @retval    -EINVAL   引数異常
+ *  @retval    -ENOENT   受信メッセージ復号機構が初期化されていない
+ *  @retval    負の値    パイプの生成に失敗した(-errno)
+ *  @note 受信スレッドの生成前にUIスレッドから呼び出す.
+ *        *fdpが読み出し可能になったら受信スレッドから
+ *        ipmsg_recvcrypt_pollを呼び出す.
+ */
+int
+ipmsg_recvcrypt_enable_poll(int *fdp) {
+	int rc = 0;
+	int  i = 0;
+
+	if (fdp == NULL) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	if (recvcrypt_pool == NULL) {
+		rc = -ENOENT;
+		goto error_out;
+	}
+
+	if (recvcrypt_wakeup_fds[0] < 0) {
+		rc = pipe(recvcrypt_wakeup_fds);
+		if (rc < 0) {
+			rc = -errno;
+			recvcrypt_wakeup_fds[0] = recvcrypt_wakeup_fds[1] = -1;
+			goto error_out;
+		}
+		for(i = 0; i < 2; ++i)
+			fcntl(recvcrypt_wakeup_fds[i], F_SETFL, 
+			    fcntl(recvcrypt_wakeup_fds[i], F_GETFL) | O_NONBLOCK);
+	}
+
+	*fdp = recvcrypt_wakeup_fds[0];
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	return rc;
+}
+
+/** 復号済みメッセージをUIスレッドから配送するよう設定を戻す
+ *  @note 受信スレッドの生成に失敗した場合, または, 受信スレッドの
+ *        終了後にUIスレッドから呼び出す.
+ */
+void
+ipmsg_recvcrypt_disable_poll(void) {
+
+	if (recvcrypt_wakeup_fds[0] < 0)
+		return;
+
+	close(recvcrypt_wakeup_fds[0]);
+	close(recvcrypt_wakeup_fds[1]);
+	recvcrypt_wakeup_fds[0] = recvcrypt_wakeup_fds[1] = -1;
+}
+
+/** 受信スレッドから復号済みメッセージを配送する
+ *  @note ipmsg_recvcrypt_enable_pollで設定した場合に, 受信スレッドから
+ *        呼び出す. 平文のメッセージと同じスレッドで配送される.
+ */
+void
+ipmsg_recvcrypt_poll(void) {
+	char  buf[64];
+	ssize_t   len = 0;
+
+	if ( (recvcrypt_done_queue == NULL) || (recvcrypt_wakeup_fds[0] < 0) )
+		return;
+
+	/*
+	 * 通知を読み捨てる
+	 */
+	do {
+		len = read(recvcrypt_wakeup_fds[0], buf, sizeof(buf));
+	} while ( (len > 0) || ( (len < 0) && (errno == EINTR) ) );
+
+	recvcrypt_dispatch_done();
+}
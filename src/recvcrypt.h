@@ -0,0 +1,40 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if !defined(G2IPMSG_RECVCRYPT_H)
+#define G2IPMSG_RECVCRYPT_H
+
+#define IPMSG_RECVCRYPT_WORKERS        (2)   /*  復号スレッド数  */
+#define IPMSG_RECVCRYPT_QUEUE_MAX      (64)  /*  復号待ちメッセージ数の上限  */
+#define IPMSG_RECVCRYPT_RETRY_MS       (100) /*  完了処理の再試行間隔(ms)  */
+
+int ipmsg_recvcrypt_init(void);
+void ipmsg_recvcrypt_cleanup(void);
+int ipmsg_recvcrypt_submit(const udp_con_t *con, const msg_data_t *msg);
+gint ipmsg_recvcrypt_refer_queue_depth(void);
+int ipmsg_recvcrypt_enable_poll(int *fdp);
+void ipmsg_recvcrypt_disable_poll(void);
+void ipmsg_recvcrypt_poll(void);
+#endif /*  G2IPMSG_RECVCRYPT_H  */
@@ -0,0 +1,465 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "common.h"
+
+/** @file 
+ * @brief  デバッグ出力のトレースリング
+ * @author Takeharu KATO
+ */ 
+
+#define IPMSG_TRACE_STATE_INIT    (0)  /* 書き出しスレッド起動前  */
+#define IPMSG_TRACE_STATE_RUNNING (1)  /* 書き出しスレッド動作中  */
+#define IPMSG_TRACE_STATE_STOPPED (2)  /* 終了処理後(直接出力する)  */
+
+/** トレース記録
+ */
+typedef struct _trace_record{
+	int          level;  /*  出力レベル  */
+	GTimeVal        tv;  /*  記録時刻  */
+	char text[IPMSG_TRACE_MSG_LEN]; /*  出力文字列  */
+}trace_record_t;
+
+/** リング内の記録領域
+ */
+typedef struct _trace_slot{
+	volatile gint  seq;  /*  格納済み記録の通番+1(0は書き込み中/未使用)  */
+	trace_record_t rec;  /*  記録  */
+}trace_slot_t;
+
+/** スレッド毎のトレースリング
+ *  @note 書き込みは所有スレッドのみ, 読み出しは書き出しスレッドのみが行う.
+ */
+typedef struct _trace_ring{
+	volatile gint head;  /*  次に書き込む記録の通番(所有スレッドが更新)  */
+	guint      flushed;  /*  書き出し済み記録の通番(書き出しスレッドが更新)  */
+	guint         lost;  /*  上書きにより失われた記録数  */
+	volatile gint dead;  /*  所有スレッドが終了した  */
+	gpointer     owner;  /*  所有スレッド(表示用)  */
+	trace_slot_t slots[IPMSG_TRACE_RING_SIZE];  /*  記録領域  */
+}trace_ring_t;
+
+/** 現在の出力レベル
+ */
+volatile gint ipmsg_log_level = IPMSG_LOG_ERR;
+
+/** リングに記録するのみで出力しない
+ * @attention 内部リンケージ
+ */
+static volatile gint trace_only = 0;
+
+/** トレース機構の状態
+ * @attention 内部リンケージ
+ */
+static volatile gint trace_state = IPMSG_TRACE_STATE_INIT;
+
+/** 書き出しスレッド停止要求
+ * @attention 内部リンケージ
+ */
+static volatile gint flush_thread_stop = 0;
+
+/** 書き出しスレッド
+ * @attention 内部リンケージ
+ */
+static GThread *flush_thread = NULL;
+
+/** リングの内容表示要求(シグナルハンドラから設定する)
+ * @attention 内部リンケージ
+ */
+static volatile sig_atomic_t dump_requested = 0;
+
+/** 登録済みリングのリスト
+ * @attention 内部リンケージ
+ */
+static GSList *rings = NULL;
+
+/** リングリスト排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex rings_mutex = G_STATIC_MUTEX_INIT;
+
+/** スレッド毎のリング
+ * @attention 内部リンケージ
+ */
+static GStaticPrivate thread_ring = G_STATIC_PRIVATE_INIT;
+
+/** スレッド終了時にリングを回収対象にする
+ *  @param[in]  data  トレースリング
+ *  @attention 内部リンケージ
+ */
+static void
+mark_ring_dead(gpointer data) {
+	trace_ring_t *ring = (trace_ring_t *)data;
+
+	if (ring != NULL)
+		g_atomic_int_set(&ring->dead, 1);
+}
+
+/** 呼び出し元スレッドのリングを参照する(初回は割り当てる)
+ *  @return     トレースリング(割り当てに失敗した場合はNULL)
+ *  @attention 内部リンケージ
+ */
+static trace_ring_t *
+refer_thread_ring(void) {
+	trace_ring_t *ring;
+
+	ring = g_static_private_get(&thread_ring);
+	if (ring != NULL)
+		return ring;
+
+	ring = g_try_new0(trace_ring_t, 1);
+	if (ring == NULL)
+		return NULL;
+
+	ring->owner = g_thread_self();
+
+	g_static_mutex_lock(&rings_mutex);
+	rings = g_slist_prepend(rings, ring);
+	g_static_mutex_unlock(&rings_mutex);
+
+	g_static_private_set(&thread_ring, ring, mark_ring_dead);
+
+	return ring;
+}
+
+/** トレース記録を作成する
+ *  @param[out] rec    トレース記録
+ *  @param[in]  level  出力レベル
+ *  @param[in]  file   ファイル名
+ *  @param[in]  func   関数名
+ *  @param[in]  line   行番号
+ *  @param[in]  fmt    書式
+ *  @param[in]  ap     可変長引数
+ *  @attention 内部リンケージ
+ */
+static void
+fill_record(trace_record_t *rec, int level, const char *file, const char *func,
+	    int line, const char *fmt, va_list ap) {
+	int len;
+
+	rec->level = level;
+	g_get_current_time(&rec->tv);
+
+	len = snprintf(rec->text, sizeof(rec->text),
+	    "[file:%s function: %s line:%d ] ", file, func, line);
+	if ( (len < 0) || (len >= (int)sizeof(rec->text)) )
+		len = sizeof(rec->text) - 1;
+
+	vsnprintf(rec->text + len, sizeof(rec->text) - len, fmt, ap);
+}
+
+/** トレース記録を標準エラー出力とsyslogに出力する
+ *  @param[in]  rec    トレース記録
+ *  @note エラーは呼び出し箇所で標準エラー出力に出力済みのためsyslogにのみ出力する.
+ *  @attention 内部リンケージ
+ */
+static void
+output_record(const trace_record_t *rec) {
+
+	switch(rec->level) {
+	case IPMSG_LOG_ERR:
+		syslog(LOG_ERR|LOG_USER, "%s", rec->text);
+		break;
+	case IPMSG_LOG_WARN:
+		fprintf(stderr, "Warning : %s", rec->text);
+		syslog(LOG_WARNING|LOG_USER, "%s", rec->text);
+		break;
+	default:
+		fputs(rec->text, stderr);
+		syslog(LOG_INFO|LOG_USER, "%s", rec->text);
+		break;
+	}
+}
+
+/** リングから記録を読み出す
+ *  @param[in]  ring  トレースリング
+ *  @param[in]  seq   記録の通番
+ *  @param[out] rec   読み出した記録の格納先
+ *  @retval     TRUE  読み出した
+ *  @retval     FALSE 既に上書きされた(あるいは書き込み中)
+ *  @attention 内部リンケージ
+ */
+static gboolean
+read_record(trace_ring_t *ring, guint seq, trace_record_t *rec) {
+	trace_slot_t *slot;
+
+	slot = &ring->slots[seq & (IPMSG_TRACE_RING_SIZE - 1)];
+
+	if ((guint)g_atomic_int_get(&slot->seq) != seq + 1)
+		return FALSE;
+
+	memcpy(rec, &slot->rec, sizeof(trace_record_t));
+
+	/* 複写中に上書きされていないことを確認する  */
+	if ((guint)g_atomic_int_get(&slot->seq) != seq + 1)
+		return FALSE;
+
+	rec->text[sizeof(rec->text) - 1] = '\0';
+
+	return TRUE;
+}
+
+/** リングに溜まった未出力の記録を書き出す
+ *  @param[in]  ring  トレースリング
+ *  @note rings_mutexを獲得して呼び出すこと.
+ *  @attention 内部リンケージ
+ */
+static void
+flush_ring(trace_ring_t *ring) {
+	trace_record_t rec;
+	guint head;
+	guint seq;
+
+	head = (guint)g_atomic_int_get(&ring->head);
+
+	if ( (head - ring->flushed) > IPMSG_TRACE_RING_SIZE ) {
+		ring->lost += head - ring->flushed - IPMSG_TRACE_RING_SIZE;
+		ring->flushed = head - IPMSG_TRACE_RING_SIZE;
+	}
+
+	for(seq = ring->flushed; seq != head; ++seq) {
+		if (read_record(ring, seq, &rec)) {
+			if (!g_atomic_int_get(&trace_only))
+				output_record(&rec);
+		} else
+			++ring->lost;
+	}
+	ring->flushed = head;
+
+	if ( (ring->lost > 0) && (!g_atomic_int_get(&trace_only)) ) {
+		fprintf(stderr, "trace: %u records dropped on thread %p\n", 
+		    ring->lost, ring->owner);
+		ring->lost = 0;
+	}
+}
+
+/** 全リングの未出力の記録を書き出し, 終了したスレッドのリングを解放する
+ *  @attention 内部リンケージ
+ */
+static void
+flush_rings(void) {
+	GSList *node;
+	GSList *next;
+	trace_ring_t *ring;
+
+	g_static_mutex_lock(&rings_mutex);
+	for(node = rings; node != NULL; node = next) {
+		next = g_slist_next(node);
+		ring = (trace_ring_t *)node->data;
+		flush_ring(ring);
+		if (g_atomic_int_get(&ring->dead)) {
+			rings = g_slist_delete_link(rings, node);
+			g_free(ring);
+		}
+	}
+	g_static_mutex_unlock(&rings_mutex);
+
+	fflush(stderr);
+}
+
+/** 書き出しスレッド
+ *  @param[in]  data  未使用
+ *  @return     NULL
+ *  @attention 内部リンケージ
+ */
+static gpointer
+trace_flush_thread(gpointer data) {
+
+	while(!g_atomic_int_get(&flush_thread_stop)) {
+		g_usleep(IPMSG_TRACE_FLUSH_INTERVAL_MS * 1000);
+		if (dump_requested) {
+			dump_requested = 0;
+			ipmsg_trace_dump(stderr);
+		}
+		flush_rings();
+	}
+
+	return NULL;
+}
+
+/** SIGUSR1受信時にリングの内容表示を要求する
+ *  @param[in]  signo  シグナル番号(未使用)
+ *  @attention 内部リンケージ
+ */
+static void
+trace_dump_signal_handler(int signo) {
+
+	dump_requested = 1;
+}
+
+/** 出力レベルを設定する
+ *  @param[in]  level       出力レベル
+ *  @param[in]  record_only 真の場合はリングに記録するのみで出力しない
+ */
+void
+ipmsg_trace_set_level(int level, gboolean record_only) {
+
+	g_atomic_int_set(&trace_only, (record_only) ? (1) : (0));
+	g_atomic_int_set(&ipmsg_log_level, level);
+}
+
+/** トレース記録を呼び出し元スレッドのリングに格納する
+ *  @param[in]  level  出力レベル
+ *  @param[in]  file   ファイル名
+ *  @param[in]  func   関数名
+ *  @param[in]  line   行番号
+ *  @param[in]  fmt    書式
+ *  @note 呼び出し元はipmsg_log_enabled()で出力レベルを判定済みであること.
+ *        リングが一杯の場合は最も古い記録を上書きする(待ち合わせない).
+ */
+void
+ipmsg_trace_out(int level, const char *file, const char *func, int line,
+		const char *fmt, ...) {
+	va_list ap;
+	trace_ring_t *ring = NULL;
+	trace_slot_t *slot;
+	trace_record_t rec;
+	guint seq;
+
+	if (g_atomic_int_get(&trace_state) != IPMSG_TRACE_STATE_STOPPED)
+		ring = refer_thread_ring();
+
+	if (ring == NULL) {
+		/* 終了処理後やリングを割り当てられない場合は直接出力する  */
+		va_start(ap, fmt);
+		fill_record(&rec, level, file, func, line, fmt, ap);
+		va_end(ap);
+		output_record(&rec);
+		fflush(stderr);
+		return;
+	}
+
+	seq = (guint)ring->head;
+	slot = &ring->slots[seq & (IPMSG_TRACE_RING_SIZE - 1)];
+
+	g_atomic_int_set(&slot->seq, 0);
+
+	va_start(ap, fmt);
+	fill_record(&slot->rec, level, file, func, line, fmt, ap);
+	va_end(ap);
+
+	g_atomic_int_set(&slot->seq, (gint)(seq + 1));
+	g_atomic_int_set(&ring->head, (gint)(seq + 1));
+}
+
+/** 全リングに保持されている記録を出力済みのものも含めて表示する
+ *  @param[in]  fp  出力先
+ */
+void
+ipmsg_trace_dump(FILE *fp) {
+	GSList *node;
+	trace_ring_t *ring;
+	trace_record_t rec;
+	guint head;
+	guint seq;
+	guint count;
+
+	if (fp == NULL)
+		return;
+
+	g_static_mutex_lock(&rings_mutex);
+	for(node = rings; node != NULL; node = g_slist_next(node)) {
+		ring = (trace_ring_t *)node->data;
+		head = (guint)g_atomic_int_get(&ring->head);
+		count = MIN(head, IPMSG_TRACE_RING_SIZE);
+
+		fprintf(fp, "=== trace thread %p (%u records) ===\n", 
+		    ring->owner, count);
+		for(seq = head - count; seq != head; ++seq) {
+			if (!read_record(ring, seq, &rec))
+				continue;
+			fprintf(fp, "%ld.%06ld L%d %s", 
+			    (long)rec.tv.tv_sec, (long)rec.tv.tv_usec, 
+			    rec.level, rec.text);
+		}
+	}
+	g_static_mutex_unlock(&rings_mutex);
+
+	fflush(fp);
+}
+
+/** トレース機構を初期化し, 書き出しスレッドを起動する
+ *  @retval  0       正常終了
+ *  @retval -ENOMEM  書き出しスレッドを起動できなかった
+ */
+int
+ipmsg_trace_init(void) {
+	int rc;
+	struct sigaction act;
+
+	if (flush_thread != NULL)
+		return 0;
+
+	memset(&act, 0, sizeof(struct sigaction));
+	act.sa_handler = trace_dump_signal_handler;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &act, NULL);
+
+	g_atomic_int_set(&flush_thread_stop, 0);
+	flush_thread = g_thread_create(trace_flush_thread, NULL, TRUE, NULL);
+	if (flush_thread == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+	g_atomic_int_set(&trace_state, IPMSG_TRACE_STATE_RUNNING);
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	return rc;
+}
+
+/** 書き出しスレッドを停止し, 残りの記録を書き出す
+ */
+void
+ipmsg_trace_cleanup(void) {
+	trace_ring_t *self;
+
+	g_atomic_int_set(&trace_state, IPMSG_TRACE_STATE_STOPPED);
+
+	if (flush_thread != NULL) {
+		g_atomic_int_set(&flush_thread_stop, 1);
+		g_thread_join(flush_thread);
+		flush_thread = NULL;
+	}
+
+	flush_rings();
+
+	/*
+	 * 呼び出し元スレッドのリングのみ解放する.
+	 * 動作中の他スレッドのリングは, スレッド終了時に
+	 * mark_ring_deadから参照されるため解放しない.
+	 */
+	self = g_static_private_get(&thread_ring);
+	g_static_private_set(&thread_ring, NULL, NULL);
+	if (self == NULL)
+		return;
+
+	g_static_mutex_lock(&rings_mutex);
+	rings = g_slist_remove(rings, self);
+	g_static_mutex_unlock(&rings_mutex);
+
+	g_free(self);
+}
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if !defined(TRACE_H)
+#define TRACE_H
+
+#define IPMSG_LOG_NONE                (0)  /* 出力しない       */
+#define IPMSG_LOG_ERR                 (1)  /* エラーのみ       */
+#define IPMSG_LOG_WARN                (2)  /* 警告以上         */
+#define IPMSG_LOG_DEBUG               (3)  /* デバッグ文を含む */
+
+#define IPMSG_TRACE_RING_SIZE         (256)  /* スレッド毎の記録数(2の冪)  */
+#define IPMSG_TRACE_MSG_LEN           (256)  /* 1記録あたりの最大長  */
+#define IPMSG_TRACE_FLUSH_INTERVAL_MS (100)  /* 書き出しスレッドの起床間隔(ms) */
+
+/** 現在の出力レベル(構成情報の変更時に更新する)
+ */
+extern volatile gint ipmsg_log_level;
+
+/** 指定したレベルの出力が有効か判定する
+ *  @param[in]  level  出力レベル
+ *  @attention 呼び出し箇所のコストを分岐1つに抑えるためGConfを参照しない.
+ */
+#define ipmsg_log_enabled(level) G_UNLIKELY(ipmsg_log_level >= (level))
+
+void ipmsg_trace_set_level(int level, gboolean trace_only);
+void ipmsg_trace_out(int level, const char *file, const char *func, int line,
+		     const char *fmt, ...) G_GNUC_PRINTF(5, 6);
+void ipmsg_trace_dump(FILE *fp);
+int ipmsg_trace_init(void);
+void ipmsg_trace_cleanup(void);
+#endif  /*  TRACE_H  */
@@ -23,25 +23,53 @@
  * SUCH DAMAGE.
  */
 
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  /*  recvmmsg(2), sendmmsg(2)  */
+#endif  /*  !_GNU_SOURCE  */
+
 #include "common.h"
 
+/** 受信時の補助データ格納領域
+ */
+typedef union _udp_recv_ctrl{
+	struct cmsghdr hdr;  /*  アラインメント確保用  */
+	char buf[64];
+}udp_recv_ctrl_t;
+
 GList *con_list = NULL;
 GStaticMutex udp_list_mutex = G_STATIC_MUTEX_INIT;
 
-const char *
-udp_get_peeraddr(const udp_con_t *con){
-	int                rc = 0;
-	struct addrinfo *info = NULL;
+/** 受信統計情報
+ * @attention 内部リンケージ
+ */
+static udp_recv_stat_t recv_stat;
 
-	g_assert(con != NULL);
+/** 再利用待ちの受信バッファ
+ * @attention 内部リンケージ
+ */
+static GSList *msg_buf_pool = NULL;
 
-	info = con->server_info;
-	g_assert(info != NULL);
+/** 再利用待ちの受信バッファ数
+ * @attention 内部リンケージ
+ */
+static int msg_buf_pool_count = 0;
 
-	rc = netcommon_get_peeraddr(info, (char *)con->peer); 
-  
-	return (const char *)con->peer;
-}
+/** 受信バッファプール排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex msg_buf_pool_mutex = G_STATIC_MUTEX_INIT;
+
+/** 受信統計情報排他用ロック
+ * @attention 内部リンケージ
+ */
+static GStaticMutex recv_stat_mutex = G_STATIC_MUTEX_INIT;
+
+/** カーネルが最後に通知した破棄データグラム数(SO_RXQ_OVFL)
+ * @attention 内部リンケージ
+ */
+static guint32 last_drop_count = 0;
+
+static int udp_setup_socket_options(const udp_con_t *con);
 
 int 
 udp_setup_server(udp_con_t *con, int port, int family) {
@@ -92,6 +120,10 @@ udp_setup_server(udp_con_t *con, int port, int family) {
 	}
 #endif /*  IPV6_V6ONLY  */
 
+	rc = udp_setup_socket_options(con);
+	if (rc != 0)
+		goto error_out;
+
 	con->server_info = info;
 
 	rc = 0;
@@ -139,6 +171,90 @@ error_out:
 	return rc;
 }
 
+/** 送信先アドレスを名前解決する
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  ipaddr       送信先IPアドレス文字列
+ *  @param[in]  port         送信先ポート番号
+ *  @param[out] addr         解決したアドレスの返却領域
+ *  @param[out] lenp         解決したアドレス長の返却領域
+ *  @retval  0       正常終了
+ *  @retval -EINVAL 引数異常
+ *  @retval -ENOSPC 解決したアドレスが返却領域に収まらない
+ *  @retval 上記以外 名前解決失敗
+ */
+int
+udp_resolve_peer_addr(const udp_con_t *con, const char *ipaddr, int port, 
+    struct sockaddr_storage *addr, socklen_t *lenp) {
+	int                rc = 0;
+	struct addrinfo *info = NULL;
+
+	if ( (con == NULL) || (ipaddr == NULL) || 
+	    (addr == NULL) || (lenp == NULL) )
+		return -EINVAL;
+
+	rc = setup_addr_info(&info, ipaddr, port, SOCK_DGRAM, con->family);
+	if (rc < 0)
+		goto error_out;
+
+	if (info->ai_addrlen > sizeof(struct sockaddr_storage)) {
+		rc = -ENOSPC;
+		goto error_out;
+	}
+
+	memcpy(addr, info->ai_addr, info->ai_addrlen);
+	*lenp = info->ai_addrlen;
+
+	rc = 0; /* 正常終了 */
+
+error_out:
+	if (info != NULL)
+		freeaddrinfo(info);
+
+	return rc;
+}
+
+/** 名前解決済みのアドレスにメッセージを送信する
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  addr         送信先アドレス
+ *  @param[in]  addrlen      送信先アドレス長
+ *  @param[in]  port         送信先ポート番号
+ *  @param[in]  msg          送信するメッセージ
+ *  @param[in]  len          送信するメッセージ長
+ *  @retval  0以上   送信したバイト数
+ *  @retval -EINVAL 引数異常
+ *  @retval -EAFNOSUPPORT 送信先アドレスのファミリが不正
+ *  @retval 上記以外 送信失敗(-errno)
+ *  @note 送信先アドレスのポート番号は, portで置き換えて送信する.
+ */
+int
+udp_send_message_to(const udp_con_t *con, const struct sockaddr_storage *addr,
+    socklen_t addrlen, int port, const char *msg, size_t len) {
+	int                    rc = 0;
+	struct sockaddr_storage to;
+
+	if ( (con == NULL) || (addr == NULL) || (msg == NULL) ||
+	    (addrlen == 0) || (addrlen > sizeof(to)) )
+		return -EINVAL;
+
+	memcpy(&to, addr, addrlen);
+	switch (to.ss_family) {
+	case AF_INET:
+		((struct sockaddr_in *)&to)->sin_port = htons(port);
+		break;
+	case AF_INET6:
+		((struct sockaddr_in6 *)&to)->sin6_port = htons(port);
+		break;
+	default:
+		return -EAFNOSUPPORT;
+	}
+
+	rc = sendto(con->soc, msg, len, 0, (struct sockaddr *)&to, addrlen);
+	if (rc < 0)
+		rc = -errno;
+
+	return rc;
+}
+
 int
 udp_send_peer(const udp_con_t *con, const char *msg, size_t len) {
 	int                rc = 0;
@@ -260,6 +376,92 @@ udp_send_broadcast(const udp_con_t *con,const char *msg,size_t len){
   return udp_send_broadcast_with_addr(con,NULL,msg,len);
 }
 
+/** 同一のメッセージを複数の送信先に送信する
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in,out] targets   送信先配列(各要素のresultに送信結果を返却する)
+ *  @param[in]  count        送信先数
+ *  @param[in]  msg          送信するメッセージ
+ *  @param[in]  len          送信するメッセージ長
+ *  @retval  0以上   送信に失敗した送信先の数
+ *  @retval -EINVAL 引数異常
+ *  @note sendmmsg(2)が使用可能な場合は, UDP_SEND_BATCH_MAX件ずつ
+ *        まとめて送信する.
+ */
+int
+udp_send_multi(const udp_con_t *con, udp_send_target_t *targets, int count,
+    const char *msg, size_t len) {
+	int                  rc = 0;
+	int                sent = 0;
+	int            failures = 0;
+	struct iovec        iov;
+#if defined(HAVE_SENDMMSG)
+	int                   i = 0;
+	int                   n = 0;
+	struct mmsghdr msgs[UDP_SEND_BATCH_MAX];
+#endif  /*  HAVE_SENDMMSG  */
+
+	if ( (con == NULL) || (targets == NULL) || (count < 0) || (msg == NULL) )
+		return -EINVAL;
+
+	iov.iov_base = (void *)msg;
+	iov.iov_len  = len;
+
+#if defined(HAVE_SENDMMSG)
+	while (sent < count) {
+		n = count - sent;
+		if (n > UDP_SEND_BATCH_MAX)
+			n = UDP_SEND_BATCH_MAX;
+
+		memset(msgs, 0, sizeof(struct mmsghdr) * n);
+		for(i = 0; i < n; ++i) {
+			msgs[i].msg_hdr.msg_iov     = &iov;
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+			msgs[i].msg_hdr.msg_name    = &targets[sent + i].addr;
+			msgs[i].msg_hdr.msg_namelen = targets[sent + i].addrlen;
+		}
+
+		rc = sendmmsg(con->soc, msgs, n, 0);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			/*
+			 * 先頭の送信先で失敗した. 失敗を記録して次の送信先から
+			 * 再開する.
+			 */
+			targets[sent].result = -errno;
+			++failures;
+			++sent;
+			continue;
+		}
+		if (rc == 0) {
+			targets[sent].result = -EIO;
+			++failures;
+			++sent;
+			continue;
+		}
+
+		for(i = 0; i < rc; ++i)
+			targets[sent + i].result = msgs[i].msg_len;
+		sent += rc;
+	}
+#else
+	for(sent = 0; sent < count; ++sent) {
+		rc = sendto(con->soc, iov.iov_base, iov.iov_len, 0, 
+		    (struct sockaddr *)&targets[sent].addr, 
+		    targets[sent].addrlen);
+		if (rc < 0) {
+			targets[sent].result = -errno;
+			++failures;
+		} else
+			targets[sent].result = rc;
+	}
+#endif  /*  HAVE_SENDMMSG  */
+
+	dbg_out("sent to %d targets (%d failed)\n", count, failures);
+
+	return failures;
+}
+
 
 int 
 alloc_udp_connection(udp_con_t **con_p) {
@@ -459,7 +661,7 @@ udp_server_setup(int port, int family) {
 		con->family = node->ai_family;
 		con->port   = port;
 
-		rc = udp_enable_broadcast(con);
+		rc = udp_setup_socket_options(con);
 		if (rc < 0)
 			goto free_connections;
 		
@@ -487,12 +689,66 @@ error_out:
 static int
 udp_set_buffer(const udp_con_t *con){
   int rc;
-  int size=0;
 
   if (!con)
     return -EINVAL;
 
-  return sock_set_buffer(con->soc, _MSG_BUF_MIN_SIZE, _MSG_BUF_SIZE);
+  rc = sock_set_buffer(con->soc, _MSG_BUF_MIN_SIZE, _MSG_BUF_SIZE);
+  if (rc < 0)
+    return rc;
+
+  return sock_set_recv_buffer(con->soc, _MSG_BUF_MIN_SIZE, 
+      hostinfo_refer_ipmsg_recv_bufsize());
+}
+
+/** カーネルによるデータグラム破棄数の通知を有効にする
+ *  @param[in]  con          UDPコネクション情報
+ *  @retval     0            正常終了(未対応の環境を含む)
+ *  @retval    -EINVAL       引数異常
+ *  @attention 内部リンケージ
+ */
+static int
+udp_enable_drop_report(const udp_con_t *con){
+#if defined(SO_RXQ_OVFL)
+  int flag;
+#endif  /*  SO_RXQ_OVFL  */
+
+  if (!con)
+    return -EINVAL;
+
+#if defined(SO_RXQ_OVFL)
+  flag=1;
+  if (setsockopt(con->soc, SOL_SOCKET, SO_RXQ_OVFL, (void*)&flag, sizeof(int)) < 0)
+    war_out("Can not enable drop report:%s(%d)\n",strerror(errno),errno);
+#endif  /*  SO_RXQ_OVFL  */
+
+  return 0;
+}
+
+/** ソケットの受信設定を行う
+ *  @param[in]  con          UDPコネクション情報
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    負の値        ブロードキャストを設定できなかった(-errno)
+ *  @note 受信毎に設定しないよう, ソケット生成時に一度だけ呼び出す.
+ *  @attention 内部リンケージ
+ */
+static int
+udp_setup_socket_options(const udp_con_t *con){
+  int rc;
+
+  if (!con)
+    return -EINVAL;
+
+  rc=udp_set_buffer(con);
+  if (rc<0)
+    war_out("Can not set socket buffer:%s(%d)\n",strerror(-rc),-rc);
+
+  rc=udp_enable_drop_report(con);
+  if (rc<0)
+    return rc;
+
+  return udp_enable_broadcast(con);
 }
 
 int
@@ -546,70 +802,355 @@ udp_disable_broadcast(const udp_con_t *con){
   return 0;
 }
 
+/** 受信バッファを獲得する
+ *  @return 受信バッファ(_MSG_BUF_SIZE + 1バイト)
+ *  @retval NULL メモリ不足
+ *  @note 返却されたバッファはudp_put_msg_bufferで返却する.
+ */
+char *
+udp_get_msg_buffer(void) {
+	char *buf = NULL;
+
+	g_static_mutex_lock(&msg_buf_pool_mutex);
+	if (msg_buf_pool != NULL) {
+		buf = msg_buf_pool->data;
+		msg_buf_pool = g_slist_delete_link(msg_buf_pool, msg_buf_pool);
+		--msg_buf_pool_count;
+	}
+	g_static_mutex_unlock(&msg_buf_pool_mutex);
+
+	if (buf == NULL)
+		buf = g_malloc(_MSG_BUF_SIZE + 1);
+
+	return buf;
+}
+
+/** 受信バッファを返却する
+ *  @param[in]  data         udp_get_msg_bufferで獲得したバッファ
+ *  @note GDestroyNotifyとして使用できる.
+ *        プールが上限に達している場合は解放する.
+ */
+void
+udp_put_msg_buffer(gpointer data) {
+
+	if (data == NULL)
+		return;
+
+	g_static_mutex_lock(&msg_buf_pool_mutex);
+	if (msg_buf_pool_count < UDP_MSG_BUF_POOL_MAX) {
+		msg_buf_pool = g_slist_prepend(msg_buf_pool, data);
+		++msg_buf_pool_count;
+		data = NULL;
+	}
+	g_static_mutex_unlock(&msg_buf_pool_mutex);
+
+	if (data != NULL)
+		g_free(data);
+}
+
+/** 再利用待ちの受信バッファを全て解放する
+ */
+void
+udp_release_msg_buffers(void) {
+	GSList *node = NULL;
+
+	g_static_mutex_lock(&msg_buf_pool_mutex);
+	for(node = msg_buf_pool; node != NULL; node = g_slist_next(node))
+		g_free(node->data);
+	g_slist_free(msg_buf_pool);
+	msg_buf_pool = NULL;
+	msg_buf_pool_count = 0;
+	g_static_mutex_unlock(&msg_buf_pool_mutex);
+}
+
+/** 一括受信用バッファを確保する
+ *  @param[out] batch_p      確保したバッファを指すポインタの格納先アドレス
+ *  @param[in]  nr_slots     一度に受信するデータグラムの最大数
+ *                           (1からUDP_RECV_BATCH_MAXの範囲に丸める)
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ *  @retval    -ENOMEM       メモリ不足
+ */
 int
-udp_recv_message(const udp_con_t *con,char **msg,size_t *len){
-  ssize_t recv_len;
-  char *recv_buf=NULL;
-  int old_fd_flags;
-  int rc;
-  int ret_code=0;
-  struct addrinfo *info;
+udp_alloc_recv_batch(udp_recv_batch_t **batch_p, int nr_slots) {
+	int                  rc = 0;
+	int                   i = 0;
+	udp_recv_batch_t *batch = NULL;
 
-  if ( (!con) || (!msg) || (!len) )
-    return -EINVAL;
+	if ( (batch_p == NULL) || (*batch_p != NULL) )
+		return -EINVAL;
 
-  g_assert(*msg==NULL);  
+	if (nr_slots <= 0)
+		nr_slots = 1;
+	if (nr_slots > UDP_RECV_BATCH_MAX)
+		nr_slots = UDP_RECV_BATCH_MAX;
 
-  recv_buf=g_malloc(_MSG_BUF_SIZE);
-  if (!recv_buf)
-    return -ENOMEM;
+	batch = g_malloc(sizeof(udp_recv_batch_t));
+	if (batch == NULL)
+		return -ENOMEM;
 
-  rc=udp_set_buffer(con);
-  if (rc<0)
-    goto error_out;
+	memset(batch, 0, sizeof(udp_recv_batch_t));
 
-  rc=udp_enable_broadcast(con);
-  if (rc<0)
-    goto error_out;
-
-  info=con->server_info;
-  /*
-   *  空読みする
-   */
-
-  recv_len=recvfrom(con->soc,recv_buf,_MSG_BUF_SIZE,(MSG_PEEK|MSG_DONTWAIT),info->ai_addr,&(info->ai_addrlen));
-  if (recv_len<=0) {
-    err_out("%s(errno:%d)\n",strerror(errno),errno);
-    ret_code=-errno;
-    goto error_out;
-  }
+	for(i = 0; i < nr_slots; ++i) {
+		batch->bufs[i] = udp_get_msg_buffer();
+		if (batch->bufs[i] == NULL) {
+			rc = -ENOMEM;
+			goto free_batch_out;
+		}
+		++batch->nr_slots;
+	}
 
-  dbg_out("read:%d %s\n",recv_len,recv_buf);
-  /*
-   *  バッファに読み込む
-   */
-  recv_len=recvfrom(con->soc,recv_buf,recv_len,MSG_DONTWAIT,info->ai_addr,&(info->ai_addrlen));
-  if (recv_len<0) {
-    err_out("%s(errno:%d)\n",strerror(errno),errno);
-    ret_code=-errno;
-    goto error_out;
-  }
+	dbg_out("Allocate receive batch:%d slots\n", batch->nr_slots);
 
-  /*
-   * バッファ獲得
-   */
-  
-  g_assert(*msg==NULL);
-  *msg=g_malloc(recv_len);
-  if (!(*msg))
-    goto error_out;
-  dbg_out("copy:%d %s\n",recv_len,recv_buf);
-  *len=recv_len;
-  memmove(*msg,recv_buf,recv_len);  /*  内容をコピー  */
+	*batch_p = batch;
+
+	return 0;
+
+free_batch_out:
+	udp_free_recv_batch(&batch);
+
+	return rc;
+}
+
+/** 一括受信用バッファを解放する
+ *  @param[in,out] batch_p   解放するバッファを指すポインタのアドレス
+ *  @retval     0            正常終了
+ *  @retval    -EINVAL       引数異常
+ */
+int
+udp_free_recv_batch(udp_recv_batch_t **batch_p) {
+	int                  i = 0;
+	udp_recv_batch_t *batch = NULL;
+
+	if ( (batch_p == NULL) || (*batch_p == NULL) )
+		return -EINVAL;
+
+	batch = *batch_p;
+
+	for(i = 0; i < batch->nr_slots; ++i) {
+		if (batch->bufs[i] != NULL)
+			udp_put_msg_buffer(batch->bufs[i]);
+	}
+
+	g_free(batch);
+
+	*batch_p = NULL;
+
+	return 0;
+}
+
+/** 受信統計情報を更新する
+ *  @param[in]  count        今回受信したデータグラム数
+ *  @attention 内部リンケージ
+ */
+static void
+udp_update_recv_stat(int count) {
+
+	g_static_mutex_lock(&recv_stat_mutex);
+
+	++recv_stat.wakeups;
+	if (count == 0)
+		++recv_stat.empty_wakeups;
+	recv_stat.packets += count;
+	++recv_stat.batches[count];
+
+	g_static_mutex_unlock(&recv_stat_mutex);
+}
+
+/** 受信時の補助データからカーネルによる破棄数を取り出し記録する
+ *  @param[in]  hdr          受信したメッセージヘッダ
+ *  @attention 内部リンケージ
+ */
+static void
+udp_check_drop_count(const struct msghdr *hdr) {
+#if defined(SO_RXQ_OVFL)
+	struct cmsghdr *cmsg = NULL;
+	guint32         drops = 0;
+
+	for(cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; 
+	    cmsg = CMSG_NXTHDR((struct msghdr *)hdr, cmsg)) {
+		if ( (cmsg->cmsg_level != SOL_SOCKET) || 
+		    (cmsg->cmsg_type != SO_RXQ_OVFL) )
+			continue;
+
+		memcpy(&drops, CMSG_DATA(cmsg), sizeof(guint32));
+
+		g_static_mutex_lock(&recv_stat_mutex);
+		if (drops != last_drop_count) {
+			war_out("%u datagrams dropped by kernel "
+			    "(receive buffer too small?)\n", 
+			    drops - last_drop_count);
+			recv_stat.drops += (guint32)(drops - last_drop_count);
+			last_drop_count = drops;
+		}
+		g_static_mutex_unlock(&recv_stat_mutex);
+	}
+#endif  /*  SO_RXQ_OVFL  */
+}
+
+/** 受信済みのデータグラムをまとめて読み込む
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in,out] batch     一括受信用バッファ
+ *                           (batch->countに受信したデータグラム数を設定する)
+ *  @retval     0以上        受信したデータグラム数
+ *  @retval    -EINVAL       引数異常
+ *  @retval    負の値        受信時のエラー(-errno)
+ *  @note ソケットを待ち合わせることなく, 受信キュー上にある
+ *        データグラムをbatch->nr_slots個まで読み込む.
+ */
+int
+udp_recv_messages(const udp_con_t *con, udp_recv_batch_t *batch) {
+	int                 rc = 0;
+	int                  i = 0;
+	int              count = 0;
+	struct iovec     iovs[UDP_RECV_BATCH_MAX];
+	udp_recv_ctrl_t ctrls[UDP_RECV_BATCH_MAX];
+#if defined(HAVE_RECVMMSG)
+	struct mmsghdr   msgs[UDP_RECV_BATCH_MAX];
+#else
+	ssize_t       recv_len = 0;
+	struct msghdr      hdr;
+#endif  /*  HAVE_RECVMMSG  */
+
+	if ( (con == NULL) || (batch == NULL) )
+		return -EINVAL;
+
+	batch->count = 0;
+
+	/*
+	 * 前回受信時に取り出されたバッファを補充する
+	 */
+	for(i = 0; i < batch->nr_slots; ++i) {
+		if (batch->bufs[i] == NULL) {
+			batch->bufs[i] = udp_get_msg_buffer();
+			if (batch->bufs[i] == NULL)
+				return -ENOMEM;
+		}
+		iovs[i].iov_base = batch->bufs[i];
+		iovs[i].iov_len  = _MSG_BUF_SIZE;
+	}
+
+#if defined(HAVE_RECVMMSG)
+	memset(msgs, 0, sizeof(struct mmsghdr) * batch->nr_slots);
+
+	for(i = 0; i < batch->nr_slots; ++i) {
+		msgs[i].msg_hdr.msg_iov        = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen     = 1;
+		msgs[i].msg_hdr.msg_name       = &batch->addrs[i];
+		msgs[i].msg_hdr.msg_namelen    = sizeof(struct sockaddr_storage);
+		msgs[i].msg_hdr.msg_control    = ctrls[i].buf;
+		msgs[i].msg_hdr.msg_controllen = sizeof(ctrls[i].buf);
+	}
+
+	rc = recvmmsg(con->soc, msgs, batch->nr_slots, MSG_DONTWAIT, NULL);
+	if (rc < 0) {
+		if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) ) {
+			rc = -errno;
+			err_out("%s(errno:%d)\n", strerror(errno), errno);
+			goto error_out;
+		}
+		rc = 0;
+	}
+
+	for(count = 0; count < rc; ++count) {
+		batch->lens[count]     = msgs[count].msg_len;
+		batch->addrlens[count] = msgs[count].msg_hdr.msg_namelen;
+	}
+
+	if (count > 0)
+		udp_check_drop_count(&msgs[count - 1].msg_hdr);
+#else
+	for(count = 0; count < batch->nr_slots; ++count) {
+
+		memset(&hdr, 0, sizeof(struct msghdr));
+		hdr.msg_iov        = &iovs[count];
+		hdr.msg_iovlen     = 1;
+		hdr.msg_name       = &batch->addrs[count];
+		hdr.msg_namelen    = sizeof(struct sockaddr_storage);
+		hdr.msg_control    = ctrls[count].buf;
+		hdr.msg_controllen = sizeof(ctrls[count].buf);
+
+		recv_len = recvmsg(con->soc, &hdr, MSG_DONTWAIT);
+		if (recv_len < 0) {
+			if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+				break;
+			if (count > 0)
+				break;  /*  受信済みのデータを先に処理する  */
+			rc = -errno;
+			err_out("%s(errno:%d)\n", strerror(errno), errno);
+			goto error_out;
+		}
+
+		batch->lens[count]     = recv_len;
+		batch->addrlens[count] = hdr.msg_namelen;
+		udp_check_drop_count(&hdr);
+	}
+#endif  /*  HAVE_RECVMMSG  */
+
+	for(i = 0; i < count; ++i)
+		batch->bufs[i][batch->lens[i]] = '\0';  /*  文字列の終端を保証する  */
+
+	batch->count = count;
+	rc = count;
+
+	dbg_out("read %d datagrams\n", count);
 
 error_out:
-  if (recv_buf)
-    g_free(recv_buf);
+	udp_update_recv_stat(batch->count);
 
-  return ret_code;
+	return rc;
+}
+
+/** 一括受信したデータグラムのバッファを取り出す
+ *  @param[in,out] batch     一括受信用バッファ
+ *  @param[in]  index        対象データグラムのインデクス
+ *  @return 受信バッファ(_MSG_BUF_SIZE + 1バイト, 受信長の位置でヌル終端済み)
+ *  @retval NULL 引数異常
+ *  @note 取り出したバッファの所有権は呼び出し元に移る.
+ *        不要になったらudp_put_msg_bufferで返却する.
+ *        空いたスロットは次回の受信時に補充される.
+ */
+char *
+udp_take_batch_buffer(udp_recv_batch_t *batch, int index) {
+	char *buf = NULL;
+
+	if ( (batch == NULL) || (index < 0) || (index >= batch->count) )
+		return NULL;
+
+	buf = batch->bufs[index];
+	batch->bufs[index] = NULL;
+
+	return buf;
+}
+
+/** 受信統計情報を取得する
+ *  @param[out] stat         統計情報の格納先アドレス
+ */
+void
+udp_get_recv_stat(udp_recv_stat_t *stat) {
+
+	if (stat == NULL)
+		return;
+
+	g_static_mutex_lock(&recv_stat_mutex);
+	memcpy(stat, &recv_stat, sizeof(udp_recv_stat_t));
+	g_static_mutex_unlock(&recv_stat_mutex);
+}
+
+/** 受信統計情報をデバッグ出力する
+ */
+void
+udp_show_recv_stat(void) {
+	int                i = 0;
+	udp_recv_stat_t stat;
+
+	udp_get_recv_stat(&stat);
+
+	dbg_out("recv stat: wakeups:%lu empty:%lu packets:%lu drops:%lu\n",
+	    stat.wakeups, stat.empty_wakeups, stat.packets, stat.drops);
+
+	for(i = 1; i <= UDP_RECV_BATCH_MAX; ++i) {
+		if (stat.batches[i] != 0)
+			dbg_out("recv stat: batch[%d]:%lu\n", i, stat.batches[i]);
+	}
 }
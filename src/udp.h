@@ -37,6 +37,56 @@ typedef struct _udp_con{
   struct addrinfo *server_info;
 }udp_con_t;
 
+/** 一括受信時の最大受信数
+ */
+#define UDP_RECV_BATCH_MAX     (64)
+/** 一括受信時のデフォルト受信数
+ */
+#define UDP_RECV_BATCH_DEFAULT (16)
+
+/** 再利用のために保持する受信バッファの最大数
+ */
+#define UDP_MSG_BUF_POOL_MAX   (UDP_RECV_BATCH_MAX * 2)
+
+/** 受信バッファサイズ(SO_RCVBUF)のデフォルト値(1MB)
+ *  @note 多数のホストからの一斉送信(BR_ENTRY)を取りこぼさない大きさにする.
+ */
+#define UDP_RECV_BUFSIZE_DEFAULT (1024 * 1024)
+
+/** 一括送信時の送信数(sendmmsg(2)1回あたりの最大数)
+ */
+#define UDP_SEND_BATCH_MAX     (64)
+
+/** 一括送信先
+ */
+typedef struct _udp_send_target{
+  struct sockaddr_storage addr;  /*  送信先アドレス  */
+  socklen_t            addrlen;  /*  送信先アドレス長  */
+  int                   result;  /*  送信結果(送信バイト数または-errno)  */
+  char        name[NI_MAXHOST];  /*  送信先名(ログ出力用)  */
+}udp_send_target_t;
+
+/** 一括受信用バッファ
+ */
+typedef struct _udp_recv_batch{
+  int                      nr_slots;  /*  確保済みスロット数  */
+  int                         count;  /*  受信済みデータグラム数  */
+  char    *bufs[UDP_RECV_BATCH_MAX];  /*  受信バッファ  */
+  size_t   lens[UDP_RECV_BATCH_MAX];  /*  受信長  */
+  struct sockaddr_storage addrs[UDP_RECV_BATCH_MAX];  /*  送信元アドレス  */
+  socklen_t addrlens[UDP_RECV_BATCH_MAX];  /*  送信元アドレス長  */
+}udp_recv_batch_t;
+
+/** 受信統計情報
+ */
+typedef struct _udp_recv_stat{
+  unsigned long       wakeups;  /*  受信通知回数  */
+  unsigned long empty_wakeups;  /*  受信データがなかった通知回数  */
+  unsigned long       packets;  /*  受信データグラム数  */
+  unsigned long         drops;  /*  カーネルが破棄したデータグラム数(SO_RXQ_OVFL)  */
+  unsigned long   batches[UDP_RECV_BATCH_MAX + 1];  /*  一括受信数ごとの回数  */
+}udp_recv_stat_t;
+
 
 int alloc_udp_connection(udp_con_t **con_p);
 int free_udp_con_data(udp_con_t **con_p);
@@ -49,11 +99,21 @@ int udp_release_connection(udp_con_t *con);
 
 int udp_send_message(const udp_con_t *con,const char *ipaddr,int port, const char *msg,size_t len);
 int udp_send_peer(const udp_con_t *con,const char *msg,size_t len);
+int udp_resolve_peer_addr(const udp_con_t *con, const char *ipaddr, int port, struct sockaddr_storage *addr, socklen_t *lenp);
+int udp_send_message_to(const udp_con_t *con, const struct sockaddr_storage *addr, socklen_t addrlen, int port, const char *msg, size_t len);
 int udp_send_broadcast_with_addr(const udp_con_t *con,const char *bcast,const char *msg,size_t len);
 int udp_send_broadcast(const udp_con_t *con,const char *msg,size_t len);
+int udp_send_multi(const udp_con_t *con, udp_send_target_t *targets, int count, const char *msg, size_t len);
 int udp_enable_broadcast(const udp_con_t *con);
 int udp_disable_broadcast(const udp_con_t *con);
-int udp_recv_message(const udp_con_t *con,char **msg,size_t *len);
-const char *udp_get_peeraddr(const udp_con_t *con);
+char *udp_get_msg_buffer(void);
+void udp_put_msg_buffer(gpointer data);
+void udp_release_msg_buffers(void);
+int udp_alloc_recv_batch(udp_recv_batch_t **batch_p, int nr_slots);
+int udp_free_recv_batch(udp_recv_batch_t **batch_p);
+int udp_recv_messages(const udp_con_t *con, udp_recv_batch_t *batch);
+char *udp_take_batch_buffer(udp_recv_batch_t *batch, int index);
+void udp_get_recv_stat(udp_recv_stat_t *stat);
+void udp_show_recv_stat(void);
 int udp_release_connection(udp_con_t *con);
 #endif
@@ -35,28 +35,6 @@
   g_object_set_data_full (G_OBJECT (component), name, \
     gtk_widget_ref (widget), (GDestroyNotify) gtk_widget_unref)
 
-static int
-release_user_entry(GtkTreeView *view) {
-  GtkTreePath *path;
-  GtkTreeIter iter;
-  GtkTreeModel *model;
-
-  model = gtk_tree_view_get_model(view);
-  
-  if (!model)
-    return -EINVAL;
-
-  path=gtk_tree_path_new_first ();
-  g_assert(path);
-
-  if (gtk_tree_model_get_iter(model,&iter,path)) {
-    while(gtk_list_store_remove(GTK_LIST_STORE(model), &iter))
-      dbg_out("Remove OK\n");
-  }
-  gtk_tree_path_free (path);
-
-  return 0;
-}
 static void
 on_messageUserTree_user_clicked(GtkTreeViewColumn *treeviewcolumn,
 				gpointer user_data) {
@@ -347,37 +325,149 @@ setup_message_tree_view(GtkWidget *view) {
 
 }
 
-void
-update_user_entry(GList *top,GtkWidget *view,gboolean is_forced) {
-  GtkTreeIter              toplevel;
-  GtkListStore           *liststore = NULL;
-  GtkWidget             *usersEntry = NULL;
-  GtkTreeViewColumn            *col = NULL;
-  userdb_t            *current_user = NULL;
-  int                             i = 0;
-  int                   users_count = 0;
-  int                          prio = 0;
-  guint                       state = 0;
-  int                            id = 0;
-  gchar              *nick_name_ref = NULL;
-  gchar                     num_str[32];
-
-  if ( (!top) || (!view) )
-    return;
+/** ユーザ一覧の行情報
+ */
+typedef struct _user_view_row{
+  GtkTreeIter iter;  /* 行の反復子(GtkListStoreでは行が存在する間有効)  */
+  guint        sig;  /* 表示内容の要約値  */
+  guint        gen;  /* 最後に表示対象となった更新世代  */
+  gint         pos;  /* 並べ替え前の行位置  */
+}user_view_row_t;
+
+/** ユーザ一覧の行情報を解放する
+ *  @param[in]  data  行情報
+ *  @attention 内部リンケージ
+ */
+static void
+free_user_view_row(gpointer data) {
 
-  state=hostinfo_refer_header_state();
+  g_slice_free(user_view_row_t,data);
+}
+
+/** 表示内容の要約値を算出する
+ *  @param[in]  hash  途中までの要約値
+ *  @param[in]  str   表示文字列
+ *  @return 要約値
+ *  @attention 内部リンケージ
+ */
+static guint
+user_view_signature(guint hash,const gchar *str) {
+  const guchar *p;
+
+  if (str)
+    for(p=(const guchar *)str;*p;++p)
+      hash=(hash ^ *p) * 16777619U;
+
+  return (hash ^ 0xff) * 16777619U; /* 区切り */
+}
+
+/** 一覧表示の行を削除すべきか判定し, 削除する
+ *  @param[in]  key        IPアドレス
+ *  @param[in]  value      行情報
+ *  @param[in]  user_data  今回の更新世代
+ *  @retval     TRUE       今回の更新で表示対象外となった(削除した)
+ *  @retval     FALSE      表示対象
+ *  @attention 内部リンケージ
+ */
+static gboolean
+remove_stale_user_view_row(gpointer key,gpointer value,gpointer user_data) {
+  user_view_row_t *row=(user_view_row_t *)value;
+  gpointer *args=(gpointer *)user_data;
+
+  if (row->gen == GPOINTER_TO_UINT(args[1]))
+    return FALSE;
 
-  release_user_entry(GTK_TREE_VIEW(view));
-  liststore = gtk_list_store_new(MAX_VIEW_ID,
+  gtk_list_store_remove(GTK_LIST_STORE(args[0]),&row->iter);
+
+  return TRUE;
+}
+
+/** ユーザ一覧のモデルと行索引を参照する(初回は作成する)
+ *  @param[in]  view    ユーザ一覧のツリービュー
+ *  @param[out] rows_p  IPアドレスから行情報を引く索引の格納先
+ *  @return ユーザ一覧のモデル
+ *  @attention 内部リンケージ
+ */
+static GtkListStore *
+refer_user_view_store(GtkWidget *view,GHashTable **rows_p) {
+  GtkListStore *liststore;
+  GHashTable   *rows;
+
+  rows=g_object_get_data(G_OBJECT(view),"user_view_rows");
+  if (rows) {
+    *rows_p=rows;
+    return GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(view)));
+  }
+
+  liststore = gtk_list_store_new(USER_VIEW_STORE_COLUMNS,
                                  G_TYPE_STRING,
                                  G_TYPE_STRING,
                                  G_TYPE_STRING,
                                  G_TYPE_STRING,
                                  G_TYPE_STRING,
-				 G_TYPE_STRING);
+				 G_TYPE_STRING,
+				 G_TYPE_POINTER);
+  gtk_tree_view_set_model(GTK_TREE_VIEW(view), GTK_TREE_MODEL(liststore));
+  g_object_unref(liststore); /* destroy model automatically with view */
 
-  for(i=0;(current_user=g_list_nth_data(top,i));++i) {
+  rows=g_hash_table_new_full(g_str_hash,g_str_equal,g_free,free_user_view_row);
+  g_object_set_data_full(G_OBJECT(view),"user_view_rows",rows,
+			 (GDestroyNotify)g_hash_table_destroy);
+
+  gtk_tree_selection_set_mode(gtk_tree_view_get_selection(GTK_TREE_VIEW(view)),
+                             GTK_SELECTION_MULTIPLE );
+  *rows_p=rows;
+
+  return liststore;
+}
+
+/** ユーザ一覧の表示を更新する
+ *  @param[in]  top        表示順に整列済みのユーザリスト
+ *  @param[in]  view       ユーザ一覧のツリービュー
+ *  @param[in]  is_forced  非表示設定のユーザも表示する
+ *  @note 一覧を作り直さず, 行の追加/削除/内容更新と一括並べ替えのみを行う.
+ */
+void
+update_user_entry(GList *top,GtkWidget *view,gboolean is_forced) {
+  static guint               update_gen = 0;
+  GtkTreeIter                      iter;
+  GtkListStore               *liststore = NULL;
+  GtkTreeModel                   *model = NULL;
+  GHashTable                      *rows = NULL;
+  GPtrArray                      *order = NULL;
+  GtkWidget                 *usersEntry = NULL;
+  GList                           *node = NULL;
+  userdb_t                *current_user = NULL;
+  user_view_row_t                  *row = NULL;
+  gint                       *new_order = NULL;
+  gpointer                      args[2];
+  gboolean                     reorder = FALSE;
+  guint                              i = 0;
+  int                      users_count = 0;
+  int                             prio = 0;
+  guint                          state = 0;
+  guint                            sig = 0;
+  gchar                  *nick_name_ref = NULL;
+  gchar                         num_str[32];
+
+  if (!view)
+    return;
+
+  state=hostinfo_refer_header_state();
+
+  liststore=refer_user_view_store(view,&rows);
+  model=GTK_TREE_MODEL(liststore);
+  order=g_ptr_array_new();
+  ++update_gen;
+
+  for(node=top;node;node=g_list_next(node)) {
+    current_user=(userdb_t *)node->data;
     g_assert(current_user);
+    ++users_count;
+
+    prio=current_user->prio;
+    if ( ( (prio<0) && (!is_forced) ) || (!(current_user->ipaddr)) )
+      continue;
 
     nick_name_ref = current_user->nickname;
     if ( (current_user->nickname == NULL) || ( current_user->nickname[0] == '\0' ) ) {
@@ -387,15 +477,6 @@ update_user_entry(GList *top,GtkWidget *view,gboolean is_forced) {
 	nick_name_ref = _("Unknown");
     }
 
-    dbg_out("Update\n");
-    dbg_out("NickName: %s\n", current_user->nickname);
-    dbg_out("Group: %s\n",current_user->group);
-    dbg_out("User: %s\n",current_user->user);
-    dbg_out("Host: %s\n",current_user->host);
-    dbg_out("IP Addr: %s\n",current_user->ipaddr);
-    dbg_out("Priority: %d\n",current_user->prio);
-
-    prio=current_user->prio;
     memset(num_str,0,32);
     if (prio>0)
       snprintf(num_str,31,"%d",prio);
@@ -403,27 +484,70 @@ update_user_entry(GList *top,GtkWidget *view,gboolean is_forced) {
       snprintf(num_str,31,"-");
     num_str[31]='\0';
 
-    if ( (prio>=0) || (is_forced) ){
-      /* Append a top level row and leave it empty */
-      gtk_list_store_append(liststore, &toplevel);
-      gtk_list_store_set(liststore, &toplevel,
+    sig=user_view_signature(2166136261U,nick_name_ref);
+    sig=user_view_signature(sig,current_user->group);
+    sig=user_view_signature(sig,current_user->host);
+    sig=user_view_signature(sig,current_user->user);
+    sig=user_view_signature(sig,num_str);
+
+    row=g_hash_table_lookup(rows,current_user->ipaddr);
+    if (!row) {
+      row=g_slice_new0(user_view_row_t);
+      gtk_list_store_append(liststore, &row->iter);
+      g_hash_table_insert(rows,g_strdup(current_user->ipaddr),row);
+      gtk_list_store_set(liststore, &row->iter,
+			 USER_VIEW_IPADDR_ID,current_user->ipaddr,
+			 USER_VIEW_ROW_ID,row,
+			 -1);
+      row->sig=~sig;
+    }
+
+    if (row->sig != sig) {
+      dbg_out("Update %s\n",current_user->ipaddr);
+      gtk_list_store_set(liststore, &row->iter,
 			 USER_VIEW_NICKNAME_ID, nick_name_ref,
 			 USER_VIEW_GROUP_ID,current_user->group,
 			 USER_VIEW_HOST_ID,current_user->host,
-			 USER_VIEW_IPADDR_ID,current_user->ipaddr,
 			 USER_VIEW_LOGON_ID,current_user->user,
 			 USER_VIEW_PRIO_ID,num_str,
 			 -1);
+      row->sig=sig;
     }
-    ++users_count;
-    fflush(stdout);
+    row->gen=update_gen;
+    g_ptr_array_add(order,row);
   }
-  gtk_tree_view_set_model(GTK_TREE_VIEW(view), GTK_TREE_MODEL(liststore));
 
-  g_object_unref(liststore); /* destroy model automatically with view */
+  /*
+   * 表示対象外となった行を削除する
+   */
+  args[0]=liststore;
+  args[1]=GUINT_TO_POINTER(update_gen);
+  g_hash_table_foreach_remove(rows,remove_stale_user_view_row,args);
+
+  /*
+   * 整列順と異なる場合は一度に並べ替える
+   */
+  i=0;
+  if (gtk_tree_model_get_iter_first(model,&iter)) {
+    do{
+      gtk_tree_model_get(model,&iter,USER_VIEW_ROW_ID,&row,-1);
+      row->pos=i;
+      if ( (i >= order->len) || (g_ptr_array_index(order,i) != row) )
+	reorder=TRUE;
+      ++i;
+    }while(gtk_tree_model_iter_next(model,&iter));
+  }
+  g_assert(i == order->len);
+
+  if (reorder) {
+    new_order=g_new(gint,order->len);
+    for(i=0;i<order->len;++i)
+      new_order[i]=((user_view_row_t *)g_ptr_array_index(order,i))->pos;
+    gtk_list_store_reorder(liststore,new_order);
+    g_free(new_order);
+  }
+  g_ptr_array_free(order,TRUE);
 
-  gtk_tree_selection_set_mode(gtk_tree_view_get_selection(GTK_TREE_VIEW(view)),
-                             GTK_SELECTION_MULTIPLE );
   /*
    * ユーザ数更新
    */
@@ -448,6 +572,8 @@ update_user_entry(GList *top,GtkWidget *view,gboolean is_forced) {
 
 void
 ipmsg_update_ui(void){
+  if (ipmsg_ui_event_is_deferred())
+    return;  /* UIスレッド以外からメインループを回さない */
   while (gtk_events_pending ())
     gtk_main_iteration ();
 }
@@ -35,6 +35,8 @@
 #define USER_VIEW_LOGON_ID       (4)
 #define USER_VIEW_PRIO_ID        (5)
 #define MAX_VIEW_ID              (6)
+#define USER_VIEW_ROW_ID         (6)  /* 行情報(非表示)  */
+#define USER_VIEW_STORE_COLUMNS  (7)
 
 #define UICOMMON_DIALOG_DELIM    ":"
 
@@ -0,0 +1,291 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+/** @file 
+ * @brief  UIスレッドへのイベント通知関数群
+ * @author Takeharu KATO
+ */ 
+
+/** UIイベント
+ */
+typedef struct _ipmsg_ui_event{
+	ipmsg_ui_event_func_t  func;  /*  処理関数  */
+	gpointer               data;  /*  イベント固有データ  */
+	GDestroyNotify      release;  /*  イベント固有データの解放関数  */
+}ipmsg_ui_event_t;
+
+/** 受信メッセージに対するUIイベント
+ */
+typedef struct _ipmsg_ui_msg_event{
+	ipmsg_ui_msg_func_t    func;  /*  処理関数  */
+	msg_data_t              msg;  /*  受信メッセージ情報の複製  */
+	char                *ipaddr;  /*  送信元IPアドレス  */
+}ipmsg_ui_msg_event_t;
+
+/** UIスレッド
+ * @attention 内部リンケージ
+ */
+static GThread *ui_thread_self = NULL;
+
+/** UIイベントキュー
+ * @attention 内部リンケージ
+ */
+static GAsyncQueue *ui_event_queue = NULL;
+
+/** イベント処理用アイドルハンドラ登録済みフラグ
+ * @attention 内部リンケージ
+ */
+static gint drain_scheduled = 0;
+
+/** UIイベントを解放する
+ *  @param[in]  ev  UIイベント
+ *  @attention 内部リンケージ
+ */
+static void
+ipmsg_ui_event_free(ipmsg_ui_event_t *ev) {
+
+	if (ev == NULL)
+		return;
+
+	if (ev->release != NULL)
+		ev->release(ev->data);
+
+	g_slice_free(ipmsg_ui_event_t, ev);
+}
+
+/** キューに溜まったUIイベントを処理する(アイドルハンドラ)
+ *  @param[in]  data  未使用
+ *  @retval     FALSE ハンドラの登録を解除する
+ *  @attention 内部リンケージ
+ */
+static gboolean
+ipmsg_ui_event_drain(gpointer data) {
+	ipmsg_ui_event_t *ev = NULL;
+
+	/*
+	 * 取り出し前にフラグを落とし, 処理中に投入されたイベントに対して
+	 * ハンドラが再登録されるようにする.
+	 */
+	g_atomic_int_set(&drain_scheduled, 0);
+
+	while ( (ev = g_async_queue_try_pop(ui_event_queue)) != NULL ) {
+
+		gdk_threads_enter();
+		ev->func(ev->data);
+		gdk_threads_leave();
+
+		ipmsg_ui_event_free(ev);
+	}
+
+	return FALSE;
+}
+
+/** UIイベント通知機構を初期化する
+ *  @retval     0       正常終了
+ *  @retval    -ENOMEM  メモリ不足
+ *  @note UIスレッドから呼び出す.
+ */
+int
+ipmsg_ui_event_init(void) {
+
+	ui_thread_self = g_thread_self();
+
+	if (ui_event_queue != NULL)
+		return 0;
+
+	ui_event_queue = g_async_queue_new();
+	if (ui_event_queue == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/** UIイベント通知機構を解放する
+ *  @note 未処理のイベントは実行せずに破棄する.
+ *        イベントを投入するスレッドの終了後に呼び出す.
+ */
+void
+ipmsg_ui_event_cleanup(void) {
+	ipmsg_ui_event_t *ev = NULL;
+
+	if (ui_event_queue == NULL)
+		return;
+
+	while ( (ev = g_async_queue_try_pop(ui_event_queue)) != NULL )
+		ipmsg_ui_event_free(ev);
+
+	g_async_queue_unref(ui_event_queue);
+	ui_event_queue = NULL;
+	ui_thread_self = NULL;
+}
+
+/** UI処理をUIスレッドへ委譲する必要があるか判定する
+ *  @retval     TRUE   UIスレッド以外から呼ばれた(イベントとして投入する)
+ *  @retval     FALSE  UIスレッドから呼ばれた(直接処理できる)
+ */
+gboolean
+ipmsg_ui_event_is_deferred(void) {
+
+	if ( (ui_thread_self == NULL) || (ui_event_queue == NULL) )
+		return FALSE;
+
+	return (g_thread_self() != ui_thread_self);
+}
+
+/** UIイベントをUIスレッドへ投入する
+ *  @param[in]  func     UIスレッドで実行する処理関数
+ *  @param[in]  data     イベント固有データ
+ *  @param[in]  release  処理後にdataを解放する関数(NULLの場合は解放しない)
+ *  @retval     0        正常終了
+ *  @retval    -EINVAL   引数異常
+ *  @retval    -ENOENT   UIイベント通知機構が初期化されていない
+ *  @retval    -ENOMEM   メモリ不足
+ *  @note dataの所有権はイベントに移る(エラー時も解放する).
+ */
+int
+ipmsg_ui_event_post(ipmsg_ui_event_func_t func, gpointer data, 
+    GDestroyNotify release) {
+	int                rc = 0;
+	ipmsg_ui_event_t  *ev = NULL;
+
+	if (func == NULL) {
+		rc = -EINVAL;
+		goto error_out;
+	}
+
+	if (ui_event_queue == NULL) {
+		rc = -ENOENT;
+		goto error_out;
+	}
+
+	ev = g_slice_new(ipmsg_ui_event_t);
+	if (ev == NULL) {
+		rc = -ENOMEM;
+		goto error_out;
+	}
+
+	ev->func    = func;
+	ev->data    = data;
+	ev->release = release;
+
+	g_async_queue_push(ui_event_queue, ev);
+
+	if (g_atomic_int_compare_and_exchange(&drain_scheduled, 0, 1))
+		g_idle_add(ipmsg_ui_event_drain, NULL);
+
+	return 0;
+
+error_out:
+	if ( (release != NULL) && (data != NULL) )
+		release(data);
+
+	return rc;
+}
+
+/** 受信メッセージに対するUIイベントを解放する
+ *  @param[in]  data  受信メッセージに対するUIイベント
+ *  @attention 内部リンケージ
+ */
+static void
+ipmsg_ui_msg_event_free(gpointer data) {
+	ipmsg_ui_msg_event_t *mev = NULL;
+
+	mev = (ipmsg_ui_msg_event_t *)data;
+	if (mev == NULL)
+		return;
+
+	release_message_data(&mev->msg);
+	if (mev->ipaddr != NULL)
+		g_free(mev->ipaddr);
+
+	g_slice_free(ipmsg_ui_msg_event_t, mev);
+}
+
+/** 受信メッセージに対するUIイベントを処理する
+ *  @param[in]  data  受信メッセージに対するUIイベント
+ *  @attention 内部リンケージ
+ */
+static void
+ipmsg_ui_msg_event_handler(gpointer data) {
+	ipmsg_ui_msg_event_t *mev = NULL;
+
+	mev = (ipmsg_ui_msg_event_t *)data;
+	g_assert(mev != NULL);
+
+	mev->func(&mev->msg, mev->ipaddr);
+}
+
+/** 受信メッセージに対するUI処理を実行する
+ *  @param[in]  func     UI処理関数
+ *  @param[in]  msg      受信メッセージ情報
+ *  @param[in]  ipaddr   送信元IPアドレス
+ *  @retval     0        正常終了(UIスレッドへ投入した場合を含む)
+ *  @retval    -EINVAL   引数異常
+ *  @retval    -ENOMEM   メモリ不足
+ *  @retval     上記以外 UI処理関数の返り値
+ *  @note UIスレッド以外から呼ばれた場合は, msgとipaddrを複製して
+ *        UIスレッドへ投入する.
+ */
+int
+ipmsg_ui_event_call_message(ipmsg_ui_msg_func_t func, const msg_data_t *msg, 
+    const char *ipaddr) {
+	int                    rc = 0;
+	ipmsg_ui_msg_event_t *mev = NULL;
+
+	if ( (func == NULL) || (msg == NULL) )
+		return -EINVAL;
+
+	if (!ipmsg_ui_event_is_deferred())
+		return func(msg, ipaddr);
+
+	mev = g_slice_new0(ipmsg_ui_msg_event_t);
+	if (mev == NULL)
+		return -ENOMEM;
+
+	mev->func = func;
+
+	init_message_data(&mev->msg);
+	rc = copy_message_data(&mev->msg, msg);
+	if (rc != 0)
+		goto free_event_out;
+
+	if (ipaddr != NULL) {
+		mev->ipaddr = g_strdup(ipaddr);
+		if (mev->ipaddr == NULL) {
+			rc = -ENOMEM;
+			goto free_event_out;
+		}
+	}
+
+	return ipmsg_ui_event_post(ipmsg_ui_msg_event_handler, mev, 
+	    ipmsg_ui_msg_event_free);
+
+free_event_out:
+	ipmsg_ui_msg_event_free(mev);
+
+	return rc;
+}
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (C) 2006 Takeharu KATO
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if !defined(G2IPMSG_UIEVENT_H)
+#define G2IPMSG_UIEVENT_H
+
+/** UIイベント処理関数
+ *  @param[in]  data  イベント固有データ
+ */
+typedef void (*ipmsg_ui_event_func_t)(gpointer data);
+
+/** 受信メッセージに対するUI処理関数
+ *  @param[in]  msg     受信メッセージ情報
+ *  @param[in]  ipaddr  送信元IPアドレス
+ */
+typedef int (*ipmsg_ui_msg_func_t)(const msg_data_t *msg, const char *ipaddr);
+
+int ipmsg_ui_event_init(void);
+void ipmsg_ui_event_cleanup(void);
+gboolean ipmsg_ui_event_is_deferred(void);
+int ipmsg_ui_event_post(ipmsg_ui_event_func_t func, gpointer data, GDestroyNotify release);
+int ipmsg_ui_event_call_message(ipmsg_ui_msg_func_t func, const msg_data_t *msg, const char *ipaddr);
+#endif /*  G2IPMSG_UIEVENT_H  */
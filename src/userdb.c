@@ -25,29 +25,428 @@
 
 #include "common.h"
 
-static GList *users=NULL;
+/** ユーザ情報の索引キー(バイナリ形式のIPアドレス)
+ */
+typedef struct _userdb_addr_key{
+  int      family;   /* アドレスファミリ  */
+  guint32  scope;    /* IPv6のスコープID  */
+  guint8   addr[16]; /* ネットワークバイトオーダのアドレス  */
+}userdb_addr_key_t;
+
+/** ユーザ一覧の整列条件(整列1回につき1度だけ読み込む)
+ */
+typedef struct _userdb_sort_config{
+  gboolean with_group;   /* グループで整列する  */
+  gboolean group_order;  /* グループを昇順に整列する  */
+  int      sub_id;       /* 第2整列キー  */
+  gboolean sub_order;    /* 第2整列キーを昇順に整列する  */
+}userdb_sort_config_t;
+
+/** 作成済みのホストリスト応答
+ */
+typedef struct _userdb_hostlist_page{
+  int    req_length;  /* 要求されたエントリ数  */
+  int    length;      /* 返却するエントリ数  */
+  int    next_start;  /* 次の要求の開始位置(0は終端)  */
+  size_t len;         /* ホストリスト文字列長  */
+  gchar *string;      /* ホストリスト文字列  */
+}userdb_hostlist_page_t;
+
+static GQueue users={NULL, NULL, 0};  /* ユーザ情報(登録順)  */
+static GHashTable *user_index=NULL;   /* アドレス -> usersのリンク  */
+static GHashTable *group_index=NULL;  /* グループ名 -> 所属ユーザ数  */
+static GHashTable *hostlist_pages=NULL; /* 開始位置 -> 作成済みホストリスト応答  */
+static int hostlist_port=0;           /* エントリの直列化に使用したポート番号  */
 static GList *waiter_windows=NULL;
 GStaticMutex userdb_mutex = G_STATIC_MUTEX_INIT;
 GStaticMutex win_mutex = G_STATIC_MUTEX_INIT;
+static gint notify_pending = 0;  /* ユーザ一覧更新通知待ち */
+
+/** IPアドレス文字列から索引キーを作成する
+ *  @param[in]  ipaddr  IPアドレス文字列(数値形式)
+ *  @param[out] key     索引キー返却領域
+ *  @retval  0       正常終了
+ *  @retval -EINVAL 数値形式のIPアドレスではない
+ *  @attention 内部リンケージ
+ */
+static int
+make_addr_key(const char *ipaddr, userdb_addr_key_t *key) {
+  char buff[NI_MAXHOST];
+  char *scope;
 
-static gint 
-userdb_find_by_ipaddr(gconstpointer a,gconstpointer b) {
-  int rc=-EINVAL;
-  userdb_t *user_a,*user_b;
+  memset(key, 0, sizeof(userdb_addr_key_t));
 
-  if ( (!a) || (!b) ) 
-    goto out;
+  if (inet_pton(AF_INET, ipaddr, key->addr) == 1) {
+    key->family = AF_INET;
+    return 0;
+  }
 
-  user_a=(userdb_t *)a;
-  user_b=(userdb_t *)b;
+  /*
+   * リンクローカルアドレスのスコープ指定(%インタフェース名)を分離する
+   */
+  g_strlcpy(buff, ipaddr, sizeof(buff));
+  scope = strchr(buff, '%');
+  if (scope != NULL) {
+    *scope++ = '\0';
+    key->scope = if_nametoindex(scope);
+    if (key->scope == 0)
+      key->scope = strtoul(scope, NULL, 10);
+  }
 
-  if (!strcmp(user_a->ipaddr,user_b->ipaddr)) 
+  if (inet_pton(AF_INET6, buff, key->addr) == 1) {
+    key->family = AF_INET6;
     return 0;
+  }
 
-  rc=-ESRCH;
- out:
+  return -EINVAL;
+}
+
+/** 索引キーのハッシュ値を算出する(FNV-1a)
+ *  @param[in]  data  索引キー
+ *  @return ハッシュ値
+ *  @attention 内部リンケージ
+ */
+static guint
+addr_key_hash(gconstpointer data) {
+  const guint8 *p = (const guint8 *)data;
+  guint32 hash = 2166136261U;
+  size_t i;
+
+  for(i = 0; i < sizeof(userdb_addr_key_t); ++i) {
+    hash ^= p[i];
+    hash *= 16777619U;
+  }
+
+  return (guint)hash;
+}
+
+/** 索引キーを比較する
+ *  @param[in]  a  索引キー
+ *  @param[in]  b  索引キー
+ *  @retval TRUE  同一アドレス
+ *  @retval FALSE 異なるアドレス
+ *  @attention 内部リンケージ
+ */
+static gboolean
+addr_key_equal(gconstpointer a, gconstpointer b) {
+
+  return (memcmp(a, b, sizeof(userdb_addr_key_t)) == 0) ? (TRUE) : (FALSE);
+}
+
+/** 索引キーを解放する
+ *  @param[in]  data  索引キー
+ *  @attention 内部リンケージ
+ */
+static void
+free_addr_key(gpointer data) {
+
+  g_slice_free(userdb_addr_key_t, data);
+}
+
+/** IPアドレスに対応するユーザ情報のリンクを検索する
+ *  @param[in]  ipaddr  IPアドレス文字列
+ *  @return ユーザ情報のリンク(見つからない場合はNULL)
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static GList *
+index_lookup(const char *ipaddr) {
+  userdb_addr_key_t key;
+
+  if ( (!ipaddr) || (!user_index) )
+    return NULL;
+
+  if (make_addr_key(ipaddr, &key) < 0)
+    return NULL;
+
+  return (GList *)g_hash_table_lookup(user_index, &key);
+}
+
+/** グループの所属ユーザ数を増やす
+ *  @param[in]  group  グループ名
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static void
+group_index_ref(const char *group) {
+  guint count;
+
+  if (!group)
+    return;
+
+  if (!group_index)
+    group_index = g_hash_table_new_full(g_str_hash, g_str_equal, 
+					g_free, NULL);
+
+  count = GPOINTER_TO_UINT(g_hash_table_lookup(group_index, group));
+  if (count == 0)
+    g_hash_table_insert(group_index, g_strdup(group), GUINT_TO_POINTER(1));
+  else
+    g_hash_table_replace(group_index, g_strdup(group), 
+			 GUINT_TO_POINTER(count + 1));
+}
+
+/** グループの所属ユーザ数を減らす
+ *  @param[in]  group  グループ名
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static void
+group_index_unref(const char *group) {
+  guint count;
+
+  if ( (!group) || (!group_index) )
+    return;
+
+  count = GPOINTER_TO_UINT(g_hash_table_lookup(group_index, group));
+  if (count <= 1)
+    g_hash_table_remove(group_index, group);
+  else
+    g_hash_table_replace(group_index, g_strdup(group), 
+			 GUINT_TO_POINTER(count - 1));
+}
+
+/** 作成済みのホストリスト応答を解放する
+ *  @param[in]  data  ホストリスト応答
+ *  @attention 内部リンケージ
+ */
+static void
+free_hostlist_page(gpointer data) {
+  userdb_hostlist_page_t *page=(userdb_hostlist_page_t *)data;
+
+  if (page->string)
+    g_free(page->string);
+  g_slice_free(userdb_hostlist_page_t, page);
+}
+
+/** 作成済みのホストリスト応答を破棄する
+ *  @note 登録簿の追加/削除/更新時に呼び出すこと.
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static void
+invalidate_hostlist_pages(void) {
+
+  if (hostlist_pages) {
+    g_hash_table_destroy(hostlist_pages);
+    hostlist_pages=NULL;
+  }
+}
+
+/** 更新前のエントリの公開鍵を引き継ぐ
+ *  @param[in,out] user     更新後のエントリ(NULLの場合は解析済みの公開鍵を破棄する)
+ *  @param[in,out] backup   更新前のエントリの複製(引き継いだ鍵はNULLにする)
+ *  @param[in]     rsa      更新前のエントリの解析済みの公開鍵(NULL可)
+ *  @note 公開鍵が変わらない場合は, 解析済みの公開鍵も引き継ぐ.
+ *        引き継がなかった解析済みの公開鍵は解放する.
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static void
+carry_over_public_key(userdb_t *user, userdb_t *backup, gpointer rsa) {
+  gboolean same_key=FALSE;
+
+  if ( (user) && (backup->pub_key_e) && (backup->pub_key_n) ) {
+    if ( (!(user->pub_key_e)) && (!(user->pub_key_n)) ) {
+      /*
+       * エントリ通知は公開鍵を含まないため, 取得済みの鍵を引き継ぐ
+       */
+      user->pub_key_e=backup->pub_key_e;
+      user->pub_key_n=backup->pub_key_n;
+      user->crypt_cap=backup->crypt_cap;
+      backup->pub_key_e=backup->pub_key_n=NULL;
+      same_key=TRUE;
+    } else if ( (user->pub_key_e) && (user->pub_key_n) &&
+		(!strcmp(user->pub_key_e,backup->pub_key_e)) &&
+		(!strcmp(user->pub_key_n,backup->pub_key_n)) )
+      same_key=TRUE;
+  }
+
+  if ( (same_key) && (rsa) ) {
+    user->pub_key_rsa=rsa;
+    rsa=NULL;
+  }
+
+#if defined(USE_OPENSSL)
+  if (rsa)
+    RSA_free((RSA *)rsa);
+#endif  /*  USE_OPENSSL  */
+}
+
+/** 作成済みのホストリスト応答が指定位置で終わるか判定する
+ *  @param[in]  key        開始位置
+ *  @param[in]  value      ホストリスト応答
+ *  @param[in]  user_data  判定する位置
+ *  @retval     TRUE       指定位置で終わる
+ *  @retval     FALSE      指定位置で終わらない
+ *  @attention 内部リンケージ
+ */
+static gboolean
+hostlist_page_ends_at(gpointer key, gpointer value, gpointer user_data) {
+  userdb_hostlist_page_t *page=(userdb_hostlist_page_t *)value;
+
+  return (page->next_start == GPOINTER_TO_INT(user_data));
+}
+
+/** 作成したホストリスト応答を保持する対象か判定する
+ *  @param[in]  start  開始位置
+ *  @param[in]  total  最後のエントリの位置
+ *  @retval     TRUE   保持する
+ *  @retval     FALSE  保持しない
+ *  @note 先頭ページ, または, 作成済みの応答が返した次の開始位置のみを
+ *        保持し, ピアが任意の開始位置を要求しても保持数が増えないようにする.
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static gboolean
+hostlist_page_cacheable(int start, unsigned int total) {
+
+  if ( (start < 0) || ((unsigned int)start > total) )
+    return FALSE;
+
+  if (start == 0)
+    return TRUE;
+
+  if (!hostlist_pages)
+    return FALSE;
+
+  return (g_hash_table_find(hostlist_pages, hostlist_page_ends_at,
+			    GINT_TO_POINTER(start)) != NULL);
+}
+
+/** ホストリスト応答用に直列化したエントリを参照する(未作成時は作成する)
+ *  @param[in]  entry  ユーザ情報
+ *  @return 直列化したエントリ(作成できなかった場合はNULL)
+ *  @note エントリは ユーザ名:ホスト名:コマンド番号:IPアドレス:
+ *        ポート番号:ニックネーム:グループ名: の形式.
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static const gchar *
+refer_hostlist_entry(userdb_t *entry) {
 
-  return rc; /* Not found */
+  if (entry->hostlist_entry)
+    return entry->hostlist_entry;
+
+  entry->hostlist_entry=g_strdup_printf("%s%c%s%c%d%c%s%c%d%c%s%c%s%c",
+	     (entry->user)?(entry->user):(HOSTLIST_DUMMY),
+	     HOSTLIST_SEPARATOR,
+	     (entry->host)?(entry->host):(HOSTLIST_DUMMY),
+	     HOSTLIST_SEPARATOR,
+	     IPMSG_ANSLIST,
+	     HOSTLIST_SEPARATOR,
+	     (entry->ipaddr)?(entry->ipaddr):(HOSTLIST_DUMMY),
+	     HOSTLIST_SEPARATOR,
+	     hostlist_port,
+	     HOSTLIST_SEPARATOR,
+	     (entry->nickname)?(entry->nickname):(HOSTLIST_DUMMY),
+	     HOSTLIST_SEPARATOR,
+	     (entry->group)?(entry->group):(HOSTLIST_DUMMY),
+	     HOSTLIST_SEPARATOR);
+  if (!(entry->hostlist_entry))
+    return NULL;
+
+  entry->hostlist_len=strlen(entry->hostlist_entry);
+  /* 従来の作成処理と同じくIPMSG_BUFSIZ-1で打ち切る  */
+  if (entry->hostlist_len > (IPMSG_BUFSIZ-1)) {
+    entry->hostlist_len=IPMSG_BUFSIZ-1;
+    entry->hostlist_entry[entry->hostlist_len]='\0';
+  }
+
+  return entry->hostlist_entry;
+}
+
+/** ユーザ情報の整列用キーを作成する
+ *  @param[in]  entry  ユーザ情報
+ *  @note 照合キーはロケールに従い, IPアドレスは数値として比較できる形式にする.
+ *        エントリの内容を変更した際に呼び出すこと.
+ *  @attention 内部リンケージ
+ */
+static void
+update_sort_keys(userdb_t *entry) {
+  userdb_addr_key_t key;
+
+  if (entry->group_key)
+    g_free(entry->group_key);
+  if (entry->user_key)
+    g_free(entry->user_key);
+  if (entry->host_key)
+    g_free(entry->host_key);
+
+  entry->group_key=(entry->group)?(g_utf8_collate_key(entry->group, -1)):(NULL);
+  entry->user_key=(entry->user)?(g_utf8_collate_key(entry->user, -1)):(NULL);
+  entry->host_key=(entry->host)?(g_utf8_collate_key(entry->host, -1)):(NULL);
+
+  /*
+   * 先頭バイトでIPv4, IPv6, その他の順に並べ, 以降はネットワークバイトオーダの
+   * アドレスをmemcmpで比較する.
+   */
+  memset(entry->addr_key, 0xff, sizeof(entry->addr_key));
+  if ( (entry->ipaddr) && (make_addr_key(entry->ipaddr, &key) == 0) ) {
+    entry->addr_key[0] = (key.family == AF_INET) ? (0) : (1);
+    memcpy(&entry->addr_key[1], key.addr, sizeof(key.addr));
+  }
+}
+
+/** ユーザ情報を末尾に登録し, 索引に追加する
+ *  @param[in]  entry  ユーザ情報
+ *  @retval  0       正常終了
+ *  @retval -EINVAL 引数異常(数値形式のIPアドレスではない)
+ *  @retval -EEXIST 登録済み
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static int
+index_insert(userdb_t *entry) {
+  userdb_addr_key_t *key;
+
+  if ( (!entry) || (!(entry->ipaddr)) )
+    return -EINVAL;
+
+  if (!user_index)
+    user_index = g_hash_table_new_full(addr_key_hash, addr_key_equal, 
+				       free_addr_key, NULL);
+
+  key = g_slice_new(userdb_addr_key_t);
+  if (make_addr_key(entry->ipaddr, key) < 0) {
+    g_slice_free(userdb_addr_key_t, key);
+    return -EINVAL;
+  }
+
+  if (g_hash_table_lookup(user_index, key)) {
+    g_slice_free(userdb_addr_key_t, key);
+    return -EEXIST;
+  }
+
+  update_sort_keys(entry);
+  invalidate_hostlist_pages();
+  g_queue_push_tail(&users, entry);
+  g_hash_table_insert(user_index, key, users.tail);
+  group_index_ref(entry->group);
+
+  return 0;
+}
+
+/** ユーザ情報を登録簿と索引から外す
+ *  @param[in]  link  ユーザ情報のリンク
+ *  @note ユーザ情報自体, および, グループの所属ユーザ数は変更しない.
+ *  @attention 内部リンケージ
+ *  @attention userdb_mutexを獲得して呼び出すこと
+ */
+static void
+index_remove(GList *link) {
+  userdb_t *entry;
+  userdb_addr_key_t key;
+
+  g_assert(link);
+  entry = (userdb_t *)link->data;
+  g_assert(entry);
+
+  if ( (user_index) && (make_addr_key(entry->ipaddr, &key) == 0) )
+    g_hash_table_remove(user_index, &key);
+
+  invalidate_hostlist_pages();
+  g_queue_delete_link(&users, link);
 }
 
 static void
@@ -165,10 +564,22 @@ destroy_user_info_contents(userdb_t *entry){
     g_free(entry->nickname);
   if (entry->ipaddr) 
     g_free(entry->ipaddr);
+  if (entry->group_key)
+    g_free(entry->group_key);
+  if (entry->user_key)
+    g_free(entry->user_key);
+  if (entry->host_key)
+    g_free(entry->host_key);
+  if (entry->hostlist_entry)
+    g_free(entry->hostlist_entry);
   if (entry->pub_key_e)
     g_free(entry->pub_key_e);
   if (entry->pub_key_n)
     g_free(entry->pub_key_n);
+#if defined(USE_OPENSSL)
+  if (entry->pub_key_rsa)
+    RSA_free((RSA *)entry->pub_key_rsa);
+#endif  /*  USE_OPENSSL  */
 
   memset(entry,0,sizeof(userdb_t));
 
@@ -186,15 +597,53 @@ do_notify_change(gpointer data,gpointer user_data) {
 
   return;
 }
-static int
-notify_userdb_changed(void){
+static void
+notify_userdb_changed_on_ui(gpointer data){
+
+  g_atomic_int_set(&notify_pending, 0);
 
   g_static_mutex_lock(&win_mutex);
   g_list_foreach(waiter_windows,
 		 do_notify_change,
 		 NULL);  
   g_static_mutex_unlock(&win_mutex);
+}
+/** 溜まったユーザ一覧の変更をアイドル時にまとめて反映する
+ *  @param[in]  data  未使用
+ *  @retval     FALSE 一度のみ実行する
+ *  @attention 内部リンケージ
+ */
+static gboolean
+notify_userdb_changed_idle(gpointer data){
+
+  notify_userdb_changed_on_ui(data);
+
+  return FALSE;
+}
+static int
+notify_userdb_changed(void){
+
+  /*
+   * ダイアルアップホストの追加/削除/アドレス変更に追従するため,
+   * ブロードキャスト送信先を再構築させる.
+   */
+  ipmsg_bcast_invalidate_dialup_targets();
 
+  /*
+   * 連続した変更(ログイン集中時など)は, 描画後のアイドル時に
+   * 一度にまとめて反映する.
+   * UIスレッド以外(ネットワークスレッド)からの通知は, 
+   * UIスレッドへイベントとして投入する.
+   */
+  if (!g_atomic_int_compare_and_exchange(&notify_pending, 0, 1))
+    return 0;
+
+  if (ipmsg_ui_event_is_deferred())
+    ipmsg_ui_event_post(notify_userdb_changed_on_ui, NULL, NULL);
+  else
+    g_idle_add(notify_userdb_changed_idle, NULL);
+
+  return 0;
 }
 
 #define strdup_with_check(dest,src,member,err_label)	\
@@ -216,11 +665,14 @@ copy_user_info(userdb_t *dest,userdb_t *src) {
   g_assert(!(dest->ipaddr));
   g_assert(!(dest->pub_key_e));
   g_assert(!(dest->pub_key_n));
+  g_assert(!(dest->pub_key_rsa)); /* 解析済みの公開鍵は複製しない  */
 
   dest->prio=src->prio;
   dest->cap=src->cap;
   dest->crypt_cap=src->crypt_cap;
   dest->pf = src->pf;
+  memcpy(&dest->peer, &src->peer, sizeof(dest->peer));
+  dest->peer_len = src->peer_len;
 
   /*  下記はマクロであることに注意  */
   strdup_with_check(dest,src,user,error_out)
@@ -253,7 +705,7 @@ fill_user_info_with_message(const udp_con_t *con, const msg_data_t *msg, userdb_
 
   memset(new_user,0,sizeof(userdb_t));
 
-  peer_addr = udp_get_peeraddr(con);
+  peer_addr = refer_peer_addr_from_msg(msg);
 
   rc=-ENOMEM;
   convert_string_internal(refer_user_name_from_msg(msg),(const gchar **)&(new_user->user));
@@ -293,6 +745,16 @@ fill_user_info_with_message(const udp_con_t *con, const msg_data_t *msg, userdb_
   new_user->prio=default_prio;
   new_user->pf = con->family;
 
+  /*
+   * 受信したデータグラムの送信元アドレスを送信先アドレスとして
+   * 保持し, ユニキャスト送信時の名前解決を省略する.
+   * エントリ更新時は, ここで最新のアドレスに置き換えられる.
+   */
+  if ( (msg->peer_len > 0) && (msg->peer_len <= sizeof(new_user->peer)) ) {
+    memcpy(&new_user->peer, &msg->peer, msg->peer_len);
+    new_user->peer_len = msg->peer_len;
+  }
+
   dbg_out("Fill:  %s %s %s %s %d %x\n",
 	  new_user->user,
 	  new_user->host,
@@ -321,8 +783,6 @@ fill_user_info_with_message(const udp_con_t *con, const msg_data_t *msg, userdb_
 static int
 add_with_userdb_entry(userdb_t *new_user){
   int rc;
-  GList *new_entry;
-  GList *current_entry=NULL;
 
   if (!new_user)
     return -EINVAL;
@@ -335,19 +795,9 @@ add_with_userdb_entry(userdb_t *new_user){
 	  (unsigned int)new_user->cap);
 
   g_static_mutex_lock(&userdb_mutex);
-  current_entry=g_list_find_custom (users,new_user,userdb_find_by_ipaddr);
-  if (!current_entry){
-    users=g_list_append(users,new_user);
-  } else {
-    rc=-EEXIST;
+  rc=index_insert(new_user);
+  if (rc<0)
     goto error_out;
-  }
-  /*
-   * 健全性チェック
-   */
-  new_entry=g_list_find_custom(users,new_user,userdb_find_by_ipaddr);
-  g_assert(new_entry);
-  g_assert(new_entry->data == new_user);
   g_static_mutex_unlock(&userdb_mutex);
   notify_userdb_changed();
 
@@ -654,17 +1104,12 @@ hostlist_userinfo_add_with_answer(const udp_con_t *con, const char *message,int
 static int 
 internal_refer_user_by_addr(const char *ipaddr,const userdb_t **entry_ref){
   int rc=-ESRCH;
-  userdb_t srch_user;
   GList *found;
 
   if ( (!ipaddr) || (!entry_ref) )
     return -EINVAL;
 
-  memset(&srch_user,0,sizeof(userdb_t));
-
-  srch_user.ipaddr=(char *)ipaddr;
-
-  found=g_list_find_custom (users,&srch_user,userdb_find_by_ipaddr);
+  found=index_lookup(ipaddr);
   if (found) {
     g_assert(found->data);
     rc=0;
@@ -704,7 +1149,7 @@ userdb_hostlist_answer_add(const udp_con_t *con,const msg_data_t *msg){
   dbg_out("Here\n");
   rc=convert_string_internal(msg->message,(const gchar **)&internal_string);
   if (rc < 0) {
-    ipmsg_err_dialog(_("Can not convert message from %s into ineternal representation"), udp_get_peeraddr(con));
+    ipmsg_err_dialog(_("Can not convert message from %s into ineternal representation"), refer_peer_addr_from_msg(msg));
     return rc;
   }
 
@@ -715,7 +1160,7 @@ userdb_hostlist_answer_add(const udp_con_t *con,const msg_data_t *msg){
 
   if (next_count) {
     dbg_out("Send next:%d\n",next_count);
-    rc=ipmsg_send_get_list(udp_con,udp_get_peeraddr(con),next_count);
+    rc=ipmsg_send_get_list(udp_con,refer_peer_addr_from_msg(msg),next_count);
   }
   if (rc<0)
     goto  free_string_out;
@@ -726,12 +1171,34 @@ userdb_hostlist_answer_add(const udp_con_t *con,const msg_data_t *msg){
  error_out:
   return rc;
 }
+/** 照合キーを比較する
+ *  @param[in]  key_a  照合キー
+ *  @param[in]  key_b  照合キー
+ *  @return strcmpと同様の比較結果(いずれかがNULLの場合は等しいとみなす)
+ *  @attention 内部リンケージ
+ */
+static gint
+compare_sort_key(const gchar *key_a,const gchar *key_b){
+
+  if ( (!key_a) || (!key_b) )
+    return 0;
+
+  return strcmp(key_a,key_b);
+}
+/** 表示設定に従ってユーザ情報を比較する
+ *  @param[in]  data_a     ユーザ情報
+ *  @param[in]  data_b     ユーザ情報
+ *  @param[in]  user_data  整列条件
+ *  @return 比較結果
+ *  @attention 内部リンケージ
+ */
 static gint 
 userdb_sort_with_view_config(gconstpointer data_a,
 			     gconstpointer data_b,
 			     gpointer user_data){
   userdb_t *user_a=(userdb_t *)data_a;
   userdb_t *user_b=(userdb_t *)data_b;  
+  const userdb_sort_config_t *config=(const userdb_sort_config_t *)user_data;
   gint rc;
 
   g_assert(user_a);
@@ -740,34 +1207,32 @@ userdb_sort_with_view_config(gconstpointer data_a,
   if (user_b->prio != user_a->prio)
     return (user_b->prio - user_a->prio);
 
-  if ( (hostinfo_refer_ipmsg_is_sort_with_group()) &&
-       ( (user_a->group) && (user_b->group) ) ) {
-    rc=strcmp(user_a->group,user_b->group);
+  if (config->with_group) {
+    rc=compare_sort_key(user_a->group_key,user_b->group_key);
     if (rc) {
-      if (hostinfo_refer_ipmsg_group_sort_order())
+      if (config->group_order)
 	return rc;
       else
 	return -rc;
     }
   }
   rc=0;
-  switch(hostinfo_refer_ipmsg_sub_sort_id()) {
+  switch(config->sub_id) {
   default:
     case SORT_TYPE_USER:
-      if ((user_a->user) && (user_b->user))
-	rc=strcmp(user_a->user,user_b->user);
+      rc=compare_sort_key(user_a->user_key,user_b->user_key);
       break;
     case SORT_TYPE_IPADDR:
-      if ((user_a->ipaddr) && (user_b->ipaddr))
-	rc=strcmp(user_a->ipaddr,user_b->ipaddr);
+      rc=memcmp(user_a->addr_key,user_b->addr_key,sizeof(user_a->addr_key));
+      if ( (!rc) && (user_a->ipaddr) && (user_b->ipaddr) )
+	rc=strcmp(user_a->ipaddr,user_b->ipaddr);  /* スコープ違い等  */
       break;
     case SORT_TYPE_MACHINE:
-      if ((user_a->host) && (user_b->host))
-	rc=strcmp(user_a->host,user_b->host);
+      rc=compare_sort_key(user_a->host_key,user_b->host_key);
       break;
   }
 
-  if (!hostinfo_refer_ipmsg_sub_sort_order())
+  if (!config->sub_order)
     return -rc;
 
   return rc;
@@ -776,16 +1241,24 @@ int
 update_users_on_message_window(GtkWidget *window,gboolean is_force){
   GtkWidget *view;
   GList *current_users;
+  userdb_sort_config_t sort_config;
 
   g_assert(window);
 
   view=lookup_widget(window,"messageUserTree");
   g_assert(view);
   dbg_out("Notify userdb change :%x\n",(unsigned int)window);
+  sort_config.with_group=hostinfo_refer_ipmsg_is_sort_with_group();
+  sort_config.group_order=hostinfo_refer_ipmsg_group_sort_order();
+  sort_config.sub_id=hostinfo_refer_ipmsg_sub_sort_id();
+  sort_config.sub_order=hostinfo_refer_ipmsg_sub_sort_order();
+
   g_static_mutex_lock(&userdb_mutex);
   current_users=g_list_copy(refer_user_list());
   if (current_users) {
-    current_users=g_list_sort(current_users,(GCompareFunc)userdb_sort_with_view_config);
+    current_users=g_list_sort_with_data(current_users,
+					userdb_sort_with_view_config,
+					&sort_config);
     update_user_entry(current_users,view,is_force);
     g_list_free(current_users);    
   }else{
@@ -835,56 +1308,42 @@ userdb_search_user_by_addr(const char *ipaddr,const userdb_t **entry_ref){
 }
 void
 userdb_print_user_list(void){
-  g_list_foreach(users,
-		 print_one_user_entry,
-		 NULL);  
+  g_queue_foreach(&users,
+		  print_one_user_entry,
+		  NULL);  
 }
-static gint 
-userdb_find_group(gconstpointer a,gconstpointer b) {
-  int rc=-EINVAL;
-
-  if ( (!a) || (!b) ) 
-    return -EINVAL;
-
+static void
+collect_one_group(gpointer key,gpointer value,gpointer user_data) {
+  GList **list_p=(GList **)user_data;
+  gchar *string;
 
-  dbg_out("Pointer:0x%x 0x%x\n",a,b);
-  return strcmp((char *)a,(char *)b);
+  string=g_strdup((const gchar *)key);
+  if (string)
+    *list_p=g_list_prepend(*list_p,string);
 }
 GList *
 get_group_list(void){
   GList *ret=NULL;
-  GList *found;
-  GList *node;
-  userdb_t *ref;
-  gchar *string;
 
   g_static_mutex_lock(&userdb_mutex);
-  for(node=g_list_first(users);node;node=g_list_next(node)) {
-    ref=node->data;
-    
-    found=g_list_find_custom (ret,ref->group,userdb_find_group);
-    if (found)
-      continue;
-    string=g_strdup(ref->group);
-    if (string)
-      ret=g_list_append(ret,string);
-  }
+  if (group_index)
+    g_hash_table_foreach(group_index,collect_one_group,&ret);
   g_static_mutex_unlock(&userdb_mutex);  
 
-  return ret;
+  return g_list_sort(ret,(GCompareFunc)strcmp);
 }
 void
 userdb_update_group_list(GtkComboBox *widget){
   if (!widget)
     return;
 
-  g_list_foreach(users,
-                 (GFunc)update_one_group_entry,
-                 widget);
+  g_queue_foreach(&users,
+                  (GFunc)update_one_group_entry,
+                  widget);
 }
 GList *
 refer_user_list(void) {
-  return users;
+  return users.head;
 }
 int 
 userdb_add_user(const udp_con_t *con,const msg_data_t *msg){
@@ -912,7 +1371,7 @@ userdb_update_user(const udp_con_t *con,const msg_data_t *msg){
   userdb_t *old_user;
   userdb_t backup_user;
   GList *update_entry;
-  GList *new_entry;
+  gpointer pub_key_rsa;
   int rc;
 
   if ( (!con) || (!msg) )
@@ -925,7 +1384,7 @@ userdb_update_user(const udp_con_t *con,const msg_data_t *msg){
     return rc;
   }
   g_static_mutex_lock(&userdb_mutex);
-  update_entry=g_list_find_custom(users,&new_user,userdb_find_by_ipaddr);
+  update_entry=index_lookup(new_user.ipaddr);
   if (!update_entry) {
     g_static_mutex_unlock(&userdb_mutex);
     destroy_user_info_contents(&new_user);
@@ -935,6 +1394,7 @@ userdb_update_user(const udp_con_t *con,const msg_data_t *msg){
      * 旧来の情報を削除して新しい情報で更新
      */
     old_user=update_entry->data;
+    group_index_unref(old_user->group);
     
     memset(&backup_user,0,sizeof(userdb_t));
     rc=copy_user_info(&backup_user,old_user);
@@ -942,30 +1402,35 @@ userdb_update_user(const udp_con_t *con,const msg_data_t *msg){
       destroy_user_info_contents(old_user);
       goto fill_error_out;
     }
+    /*  解析済みの公開鍵は複製されないため, 破棄前に取り出す  */
+    pub_key_rsa=old_user->pub_key_rsa;
+    old_user->pub_key_rsa=NULL;
     destroy_user_info_contents(old_user);    
     rc=fill_user_info_with_message(con, msg, old_user);
-    if (rc<0)
+    if (rc<0) {
+      carry_over_public_key(NULL,&backup_user,pub_key_rsa);
       goto fill_error_out;
+    }
 
     old_user->prio=backup_user.prio;
+    carry_over_public_key(old_user,&backup_user,pub_key_rsa);
+    update_sort_keys(old_user);
+    invalidate_hostlist_pages();
+    group_index_ref(old_user->group);
     destroy_user_info_contents(&backup_user);
     goto ok_out;
 
   fill_error_out:
     destroy_user_info_contents(&backup_user);
+    /*  索引キーの算出にIPアドレスを使用するため, 先に外す  */
+    old_user->ipaddr=g_strdup(new_user.ipaddr);
+    index_remove(update_entry);
     destroy_user_info(old_user);
-    users=g_list_remove_link(users,update_entry);
-    g_list_free(update_entry);
+    destroy_user_info_contents(&new_user);
     g_static_mutex_unlock(&userdb_mutex);
     return rc;
   }
  ok_out:
-  /*
-   * 健全性チェック
-   */
-  new_entry=g_list_find_custom(users,&new_user,userdb_find_by_ipaddr);
-  g_assert(new_entry);
-  g_assert(new_entry->data == old_user);
   destroy_user_info_contents(&new_user);
   g_static_mutex_unlock(&userdb_mutex);
 
@@ -1018,7 +1483,7 @@ userdb_del_user(const udp_con_t *con,const msg_data_t *msg){
 
   memset(&del_user,0,sizeof(userdb_t));
 
-  del_user.ipaddr = g_strdup(udp_get_peeraddr(con));
+  del_user.ipaddr = g_strdup(refer_peer_addr_from_msg(msg));
   if (del_user.ipaddr == NULL) {
     goto  error_out;
   }
@@ -1029,7 +1494,7 @@ userdb_del_user(const udp_con_t *con,const msg_data_t *msg){
 
   dbg_out("del user start\n");
   g_static_mutex_lock(&userdb_mutex);
-  del_entry=g_list_find_custom(users,&del_user,userdb_find_by_ipaddr);
+  del_entry=index_lookup(del_user.ipaddr);
   if (!del_entry) {
     rc=-ESRCH;
     dbg_out("No such entry:%s@%s\n",del_user.user,del_user.ipaddr);
@@ -1038,9 +1503,9 @@ userdb_del_user(const udp_con_t *con,const msg_data_t *msg){
   } 
   del_user_p=del_entry->data;
   dbg_out("Free: %x\n",(unsigned int)del_user_p);
+  index_remove(del_entry);
+  group_index_unref(del_user_p->group);
   destroy_user_info(del_user_p);
-  users=g_list_remove_link(users,del_entry);
-  g_list_free(del_entry);
   g_static_mutex_unlock(&userdb_mutex);
 
   notify_userdb_changed();
@@ -1056,6 +1521,18 @@ userdb_del_user(const udp_con_t *con,const msg_data_t *msg){
   return rc;
 }
 
+/** IPMSG_GETLISTに対するホストリスト応答を作成する
+ *  @param[in]     start       返却開始位置
+ *  @param[in,out] length      返却するエントリ数(返却したエントリ数を返す)
+ *  @param[out]    ret_string  ホストリスト文字列(呼び出し元でg_freeすること)
+ *  @retval  0       正常終了
+ *  @retval -EINVAL  引数異常
+ *  @retval -ENOENT  登録簿が空
+ *  @retval -ENOMEM  メモリ不足
+ *  @note 作成した応答は登録簿が変更されるまで保持し, 同じ要求には複写のみで答える.
+ *        保持するのはページ境界(先頭, または, 保持済みの応答の次の開始位置)
+ *        から始まる応答のみ.
+ */
 int
 userdb_get_hostlist_string(int start, int *length, const char **ret_string) {
   int index;
@@ -1063,23 +1540,56 @@ userdb_get_hostlist_string(int start, int *length, const char **ret_string) {
   unsigned int total;
   int rc;
   GList *node;
+  GList *first;
   size_t str_size=0;
   size_t len=0;
   userdb_t *data;
+  userdb_hostlist_page_t *page;
   char tmp_buff[IPMSG_BUFSIZ];
-  unsigned long command;
   char *string;
-  size_t remain_len;
+  char *sp;
   int count;
   int start_no;
+  int port;
 
   rc=-EINVAL;
   if ( (start<0) || (!length) || ((*length) < 0) || (!ret_string) )
     return rc;
 
   g_static_mutex_lock(&userdb_mutex);
+
+  /*
+   * ポート番号が変わった場合は直列化済みのエントリを作り直す
+   */
+  port=hostinfo_refer_ipmsg_port();
+  if (port != hostlist_port) {
+    for(node=users.head;node;node=g_list_next(node)) {
+      data=(userdb_t *)node->data;
+      if (data->hostlist_entry) {
+	g_free(data->hostlist_entry);
+	data->hostlist_entry=NULL;
+      }
+    }
+    invalidate_hostlist_pages();
+    hostlist_port=port;
+  }
+
+  if (hostlist_pages) {
+    page=g_hash_table_lookup(hostlist_pages,GINT_TO_POINTER(start));
+    if ( (page) && (page->req_length == (*length)) ) {
+      rc=-ENOMEM;
+      string=g_memdup(page->string,page->len+1);
+      if (!string)
+	goto unlock_out;
+      rc=0;
+      *length=page->length;
+      *ret_string=string;
+      goto unlock_out;
+    }
+  }
+
   last=start + (*length);
-  total=g_list_length(users);
+  total=users.length;
   rc=-ENOENT;
   if (!total)
     goto unlock_out;
@@ -1096,33 +1606,21 @@ userdb_get_hostlist_string(int start, int *length, const char **ret_string) {
    *ポート番号（リトルエンディアン）:ニックネーム:グループ名
    */
   /* length チェック  */
-  for(index=start,count=0;
-      ( (data=(userdb_t *)g_list_nth_data(users,index)) && (index<=last) );
-      ++index){
-    memset(tmp_buff,0,IPMSG_BUFSIZ);
-    snprintf(tmp_buff,IPMSG_BUFSIZ-1,"%s%c%s%c%d%c%s%c%d%c%s%c%s%c",
-	     (data->user)?(data->user):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     (data->host)?(data->host):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     IPMSG_ANSLIST,
-	     HOSTLIST_SEPARATOR,
-	     (data->ipaddr)?(data->ipaddr):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     hostinfo_refer_ipmsg_port(),
-	     HOSTLIST_SEPARATOR,
-	     (data->nickname)?(data->nickname):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     (data->group)?(data->group):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR);
-    len=strlen(tmp_buff);
+  rc = -ENOMEM;
+  first=g_queue_peek_nth_link(&users,start);
+  for(node=first,index=start,count=0;
+      ( (node) && (index<=last) );
+      node=g_list_next(node),++index){
+    data=(userdb_t *)node->data;
+    if (!refer_hostlist_entry(data))
+      goto unlock_out;
+    len=data->hostlist_len;
     if ( (len + str_size) > (_MSG_BUF_MIN_SIZE / 2) ) {
       last=index;
     }
     str_size += len+1;
     ++count;
   }
-  rc = -ENOMEM;
   string = g_malloc(str_size+1);
   if (!string)
     goto unlock_out;
@@ -1130,43 +1628,46 @@ userdb_get_hostlist_string(int start, int *length, const char **ret_string) {
   /*
    * 作成
    */
-  memset(string,0,str_size+1);
   if (count)
     --count;
   start_no=((start+count)==total)?(0):start+count; /* 0は終端を示す  */
-  snprintf(string,IPMSG_BUFSIZ-1,"%5d%c%5d%c",start_no,HOSTLIST_SEPARATOR,total,HOSTLIST_SEPARATOR);
+  snprintf(string,str_size,"%5d%c%5d%c",start_no,HOSTLIST_SEPARATOR,total,HOSTLIST_SEPARATOR);
   dbg_out("Create from %d to %d\n",start,last);
-  for(index=start,remain_len=(str_size-strlen(string));
+  sp=string+strlen(string);
+  for(node=first,index=start;
       index<=last;
-      ++index){
-    data=(userdb_t *)g_list_nth_data(users,index);
-    memset(tmp_buff,0,IPMSG_BUFSIZ);
-    snprintf(tmp_buff,IPMSG_BUFSIZ-1,"%s%c%s%c%d%c%s%c%d%c%s%c%s%c",
-	     (data->user)?(data->user):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     (data->host)?(data->host):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     IPMSG_ANSLIST,
-	     HOSTLIST_SEPARATOR,
-	     (data->ipaddr)?(data->ipaddr):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     hostinfo_refer_ipmsg_port(),
-	     HOSTLIST_SEPARATOR,
-	     (data->nickname)?(data->nickname):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR,
-	     (data->group)?(data->group):(HOSTLIST_DUMMY),
-	     HOSTLIST_SEPARATOR);
-    len=strlen(tmp_buff);
-    g_assert(len<=(remain_len-1));
-    dbg_out("%d th :%s\n",index,tmp_buff);
-    strncat(string,tmp_buff,remain_len);
-    remain_len -= len;
+      node=g_list_next(node),++index){
+    data=(userdb_t *)node->data;
+    memcpy(sp,data->hostlist_entry,data->hostlist_len);
+    sp += data->hostlist_len;
   }
+  *sp='\0';
   
-  len=strlen(string);
+  len=sp - string;
   if (string[len-1]==HOSTLIST_SEPARATOR)
-    string[len-1]='\0';
+    string[--len]='\0';
   dbg_out("String:%s\n",string);
+
+  /*
+   * 作成した応答を保持する
+   */
+  if (!hostlist_page_cacheable(start,total))
+    goto cache_skip;
+  if (!hostlist_pages)
+    hostlist_pages=g_hash_table_new_full(g_direct_hash,g_direct_equal,
+					 NULL,free_hostlist_page);
+  page=g_slice_new(userdb_hostlist_page_t);
+  page->req_length=*length;
+  page->length=last-start;
+  page->next_start=start_no;
+  page->len=len;
+  page->string=g_memdup(string,len+1);
+  if (page->string)
+    g_hash_table_replace(hostlist_pages,GINT_TO_POINTER(start),page);
+  else
+    g_slice_free(userdb_hostlist_page_t,page);
+
+ cache_skip:
   rc=0;
   *length=last-start;
   *ret_string=string;
@@ -1178,54 +1679,82 @@ userdb_get_hostlist_string(int start, int *length, const char **ret_string) {
 int 
 userdb_invalidate_userdb(void){
   GList *node;
+  GList *next;
   userdb_t *del_user;
-  GList *new_list=NULL;
 
   dbg_out("Here\n");
 
   g_static_mutex_lock(&userdb_mutex);
-  for(node=g_list_first(users);node;node=g_list_next (node)) {
+  for(node=users.head;node;node=next) {
+    next=g_list_next(node);
     g_assert(node->data);
     del_user=(userdb_t *)node->data;
     /*  Dial Up hostは残留組となる
      *  (可達確認がブロードキャストでできないので)
      */
     if ( del_user->cap & IPMSG_DIALUPOPT) 
-      new_list=g_list_append(new_list,del_user); 
-    else
-      destroy_user_info(del_user);
+      continue;
+
+    index_remove(node);
+    group_index_unref(del_user->group);
+    destroy_user_info(del_user);
   }
-  g_list_free (users);
-  users=new_list;
   g_static_mutex_unlock(&userdb_mutex);
 
   return 0;
 }
+/** ダイアルアップホストの送信先アドレスを収集する
+ *  @param[in]  con          UDPコネクション情報
+ *  @param[in]  port         送信先ポート番号
+ *  @param[out] targets      送信先(udp_send_target_t)の追加先配列
+ *  @retval  0以上   追加した送信先の数
+ *  @retval -EINVAL 引数異常
+ *  @note 名前解決済みのアドレスを持たないホストは, ここで解決して
+ *        ユーザ情報に記録する.
+ */
 int 
-userdb_send_broad_cast(const udp_con_t *con,const char *msg,size_t len) {
+userdb_collect_dialup_targets(const udp_con_t *con, int port, GArray *targets) {
+  int rc;
+  int count = 0;
   GList *node;
   userdb_t *the_user;
+  udp_send_target_t target;
 
-  dbg_out("Here\n");
+  if ( (!con) || (!targets) )
+    return -EINVAL;
 
   g_static_mutex_lock(&userdb_mutex);
-  for(node=g_list_first(users);node;node=g_list_next (node)) {
+  for(node=users.head;node;node=g_list_next (node)) {
     g_assert(node->data);
     the_user=(userdb_t *)node->data;
-    dbg_out("Check host:%s\n",the_user->ipaddr);
-    if (the_user->cap & IPMSG_DIALUPOPT) {
-      if (!the_user->ipaddr) {
-	dbg_out("dialup host does not have ipaddr, ignored\n");
-	print_one_user_entry((gpointer)the_user,NULL);
-      }else{
-	dbg_out("%s is dialup host\n",the_user->ipaddr);
-	udp_send_broadcast_with_addr(con,the_user->ipaddr,msg,len);
+    if (!(the_user->cap & IPMSG_DIALUPOPT))
+      continue;
+
+    if (!the_user->ipaddr) {
+      dbg_out("dialup host does not have ipaddr, ignored\n");
+      print_one_user_entry((gpointer)the_user,NULL);
+      continue;
+    }
+
+    memset(&target, 0, sizeof(target));
+    if (the_user->peer_len == 0) {
+      rc = udp_resolve_peer_addr(con, the_user->ipaddr, port, 
+	  &the_user->peer, &the_user->peer_len);
+      if (rc < 0) {
+	war_out("Can not resolve dialup host %s:%d\n", the_user->ipaddr, rc);
+	continue;
       }
     }
+    memcpy(&target.addr, &the_user->peer, the_user->peer_len);
+    target.addrlen = the_user->peer_len;
+    g_strlcpy(target.name, the_user->ipaddr, sizeof(target.name));
+    g_array_append_val(targets, target);
+    ++count;
+    dbg_out("%s is dialup host\n",the_user->ipaddr);
   }
   g_static_mutex_unlock(&userdb_mutex);
 
-  return 0;
+  return count;
 }
 int
 userdb_add_waiter_window(GtkWidget *window){
@@ -1287,6 +1816,13 @@ userdb_replace_public_key_by_addr(const char *ipaddr,const unsigned long peer_ca
     g_free(user_p->pub_key_e);
   if (user_p->pub_key_n)
     g_free(user_p->pub_key_n);
+#if defined(USE_OPENSSL)
+  /*  解析済みの公開鍵は, 次回の参照時に新しい鍵から作り直す  */
+  if (user_p->pub_key_rsa) {
+    RSA_free((RSA *)user_p->pub_key_rsa);
+    user_p->pub_key_rsa=NULL;
+  }
+#endif  /*  USE_OPENSSL  */
 
   user_p->crypt_cap=peer_cap;
   user_p->pub_key_e=e_str;
@@ -1485,6 +2021,64 @@ userdb_wait_public_key(const char *peer_addr,unsigned long *cap_p,char **key_e,c
   return rc;
 }
 
+#if defined(USE_OPENSSL)
+/** ピアの公開鍵(解析済み)を参照する
+ *  @param[in]  ipaddr   ピアのIPアドレス
+ *  @param[out] cap_p    ピアの暗号化能力の返却先
+ *  @param[out] rsa_p    ピアの公開鍵の返却先(呼び出し元でRSA_freeすること)
+ *  @retval     0        正常終了
+ *  @retval    -EINVAL   引数異常
+ *  @retval    -ESRCH    ピアが登録されていない
+ *  @retval    -ENOENT   ピアの公開鍵を受け取っていない
+ *  @retval    -ENOMEM   メモリ不足
+ *  @note hex形式の公開鍵の解析は, 公開鍵を受け取ってから最初の参照時に
+ *        1度だけ行い, ユーザ情報に保持する. 返却する鍵は参照カウンタを
+ *        加算しているため, 参照中に公開鍵が更新されても使用し続けられる.
+ */
+int 
+userdb_refer_peer_rsa_key(const char *ipaddr, unsigned long *cap_p, 
+    RSA **rsa_p) {
+	int             rc = 0;
+	userdb_t   *user_p = NULL;
+	RSA           *rsa = NULL;
+
+	if ( (ipaddr == NULL) || (cap_p == NULL) || (rsa_p == NULL) )
+		return -EINVAL;
+
+	g_static_mutex_lock(&userdb_mutex);  
+
+	rc = internal_refer_user_by_addr(ipaddr, (const userdb_t **)&user_p);
+	if (rc < 0)
+		goto unlock_out;
+
+	rc = -ENOENT;
+	if ( (user_p->crypt_cap == 0) || (user_p->pub_key_e == NULL) || 
+	    (user_p->pub_key_n == NULL) )
+		goto unlock_out;
+
+	if (user_p->pub_key_rsa == NULL) {
+		rc = pcrypt_convert_peer_key(user_p->pub_key_e, 
+		    user_p->pub_key_n, &rsa);
+		if (rc != 0)
+			goto unlock_out;
+		user_p->pub_key_rsa = rsa;
+	}
+
+	rsa = (RSA *)user_p->pub_key_rsa;
+	RSA_up_ref(rsa);
+
+	*cap_p = user_p->crypt_cap;
+	*rsa_p = rsa;
+
+	rc = 0; /* 正常終了 */
+
+unlock_out:
+	g_static_mutex_unlock(&userdb_mutex);
+
+	return rc;
+}
+#endif  /*  USE_OPENSSL  */
+
 int 
 userdb_refer_proto_family(const char *ipaddr, int *family) {
 	int             rc = -ESRCH;
@@ -1518,13 +2112,133 @@ unlock_out:
   return rc;
 }
 
+/** 名前解決済みの送信先アドレスを参照する
+ *  @param[in]  ipaddr       ユーザのIPアドレス文字列
+ *  @param[out] addr         送信先アドレス返却領域
+ *  @param[out] lenp         送信先アドレス長返却領域
+ *  @retval  0       正常終了
+ *  @retval -EINVAL 引数異常
+ *  @retval -ESRCH  ユーザが登録されていない
+ *  @retval -ENOENT 送信先アドレスが未解決
+ */
+int 
+userdb_refer_peer_sockaddr(const char *ipaddr, struct sockaddr_storage *addr, 
+    socklen_t *lenp) {
+	int             rc = -ESRCH;
+	userdb_t   *user_p = NULL;
+
+	if  ( (ipaddr == NULL) || (addr == NULL) || (lenp == NULL) )
+		return -EINVAL;
+
+	g_static_mutex_lock(&userdb_mutex);  
+
+	rc = internal_refer_user_by_addr(ipaddr, (const userdb_t **)&user_p);
+	if (rc < 0)
+		goto unlock_out;
+
+	if (user_p->peer_len == 0) {
+		rc = -ENOENT;
+		goto unlock_out;
+	}
+
+	memcpy(addr, &user_p->peer, user_p->peer_len);
+	*lenp = user_p->peer_len;
+
+	rc = 0;
+
+unlock_out:
+	g_static_mutex_unlock(&userdb_mutex);
+
+	return rc;
+}
+
+/** 名前解決済みの送信先アドレスをユーザ情報に記録する
+ *  @param[in]  ipaddr       ユーザのIPアドレス文字列
+ *  @param[in]  addr         送信先アドレス
+ *  @param[in]  len          送信先アドレス長
+ *  @retval  0       正常終了
+ *  @retval -EINVAL 引数異常
+ *  @retval -ESRCH  ユーザが登録されていない
+ */
+int 
+userdb_store_peer_sockaddr(const char *ipaddr, 
+    const struct sockaddr_storage *addr, socklen_t len) {
+	int             rc = -ESRCH;
+	userdb_t   *user_p = NULL;
+
+	if  ( (ipaddr == NULL) || (addr == NULL) || 
+	    (len == 0) || (len > sizeof(user_p->peer)) )
+		return -EINVAL;
+
+	g_static_mutex_lock(&userdb_mutex);  
+
+	rc = internal_refer_user_by_addr(ipaddr, (const userdb_t **)&user_p);
+	if (rc < 0)
+		goto unlock_out;
+
+	memcpy(&user_p->peer, addr, len);
+	user_p->peer_len = len;
+
+	rc = 0;
+
+unlock_out:
+	g_static_mutex_unlock(&userdb_mutex);
+
+	return rc;
+}
+
+/** 名前解決済みの送信先アドレスを破棄する
+ *  @param[in]  ipaddr       ユーザのIPアドレス文字列
+ *  @retval  0       正常終了
+ *  @retval -EINVAL 引数異常
+ *  @retval -ESRCH  ユーザが登録されていない
+ *  @note 次回のユニキャスト送信時に名前解決をやり直させる.
+ */
+int 
+userdb_invalidate_peer_sockaddr(const char *ipaddr) {
+	int             rc = -ESRCH;
+	userdb_t   *user_p = NULL;
+
+	if  (ipaddr == NULL)
+		return -EINVAL;
+
+	g_static_mutex_lock(&userdb_mutex);  
+
+	rc = internal_refer_user_by_addr(ipaddr, (const userdb_t **)&user_p);
+	if (rc < 0)
+		goto unlock_out;
+
+	memset(&user_p->peer, 0, sizeof(user_p->peer));
+	user_p->peer_len = 0;
+
+	rc = 0;
+
+unlock_out:
+	g_static_mutex_unlock(&userdb_mutex);
+
+	return rc;
+}
+
 int
 userdb_init_userdb(void){
-  users=NULL;
+  memset(&users,0,sizeof(users));
 
   return 0;
 }
 int 
 userdb_cleanup_userdb(void){
 
+  g_static_mutex_lock(&userdb_mutex);
+  if (user_index) {
+    g_hash_table_destroy(user_index);
+    user_index=NULL;
+  }
+  if (group_index) {
+    g_hash_table_destroy(group_index);
+    group_index=NULL;
+  }
+  invalidate_hostlist_pages();
+  g_static_mutex_unlock(&userdb_mutex);
+
+  return 0;
 }
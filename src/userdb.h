@@ -34,6 +34,8 @@
 #define make_entry_canonical(the_string) ((strncmp((the_string),HOSTLIST_DUMMY,1))?(the_string):(_("UnKnown")))
 
 
+#define USERDB_ADDR_SORT_KEY_LEN  (17)  /* アドレスファミリの順位 + アドレス(16バイト)  */
+
 typedef struct _userdb{
   gchar *user;
   gchar *host;
@@ -45,7 +47,16 @@ typedef struct _userdb{
   unsigned long crypt_cap; /*  端末ケイパビリティ(エントリパケットのフラグ)  */
   gchar *pub_key_e;  /* hexフォーマット(bigendian)の文字列  */
   gchar *pub_key_n;  /* hexフォーマット(bigendian)の文字列  */
+  gpointer pub_key_rsa; /* 解析済みの公開鍵(RSA *, 未作成時はNULL)  */
   int    pf;         /* プロトコルファミリ  */
+  struct sockaddr_storage peer; /* 名前解決済みの送信先アドレス  */
+  socklen_t peer_len;           /* 送信先アドレス長(0の場合は未解決)  */
+  gchar *group_key;  /* グループ名の照合キー(整列用)  */
+  gchar *user_key;   /* ユーザ名の照合キー(整列用)  */
+  gchar *host_key;   /* ホスト名の照合キー(整列用)  */
+  guint8 addr_key[USERDB_ADDR_SORT_KEY_LEN]; /* 数値比較用のIPアドレス(整列用)  */
+  gchar *hostlist_entry; /* ホストリスト応答用に直列化したエントリ(未作成時はNULL)  */
+  size_t hostlist_len;   /* 直列化したエントリの長さ  */
 }userdb_t;
 int userdb_init_userdb(void);
 int userdb_del_user(const udp_con_t *con,const msg_data_t *msg);
@@ -58,14 +69,20 @@ int userdb_get_hostlist_string(int start, int *length, const char **ret_string)
 void userdb_print_user_list(void);
 int update_users_on_message_window(GtkWidget *window,gboolean is_forced);
 int userdb_invalidate_userdb(void);
-int userdb_send_broad_cast(const udp_con_t *con, const char *msg,size_t len);
+int userdb_collect_dialup_targets(const udp_con_t *con, int port, GArray *targets);
 int userdb_replace_prio_by_addr(const char *ipaddr,int prio,gboolean need_notify);
 void update_all_user_list_view(void);
 int userdb_replace_public_key_by_addr(const char *ipaddr,const unsigned long peer_cap,const char *key_e,const char *key_n);
 int userdb_get_public_key_by_addr(const char *ipaddr,unsigned long *cap_p,char **key_e,char **key_n);
+#if defined(USE_OPENSSL)
+int userdb_refer_peer_rsa_key(const char *ipaddr, unsigned long *cap_p, RSA **rsa_p);
+#endif  /*  USE_OPENSSL  */
 int userdb_wait_public_key(const char *peer_addr,unsigned long *cap_p,char **key_e,char **key_n);
 int userdb_get_cap_by_addr(const char *ipaddr, unsigned long *cap_p, unsigned long *crypt_cap_p);
 int userdb_refer_proto_family(const char *ipaddr, int *family);
+int userdb_refer_peer_sockaddr(const char *ipaddr, struct sockaddr_storage *addr, socklen_t *lenp);
+int userdb_store_peer_sockaddr(const char *ipaddr, const struct sockaddr_storage *addr, socklen_t len);
+int userdb_invalidate_peer_sockaddr(const char *ipaddr);
 int userdb_cleanup_userdb(void);
 GList *refer_user_list(void);
 GList *get_group_list(void);